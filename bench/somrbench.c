@@ -0,0 +1,910 @@
+#define _GNU_SOURCE // for rand_r
+#include "map_grow.h"
+#include "vector.h"
+#include <getopt.h>
+#include <math.h>
+#include <somr/somr.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** minimum duration of a timed repetition for fast kernels, in ns */
+#define MIN_REP_NS 2e6
+#define MAX_RESULTS 1024
+
+unsigned int FEATURES_COUNTS[] = { 4, 16, 64, 256 };
+unsigned int MAP_SIDES[] = { 2, 4, 8, 16 };
+unsigned int DATASET_SIZES[] = { 1000, 10000, 100000 };
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/** single benchmarked operation, run @p ops_count times in a row */
+typedef void (*bench_fn_t)(void *ctx, unsigned int ops_count);
+/** untimed preparation run before each repetition, may be NULL */
+typedef void (*bench_reset_fn_t)(void *ctx);
+
+typedef struct bench_settings_t {
+    unsigned int warmup_count;
+    unsigned int reps_count;
+    bool quick;
+    char *filter;
+} bench_settings_t;
+
+typedef struct bench_result_t {
+    char *kernel;
+    unsigned int features_count;
+    unsigned int units_count;
+    unsigned int dataset_size;
+    unsigned int ops_per_rep;
+    double median_ns;
+    double min_ns;
+    /** number of input vectors processed per op */
+    double samples_per_op;
+    /** estimated number of bytes read or written per op */
+    double bytes_per_op;
+    /** for training modes only: total number of epochs run in network */
+    unsigned long long epochs_count;
+    /** for training modes only: mean distance of input vectors to their leaf bmu */
+    double quantization_error;
+} bench_result_t;
+
+bench_result_t results[MAX_RESULTS];
+unsigned int results_count = 0;
+
+double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int cmp_doubles(const void *lhs, const void *rhs) {
+    double l = *(const double *) lhs;
+    double r = *(const double *) rhs;
+    return (l > r) - (l < r);
+}
+
+// sorts @p times and returns their median
+double median(double *times, unsigned int count) {
+    qsort(times, count, sizeof(double), cmp_doubles);
+    if (count % 2 == 1) {
+        return times[count / 2];
+    }
+    return (times[count / 2 - 1] + times[count / 2]) / 2.0;
+}
+
+void bench_report(bench_result_t *r) {
+    printf("%-16s f=%-4u units=%-4u n=%-7u %14.1f ns/op %14.0f samples/s %8.3f GB/s\n",
+        r->kernel, r->features_count, r->units_count, r->dataset_size, r->median_ns,
+        r->samples_per_op * 1e9 / r->median_ns, r->bytes_per_op / r->median_ns);
+    fflush(stdout);
+
+    if (results_count < MAX_RESULTS) {
+        results[results_count] = *r;
+        results_count++;
+    }
+}
+
+// run warmup then timed repetitions, and store median and min time per op
+// if @p ops_per_rep is 0, it is calibrated so that a repetition lasts at least MIN_REP_NS
+void bench_run(bench_settings_t *s, bench_result_t *r, bench_fn_t fn, bench_reset_fn_t reset, void *ctx, unsigned int ops_per_rep) {
+    if (ops_per_rep == 0) {
+        ops_per_rep = 1;
+        while (true) {
+            if (reset != NULL) {
+                reset(ctx);
+            }
+            double begin = now_ns();
+            fn(ctx, ops_per_rep);
+            if (now_ns() - begin >= MIN_REP_NS || ops_per_rep >= (1u << 30)) {
+                break;
+            }
+            ops_per_rep *= 2;
+        }
+    }
+
+    for (unsigned int i = 0; i < s->warmup_count; i++) {
+        if (reset != NULL) {
+            reset(ctx);
+        }
+        fn(ctx, ops_per_rep);
+    }
+
+    double *times = malloc(sizeof(double) * s->reps_count);
+    for (unsigned int i = 0; i < s->reps_count; i++) {
+        if (reset != NULL) {
+            reset(ctx);
+        }
+        double begin = now_ns();
+        fn(ctx, ops_per_rep);
+        times[i] = (now_ns() - begin) / ops_per_rep;
+    }
+    r->ops_per_rep = ops_per_rep;
+    r->median_ns = median(times, s->reps_count);
+    r->min_ns = times[0];
+    free(times);
+
+    bench_report(r);
+}
+
+bool bench_is_enabled(bench_settings_t *s, char *kernel) {
+    return s->filter == NULL || strstr(kernel, s->filter) != NULL;
+}
+
+// dataset of @p data_vectors (filled with values and labels), normalized
+void init_dataset(somr_dataset_t *dataset, somr_data_vector_t *data_vectors, unsigned int size, unsigned int features_count) {
+    unsigned int *indices = malloc(sizeof(unsigned int) * size);
+    for (unsigned int i = 0; i < size; i++) {
+        indices[i] = i;
+    }
+
+    somr_list_t class_list;
+    somr_list_init(&class_list, true);
+    char *classes[] = { "a", "b", "c", "d" };
+    for (unsigned int i = 0; i < 4; i++) {
+        somr_list_push(&class_list, classes[i]);
+    }
+
+    somr_dataset_init(dataset, data_vectors, indices, size, features_count, &class_list);
+    somr_dataset_normalize(dataset);
+    somr_list_clear(&class_list);
+    free(indices);
+}
+
+// dataset of uniformly distributed normalized vectors
+void init_random_dataset(somr_dataset_t *dataset, unsigned int size, unsigned int features_count, unsigned int *rand_state) {
+    somr_data_vector_t *data_vectors = malloc(sizeof(somr_data_vector_t) * size);
+    somr_data_vector_init_batch(data_vectors, size, features_count);
+    for (unsigned int i = 0; i < size; i++) {
+        for (unsigned int j = 0; j < features_count; j++) {
+            data_vectors[i].weights[j] = (double) rand_r(rand_state) / (double) RAND_MAX + 1e-6;
+        }
+        data_vectors[i].label = i % 4;
+    }
+    init_dataset(dataset, data_vectors, size, features_count);
+}
+
+// dataset of normalized vectors drawn around @p clusters_count x @p clusters_count nested gaussian clusters
+void init_clustered_dataset(somr_dataset_t *dataset, unsigned int size, unsigned int features_count, unsigned int clusters_count, unsigned int *rand_state) {
+    double *centers = malloc(sizeof(double) * clusters_count * clusters_count * features_count);
+    for (unsigned int i = 0; i < clusters_count; i++) {
+        double *top_center = &centers[i * clusters_count * features_count];
+        for (unsigned int j = 0; j < features_count; j++) {
+            top_center[j] = 0.2 + 0.6 * rand_r(rand_state) / (double) RAND_MAX;
+        }
+        for (unsigned int k = 1; k < clusters_count; k++) {
+            double *center = &top_center[k * features_count];
+            for (unsigned int j = 0; j < features_count; j++) {
+                center[j] = top_center[j] + 0.1 * (rand_r(rand_state) / (double) RAND_MAX - 0.5);
+            }
+        }
+    }
+
+    somr_data_vector_t *data_vectors = malloc(sizeof(somr_data_vector_t) * size);
+    somr_data_vector_init_batch(data_vectors, size, features_count);
+    for (unsigned int i = 0; i < size; i++) {
+        unsigned int cluster = rand_r(rand_state) % (clusters_count * clusters_count);
+        somr_data_vector_t *v = &data_vectors[i];
+        v->label = cluster / clusters_count;
+        for (unsigned int j = 0; j < features_count; j++) {
+            // noise from sum of uniforms, clamped to positive values
+            double noise = (rand_r(rand_state) + rand_r(rand_state)) / (double) RAND_MAX - 1.0;
+            double value = centers[cluster * features_count + j] + 0.02 * noise;
+            v->weights[j] = (value > 1e-6) ? value : 1e-6;
+        }
+    }
+    init_dataset(dataset, data_vectors, size, features_count);
+    free(centers);
+}
+
+// dataset of normalized sparse vectors with @p nnz_count non-zero features each (one per band of features), and its dense copy
+void init_sparse_datasets(somr_dataset_t *sparse, somr_dataset_t *dense, unsigned int size, unsigned int features_count, unsigned int nnz_count, unsigned int *rand_state) {
+    unsigned int band = features_count / nnz_count;
+    unsigned int *offsets = malloc(sizeof(unsigned int) * (size + 1));
+    unsigned int *nnz_indices = malloc(sizeof(unsigned int) * size * nnz_count);
+    double *nnz_values = malloc(sizeof(double) * size * nnz_count);
+    unsigned int *indices = malloc(sizeof(unsigned int) * size);
+    for (unsigned int i = 0; i < size; i++) {
+        offsets[i] = i * nnz_count;
+        for (unsigned int j = 0; j < nnz_count; j++) {
+            nnz_indices[offsets[i] + j] = j * band + rand_r(rand_state) % band;
+            nnz_values[offsets[i] + j] = (double) rand_r(rand_state) / (double) RAND_MAX + 1e-6;
+        }
+        indices[i] = i;
+    }
+    offsets[size] = size * nnz_count;
+
+    somr_data_vector_t *sparse_vectors = malloc(sizeof(somr_data_vector_t) * size);
+    somr_data_vector_init_sparse_batch(sparse_vectors, size, offsets, nnz_indices, nnz_values);
+    somr_data_vector_t *dense_vectors = malloc(sizeof(somr_data_vector_t) * size);
+    somr_data_vector_init_batch(dense_vectors, size, features_count);
+    for (unsigned int i = 0; i < size; i++) {
+        sparse_vectors[i].label = i % 4;
+        dense_vectors[i].label = i % 4;
+        memset(dense_vectors[i].weights, 0, sizeof(double) * features_count);
+        somr_data_vector_add_to(&sparse_vectors[i], dense_vectors[i].weights, features_count);
+    }
+
+    somr_list_t class_list;
+    somr_list_init(&class_list, true);
+    char *classes[] = { "a", "b", "c", "d" };
+    for (unsigned int i = 0; i < 4; i++) {
+        somr_list_push(&class_list, classes[i]);
+    }
+    somr_dataset_init(sparse, sparse_vectors, indices, size, features_count, &class_list);
+    somr_dataset_init(dense, dense_vectors, indices, size, features_count, &class_list);
+    somr_dataset_normalize(sparse);
+    somr_dataset_normalize(dense);
+    somr_list_clear(&class_list);
+    free(indices);
+    free(offsets);
+}
+
+// mean distance of all input vectors to the bmu of the leaf map they are classified in
+double compute_network_error(somr_network_t *network, somr_dataset_t *dataset) {
+    double sum = 0.0;
+    for (unsigned int i = 0; i < dataset->size; i++) {
+        somr_data_vector_t *v = &dataset->data_vectors[i];
+        somr_map_t *map = network->root.child;
+        while (true) {
+            somr_unit_t *bmu = &map->units[somr_map_find_bmu(map, v)];
+            if (bmu->child == NULL) {
+                sum += sqrt(bmu->activation);
+                break;
+            }
+            map = bmu->child;
+        }
+    }
+    return sum / dataset->size;
+}
+
+// map of @p side x @p side units with random weights
+void init_random_map(somr_map_t *map, unsigned int side, unsigned int features_count, unsigned int *rand_state) {
+    somr_map_init(map, features_count);
+    while (map->height < side) {
+        somr_map_insert_row(map, 0);
+    }
+    while (map->width < side) {
+        somr_map_insert_col(map, 0);
+    }
+    somr_map_init_random_weights(map, rand_state);
+}
+
+typedef struct kernel_ctx_t {
+    somr_dataset_t *dataset;
+    somr_map_t map;
+    somr_trainer_t trainer;
+    somr_trainer_settings_t settings;
+    unsigned int map_side;
+    unsigned int next_vector;
+    double sink;
+} kernel_ctx_t;
+
+void bench_dist(void *ctx, unsigned int ops_count) {
+    kernel_ctx_t *k = ctx;
+    double *ref = k->map.units[0].weights;
+    double sum = 0.0;
+    for (unsigned int i = 0; i < ops_count; i++) {
+        somr_data_vector_t *v = &k->dataset->data_vectors[k->next_vector];
+        sum += somr_vector_euclid_dist_squared(ref, v->weights, k->dataset->features_count);
+        k->next_vector = (k->next_vector + 1) % k->dataset->size;
+    }
+    k->sink += sum;
+}
+
+void bench_find_bmu(void *ctx, unsigned int ops_count) {
+    kernel_ctx_t *k = ctx;
+    unsigned int sum = 0;
+    for (unsigned int i = 0; i < ops_count; i++) {
+        somr_data_vector_t *v = &k->dataset->data_vectors[k->next_vector];
+        sum += somr_map_find_bmu(&k->map, v);
+        k->next_vector = (k->next_vector + 1) % k->dataset->size;
+    }
+    k->sink += sum;
+}
+
+void bench_teach_nbhd(void *ctx, unsigned int ops_count) {
+    kernel_ctx_t *k = ctx;
+    double radius = sqrt(k->map.units_count) / 2;
+    for (unsigned int i = 0; i < ops_count; i++) {
+        somr_data_vector_t *v = &k->dataset->data_vectors[k->next_vector];
+        somr_map_teach_nbhd(&k->map, i % k->map.units_count, v, 0.1, radius);
+        k->next_vector = (k->next_vector + 1) % k->dataset->size;
+    }
+}
+
+void bench_epoch(void *ctx, unsigned int ops_count) {
+    kernel_ctx_t *k = ctx;
+    double radius = sqrt(k->map.units_count) / 2;
+    for (unsigned int i = 0; i < ops_count; i++) {
+        somr_trainer_run_epoch(&k->trainer, radius, 0.5);
+    }
+}
+
+void bench_spread_reset(void *ctx) {
+    kernel_ctx_t *k = ctx;
+    somr_map_clear(&k->map);
+    k->settings.rand_state = 42;
+    init_random_map(&k->map, k->map_side, k->dataset->features_count, &k->settings.rand_state);
+}
+
+void bench_spread(void *ctx, unsigned int ops_count) {
+    kernel_ctx_t *k = ctx;
+    for (unsigned int i = 0; i < ops_count; i++) {
+        somr_unit_id_t error_unit_id = somr_trainer_compute_error(&k->trainer);
+        somr_trainer_spread(&k->trainer, error_unit_id);
+    }
+}
+
+void bench_kernels(bench_settings_t *s) {
+    unsigned int features_counts_count = s->quick ? 2 : ARRAY_SIZE(FEATURES_COUNTS);
+    unsigned int map_sides_count = s->quick ? 2 : ARRAY_SIZE(MAP_SIDES);
+    unsigned int dataset_sizes_count = s->quick ? 1 : ARRAY_SIZE(DATASET_SIZES);
+
+    for (unsigned int f = 0; f < features_counts_count; f++) {
+        unsigned int features_count = FEATURES_COUNTS[f];
+        for (unsigned int n = 0; n < dataset_sizes_count; n++) {
+            unsigned int dataset_size = DATASET_SIZES[n];
+            unsigned int rand_state = 42;
+            somr_dataset_t dataset;
+            init_random_dataset(&dataset, dataset_size, features_count, &rand_state);
+            double vector_bytes = sizeof(double) * features_count;
+
+            for (unsigned int m = 0; m < map_sides_count; m++) {
+                unsigned int map_side = MAP_SIDES[m];
+                kernel_ctx_t k;
+                k.dataset = &dataset;
+                k.map_side = map_side;
+                k.next_vector = 0;
+                k.sink = 0.0;
+                somr_trainer_settings_init(&k.settings, 0.5, 0.05, 0.01, 1, true, 42);
+                init_random_map(&k.map, map_side, features_count, &k.settings.rand_state);
+                somr_map_update_norms(&k.map);
+                somr_trainer_init(&k.trainer, &k.map, &dataset, 1.0, 1.0, &k.settings);
+
+                unsigned int units_count = k.map.units_count;
+                double map_bytes = vector_bytes * units_count;
+                bench_result_t r = { NULL, features_count, units_count, dataset_size, 0, 0.0, 0.0, 0.0, 0.0, 0, 0.0 };
+
+                // kernels independent of map size are only run once per dataset
+                if (m == 0 && bench_is_enabled(s, "dist_squared")) {
+                    r.kernel = "dist_squared";
+                    r.samples_per_op = 1.0;
+                    r.bytes_per_op = 2.0 * vector_bytes;
+                    bench_run(s, &r, bench_dist, NULL, &k, 0);
+                }
+                // same for kernels independent of dataset size
+                if (n == 0 && bench_is_enabled(s, "find_bmu")) {
+                    r.kernel = "find_bmu";
+                    r.samples_per_op = 1.0;
+                    r.bytes_per_op = map_bytes + vector_bytes;
+                    bench_run(s, &r, bench_find_bmu, NULL, &k, 0);
+                }
+                if (n == 0 && bench_is_enabled(s, "find_bmu_full")) {
+                    // euclidean distance of vectors with unknown norm, without dot product fast path
+                    r.kernel = "find_bmu_full";
+                    r.samples_per_op = 1.0;
+                    r.bytes_per_op = map_bytes + vector_bytes;
+                    for (unsigned int i = 0; i < dataset_size; i++) {
+                        dataset.data_vectors[i].norm_squared = -1.0;
+                    }
+                    bench_run(s, &r, bench_find_bmu, NULL, &k, 0);
+                    for (unsigned int i = 0; i < dataset_size; i++) {
+                        dataset.data_vectors[i].norm_squared = 1.0;
+                    }
+                }
+                if (n == 0 && bench_is_enabled(s, "find_bmu_indexed")) {
+                    // units skipped by triangle inequality, index built out of timed loop
+                    r.kernel = "find_bmu_indexed";
+                    r.samples_per_op = 1.0;
+                    r.bytes_per_op = map_bytes + vector_bytes;
+                    somr_map_build_index(&k.map);
+                    bench_run(s, &r, bench_find_bmu, NULL, &k, 0);
+                    k.map.is_indexed = false;
+                }
+                for (somr_metric_t metric = SOMR_METRIC_COSINE; metric < SOMR_METRICS_COUNT && n == 0; metric++) {
+                    char kernel[32];
+                    snprintf(kernel, sizeof(kernel), "find_bmu_%s", somr_metric_get_name(metric));
+                    if (bench_is_enabled(s, kernel)) {
+                        r.kernel = strdup(kernel);
+                        r.samples_per_op = 1.0;
+                        r.bytes_per_op = map_bytes + vector_bytes;
+                        k.map.metric = metric;
+                        bench_run(s, &r, bench_find_bmu, NULL, &k, 0);
+                        k.map.metric = SOMR_METRIC_EUCLID;
+                    }
+                }
+                if (n == 0 && bench_is_enabled(s, "teach_nbhd")) {
+                    r.kernel = "teach_nbhd";
+                    r.samples_per_op = 1.0;
+                    r.bytes_per_op = 2.0 * map_bytes + vector_bytes;
+                    bench_run(s, &r, bench_teach_nbhd, NULL, &k, 0);
+                }
+                if (bench_is_enabled(s, "run_epoch")) {
+                    r.kernel = "run_epoch";
+                    r.samples_per_op = dataset_size;
+                    r.bytes_per_op = dataset_size * (3.0 * map_bytes + vector_bytes);
+                    bench_run(s, &r, bench_epoch, NULL, &k, 1);
+                }
+                if (bench_is_enabled(s, "spread")) {
+                    // one op = error computation + insertion of a row or column
+                    r.kernel = "spread";
+                    r.samples_per_op = dataset_size;
+                    r.bytes_per_op = dataset_size * (map_bytes + 2.0 * vector_bytes) + map_bytes;
+                    bench_run(s, &r, bench_spread, bench_spread_reset, &k, 1);
+                }
+
+                somr_map_clear(&k.map);
+            }
+
+            somr_dataset_clear(&dataset);
+        }
+    }
+}
+
+void bench_train(bench_settings_t *s) {
+    if (!bench_is_enabled(s, "network_train")) {
+        return;
+    }
+
+    unsigned int features_counts_count = s->quick ? 1 : 3;
+    unsigned int dataset_sizes_count = s->quick ? 1 : 2;
+    unsigned int iters_count = s->quick ? 5 : 10;
+
+    for (unsigned int f = 0; f < features_counts_count; f++) {
+        unsigned int features_count = FEATURES_COUNTS[f];
+        for (unsigned int n = 0; n < dataset_sizes_count; n++) {
+            unsigned int dataset_size = DATASET_SIZES[n];
+            unsigned int rand_state = 42;
+            somr_dataset_t dataset;
+            init_random_dataset(&dataset, dataset_size, features_count, &rand_state);
+
+            double *times = malloc(sizeof(double) * s->reps_count);
+            unsigned int units_count = 0;
+            for (unsigned int i = 0; i < s->warmup_count + s->reps_count; i++) {
+                somr_network_t network;
+                somr_network_init(&network, features_count);
+                double begin = now_ns();
+                somr_network_train(&network, &dataset, 0.5, 0.1, 0.05, iters_count, true, 42);
+                double elapsed = now_ns() - begin;
+                if (i >= s->warmup_count) {
+                    times[i - s->warmup_count] = elapsed;
+                }
+                units_count = network.root.child->units_count;
+                somr_network_clear(&network);
+            }
+
+            bench_result_t r = { "network_train", features_count, units_count, dataset_size, 1, 0.0, 0.0, 0.0, 0.0, 0, 0.0 };
+            r.median_ns = median(times, s->reps_count);
+            r.min_ns = times[0];
+            r.samples_per_op = dataset_size;
+            r.bytes_per_op = (double) dataset_size * sizeof(double) * features_count;
+            free(times);
+            bench_report(&r);
+
+            somr_dataset_clear(&dataset);
+        }
+    }
+}
+
+/** variant of trainer settings compared by modes benchmark */
+typedef struct train_mode_t {
+    char *name;
+    void (*configure)(somr_trainer_settings_t *settings);
+} train_mode_t;
+
+void configure_fixed(somr_trainer_settings_t *settings) {
+    (void) settings;
+}
+
+void configure_adaptive(somr_trainer_settings_t *settings) {
+    settings->convergence_tolerance = 0.01;
+    settings->early_spread_ratio = 1.5;
+}
+
+void configure_sampled(somr_trainer_settings_t *settings) {
+    settings->samples_per_unit = 100;
+}
+
+void configure_multi(somr_trainer_settings_t *settings) {
+    settings->max_insertions = 8;
+}
+
+void configure_local(somr_trainer_settings_t *settings) {
+    settings->full_pass_period = 4;
+}
+
+train_mode_t TRAIN_MODES[] = {
+    { "train_fixed", configure_fixed },
+    { "train_adaptive", configure_adaptive },
+    { "train_sampled", configure_sampled },
+};
+
+/** growth modes, compared on a single map that grows large */
+train_mode_t GROWTH_MODES[] = {
+    { "grow_single", configure_fixed },
+    { "grow_multi", configure_multi },
+    { "grow_local", configure_local },
+};
+
+// train same dataset with each mode, and compare time, number of epochs and final error
+void bench_train_modes(bench_settings_t *s, train_mode_t *modes, unsigned int modes_count, somr_dataset_t *dataset, somr_trainer_settings_t *base_settings) {
+    unsigned int features_count = dataset->features_count;
+    unsigned int dataset_size = dataset->size;
+
+    for (unsigned int m = 0; m < modes_count; m++) {
+        train_mode_t *mode = &modes[m];
+        if (!bench_is_enabled(s, mode->name)) {
+            continue;
+        }
+
+        somr_trainer_settings_t settings = *base_settings;
+        mode->configure(&settings);
+
+        bench_result_t r = { mode->name, features_count, 0, dataset_size, 1, 0.0, 0.0, dataset_size, 0.0, 0, 0.0 };
+        double *times = malloc(sizeof(double) * s->reps_count);
+        for (unsigned int i = 0; i < s->warmup_count + s->reps_count; i++) {
+            somr_network_t network;
+            somr_network_init(&network, features_count);
+            double begin = now_ns();
+            somr_network_train_with_settings(&network, dataset, &settings);
+            double elapsed = now_ns() - begin;
+            if (i >= s->warmup_count) {
+                times[i - s->warmup_count] = elapsed;
+            }
+
+            // training is deterministic, keep last network measures
+            r.units_count = 0;
+            for (unsigned int j = 0; j < network.stats.maps_count; j++) {
+                r.units_count += network.stats.maps[j].width * network.stats.maps[j].height;
+            }
+            r.epochs_count = network.stats.total.epochs_count;
+            r.quantization_error = compute_network_error(&network, dataset);
+            somr_network_clear(&network);
+        }
+        r.median_ns = median(times, s->reps_count);
+        r.min_ns = times[0];
+        r.bytes_per_op = (double) r.epochs_count * dataset_size * sizeof(double) * features_count;
+        free(times);
+
+        bench_report(&r);
+        printf("%-16s epochs=%llu qe=%.6f\n", "", r.epochs_count, r.quantization_error);
+    }
+}
+
+void bench_modes(bench_settings_t *s) {
+    unsigned int features_count = 16;
+    unsigned int dataset_size = s->quick ? 2000 : 20000;
+    unsigned int iters_count = s->quick ? 20 : 50;
+    unsigned int rand_state = 42;
+    somr_dataset_t dataset;
+    init_clustered_dataset(&dataset, dataset_size, features_count, 4, &rand_state);
+
+    somr_trainer_settings_t settings;
+    somr_trainer_settings_init(&settings, 0.5, 0.1, 0.02, iters_count, true, 42);
+    bench_train_modes(s, TRAIN_MODES, ARRAY_SIZE(TRAIN_MODES), &dataset, &settings);
+
+    somr_dataset_clear(&dataset);
+}
+
+// single map (depth threshold of 1 prevents deepening) spreading to a large size on many clusters
+void bench_growth(bench_settings_t *s) {
+    unsigned int features_count = 16;
+    unsigned int dataset_size = s->quick ? 2000 : 10000;
+    unsigned int iters_count = s->quick ? 10 : 20;
+    unsigned int rand_state = 42;
+    somr_dataset_t dataset;
+    init_clustered_dataset(&dataset, dataset_size, features_count, 64, &rand_state);
+
+    somr_trainer_settings_t settings;
+    somr_trainer_settings_init(&settings, 0.5, 0.005, 1.0, iters_count, true, 42);
+    bench_train_modes(s, GROWTH_MODES, ARRAY_SIZE(GROWTH_MODES), &dataset, &settings);
+
+    somr_dataset_clear(&dataset);
+}
+
+// same high-dimensional data in sparse and dense representations, cost of sparse kernels should follow non-zero count
+void bench_sparse(bench_settings_t *s) {
+    unsigned int features_count = s->quick ? 2000 : 20000;
+    unsigned int nnz_count = features_count / 100;
+    unsigned int dataset_size = 1000;
+    unsigned int map_side = 8;
+    unsigned int rand_state = 42;
+    somr_dataset_t datasets[2];
+    init_sparse_datasets(&datasets[0], &datasets[1], dataset_size, features_count, nnz_count, &rand_state);
+    char *find_bmu_kernels[2] = { "find_bmu_sparse", "find_bmu_dense" };
+    char *epoch_kernels[2] = { "run_epoch_sparse", "run_epoch_dense" };
+
+    for (unsigned int d = 0; d < 2; d++) {
+        double vector_bytes = (d == 0) ? (sizeof(double) + sizeof(unsigned int)) * nnz_count : sizeof(double) * features_count;
+        kernel_ctx_t k;
+        k.dataset = &datasets[d];
+        k.map_side = map_side;
+        k.next_vector = 0;
+        k.sink = 0.0;
+        somr_trainer_settings_init(&k.settings, 0.5, 0.05, 0.01, 1, true, 42);
+        init_random_map(&k.map, map_side, features_count, &k.settings.rand_state);
+        somr_map_update_norms(&k.map);
+        somr_trainer_init(&k.trainer, &k.map, k.dataset, 1.0, 1.0, &k.settings);
+
+        unsigned int units_count = k.map.units_count;
+        bench_result_t r = { NULL, features_count, units_count, dataset_size, 0, 0.0, 0.0, 0.0, 0.0, 0, 0.0 };
+        if (bench_is_enabled(s, find_bmu_kernels[d])) {
+            // sparse search reads the weights at non-zero features only
+            r.kernel = find_bmu_kernels[d];
+            r.samples_per_op = 1.0;
+            r.bytes_per_op = units_count * ((d == 0) ? sizeof(double) * nnz_count : vector_bytes) + vector_bytes;
+            bench_run(s, &r, bench_find_bmu, NULL, &k, 0);
+        }
+        if (bench_is_enabled(s, epoch_kernels[d])) {
+            r.kernel = epoch_kernels[d];
+            r.samples_per_op = dataset_size;
+            r.bytes_per_op = dataset_size * (3.0 * units_count * sizeof(double) * ((d == 0) ? nnz_count : features_count) + vector_bytes);
+            bench_run(s, &r, bench_epoch, NULL, &k, 1);
+        }
+
+        somr_map_clear(&k.map);
+        somr_dataset_clear(&datasets[d]);
+    }
+}
+
+// same dense data stored with each encoding, quantized kernels read fewer bytes per input vector
+void bench_quantized(bench_settings_t *s) {
+    unsigned int features_count = 256;
+    unsigned int dataset_size = s->quick ? 10000 : 100000;
+    unsigned int map_side = 4;
+
+    for (somr_encoding_t encoding = SOMR_ENCODING_DOUBLE; encoding < SOMR_ENCODINGS_COUNT; encoding++) {
+        char find_bmu_kernel[32];
+        char epoch_kernel[32];
+        snprintf(find_bmu_kernel, sizeof(find_bmu_kernel), "find_bmu_%s", somr_encoding_get_name(encoding));
+        snprintf(epoch_kernel, sizeof(epoch_kernel), "run_epoch_%s", somr_encoding_get_name(encoding));
+        if (!bench_is_enabled(s, find_bmu_kernel) && !bench_is_enabled(s, epoch_kernel)) {
+            continue;
+        }
+
+        unsigned int rand_state = 42;
+        somr_dataset_t dataset;
+        init_clustered_dataset(&dataset, dataset_size, features_count, 4, &rand_state);
+        somr_dataset_quantize(&dataset, encoding);
+        double vector_bytes = somr_dataset_get_feature_size(&dataset) * features_count;
+
+        kernel_ctx_t k;
+        k.dataset = &dataset;
+        k.map_side = map_side;
+        k.next_vector = 0;
+        k.sink = 0.0;
+        somr_trainer_settings_init(&k.settings, 0.5, 0.05, 0.01, 1, true, 42);
+        init_random_map(&k.map, map_side, features_count, &k.settings.rand_state);
+        somr_map_update_norms(&k.map);
+        somr_trainer_init(&k.trainer, &k.map, &dataset, 1.0, 1.0, &k.settings);
+
+        unsigned int units_count = k.map.units_count;
+        bench_result_t r = { NULL, features_count, units_count, dataset_size, 0, 0.0, 0.0, 0.0, 0.0, 0, 0.0 };
+        if (bench_is_enabled(s, find_bmu_kernel)) {
+            r.kernel = strdup(find_bmu_kernel);
+            r.samples_per_op = 1.0;
+            r.bytes_per_op = vector_bytes;
+            bench_run(s, &r, bench_find_bmu, NULL, &k, 0);
+        }
+        if (bench_is_enabled(s, epoch_kernel)) {
+            r.kernel = strdup(epoch_kernel);
+            r.samples_per_op = dataset_size;
+            r.bytes_per_op = dataset_size * vector_bytes;
+            bench_run(s, &r, bench_epoch, NULL, &k, 1);
+        }
+
+        somr_map_clear(&k.map);
+        somr_dataset_clear(&dataset);
+    }
+}
+
+/** projection applied before training, compared by projection benchmark (none if output count is 0) */
+typedef struct projection_mode_t {
+    char *name;
+    somr_projection_kind_t kind;
+    unsigned int output_count;
+} projection_mode_t;
+
+projection_mode_t PROJECTION_MODES[] = {
+    { "project_none", SOMR_PROJECTION_PCA, 0 },
+    { "project_random_8", SOMR_PROJECTION_RANDOM, 8 },
+    { "project_random_32", SOMR_PROJECTION_RANDOM, 32 },
+    { "project_pca_8", SOMR_PROJECTION_PCA, 8 },
+    { "project_pca_32", SOMR_PROJECTION_PCA, 32 },
+};
+
+typedef struct leaf_entry_t {
+    somr_unit_t *unit;
+    unsigned int index;
+} leaf_entry_t;
+
+int cmp_leaf_entries(const void *lhs, const void *rhs) {
+    uintptr_t l = (uintptr_t) ((const leaf_entry_t *) lhs)->unit;
+    uintptr_t r = (uintptr_t) ((const leaf_entry_t *) rhs)->unit;
+    return (l > r) - (l < r);
+}
+
+// mean distance of input vectors to the centroid of the vectors classified in the same leaf unit, in input space
+// (comparable between networks trained with and without projection)
+double compute_centroid_error(somr_network_t *network, somr_dataset_t *dataset) {
+    unsigned int features_count = dataset->features_count;
+    leaf_entry_t *entries = malloc(sizeof(leaf_entry_t) * dataset->size);
+    somr_data_vector_t projected;
+    if (network->projection != NULL) {
+        somr_data_vector_init_batch(&projected, 1, network->projection->output_count);
+    }
+    for (unsigned int i = 0; i < dataset->size; i++) {
+        somr_data_vector_t *v = &dataset->data_vectors[i];
+        if (network->projection != NULL) {
+            somr_projection_apply(network->projection, v, projected.weights);
+            v = &projected;
+        }
+        somr_map_t *map = network->root.child;
+        somr_unit_t *bmu = &map->units[somr_map_find_bmu(map, v)];
+        while (bmu->child != NULL) {
+            map = bmu->child;
+            bmu = &map->units[somr_map_find_bmu(map, v)];
+        }
+        entries[i].unit = bmu;
+        entries[i].index = i;
+    }
+    if (network->projection != NULL) {
+        somr_data_vector_clear_batch(&projected, 1);
+    }
+    qsort(entries, dataset->size, sizeof(leaf_entry_t), cmp_leaf_entries);
+
+    double sum = 0.0;
+    double *centroid = malloc(sizeof(double) * features_count);
+    for (unsigned int begin = 0, end = 0; begin < dataset->size; begin = end) {
+        memset(centroid, 0, sizeof(double) * features_count);
+        for (end = begin; end < dataset->size && entries[end].unit == entries[begin].unit; end++) {
+            somr_data_vector_add_to(&dataset->data_vectors[entries[end].index], centroid, features_count);
+        }
+        for (unsigned int j = 0; j < features_count; j++) {
+            centroid[j] /= end - begin;
+        }
+        for (unsigned int i = begin; i < end; i++) {
+            sum += somr_vector_euclid_dist(centroid, dataset->data_vectors[entries[i].index].weights, features_count);
+        }
+    }
+    free(centroid);
+    free(entries);
+    return sum / dataset->size;
+}
+
+// wide clustered data trained directly or after projections, time includes fitting and applying projection
+void bench_projection(bench_settings_t *s) {
+    unsigned int features_count = 256;
+    unsigned int dataset_size = s->quick ? 2000 : 10000;
+    unsigned int iters_count = s->quick ? 10 : 20;
+    unsigned int rand_state = 42;
+    somr_dataset_t dataset;
+    init_clustered_dataset(&dataset, dataset_size, features_count, 4, &rand_state);
+
+    for (unsigned int m = 0; m < ARRAY_SIZE(PROJECTION_MODES); m++) {
+        projection_mode_t *mode = &PROJECTION_MODES[m];
+        if (!bench_is_enabled(s, mode->name)) {
+            continue;
+        }
+
+        bench_result_t r = { mode->name, features_count, 0, dataset_size, 1, 0.0, 0.0, dataset_size, 0.0, 0, 0.0 };
+        double *times = malloc(sizeof(double) * s->reps_count);
+        for (unsigned int i = 0; i < s->warmup_count + s->reps_count; i++) {
+            somr_network_t network;
+            double begin = now_ns();
+            if (mode->output_count > 0) {
+                unsigned int projection_state = 42;
+                somr_projection_t *projection = malloc(sizeof(somr_projection_t));
+                somr_projection_init(projection, &dataset, mode->kind, mode->output_count, &projection_state);
+                somr_network_init(&network, mode->output_count);
+                somr_network_set_projection(&network, projection);
+            } else {
+                somr_network_init(&network, features_count);
+            }
+            somr_network_train(&network, &dataset, 0.5, 0.1, 0.02, iters_count, true, 42);
+            double elapsed = now_ns() - begin;
+            if (i >= s->warmup_count) {
+                times[i - s->warmup_count] = elapsed;
+            }
+
+            r.units_count = 0;
+            for (unsigned int j = 0; j < network.stats.maps_count; j++) {
+                r.units_count += network.stats.maps[j].width * network.stats.maps[j].height;
+            }
+            r.epochs_count = network.stats.total.epochs_count;
+            r.quantization_error = compute_centroid_error(&network, &dataset);
+            somr_network_clear(&network);
+        }
+        r.median_ns = median(times, s->reps_count);
+        r.min_ns = times[0];
+        unsigned int trained_count = (mode->output_count > 0) ? mode->output_count : features_count;
+        r.bytes_per_op = (double) r.epochs_count * dataset_size * sizeof(double) * trained_count;
+        free(times);
+
+        bench_report(&r);
+        printf("%-16s epochs=%llu qe=%.6f\n", "", r.epochs_count, r.quantization_error);
+    }
+
+    somr_dataset_clear(&dataset);
+}
+
+void write_csv(FILE *file) {
+    fprintf(file, "kernel,features_count,units_count,dataset_size,ops_per_rep,median_ns_per_op,min_ns_per_op,samples_per_s,gb_per_s,epochs_count,quantization_error\n");
+    for (unsigned int i = 0; i < results_count; i++) {
+        bench_result_t *r = &results[i];
+        fprintf(file, "%s,%u,%u,%u,%u,%.3f,%.3f,%.3f,%.6f,%llu,%.9f\n",
+            r->kernel, r->features_count, r->units_count, r->dataset_size, r->ops_per_rep,
+            r->median_ns, r->min_ns, r->samples_per_op * 1e9 / r->median_ns, r->bytes_per_op / r->median_ns,
+            r->epochs_count, r->quantization_error);
+    }
+}
+
+void usage(char *exec_name) {
+    fprintf(stderr, "Usage: %s [options]\n", exec_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -o <out.csv>\t\t\tWrite results as CSV to file\n");
+    fprintf(stderr, "  -k <kernel>\t\t\tOnly run benchmarks whose name contains <kernel>\n");
+    fprintf(stderr, "  -r <nb_reps>\t\t\tNumber of timed repetitions [default: 5]\n");
+    fprintf(stderr, "  -w <nb_warmups>\t\tNumber of untimed warmup repetitions [default: 1]\n");
+    fprintf(stderr, "  -q\t\t\t\tQuick run on smaller sweeps\n");
+}
+
+int main(int argc, char *argv[]) {
+    bench_settings_t settings = { 1, 5, false, NULL };
+    char *csv_filename = NULL;
+
+    char opt;
+    while ((opt = getopt(argc, argv, "o:k:r:w:q")) != -1) {
+        switch (opt) {
+        case 'o':
+            csv_filename = optarg;
+            break;
+        case 'k':
+            settings.filter = optarg;
+            break;
+        case 'r':
+            if (atoi(optarg) <= 0) {
+                fprintf(stderr, "Invalid number of repetitions\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            settings.reps_count = atoi(optarg);
+            break;
+        case 'w':
+            if (atoi(optarg) < 0) {
+                fprintf(stderr, "Invalid number of warmups\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            settings.warmup_count = atoi(optarg);
+            break;
+        case 'q':
+            settings.quick = true;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    bench_kernels(&settings);
+    bench_train(&settings);
+    bench_modes(&settings);
+    bench_growth(&settings);
+    bench_sparse(&settings);
+    bench_quantized(&settings);
+    bench_projection(&settings);
+
+    if (csv_filename != NULL) {
+        FILE *file = fopen(csv_filename, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open %s\n", csv_filename);
+            exit(EXIT_FAILURE);
+        }
+        write_csv(file);
+        fclose(file);
+    }
+}
@@ -0,0 +1,374 @@
+#define _GNU_SOURCE // for M_PI
+#include <getopt.h>
+#include <math.h>
+#include <somr/somr.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/** max memory used to cache cluster centers, offsets of deeper levels are recomputed for each row */
+#define MAX_CENTERS_CACHE_SIZE (64 * 1024 * 1024)
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+/**
+Clusters form a complete tree of depth @p depth where each node has @p branching children.
+Each node center is its parent center plus a gaussian offset whose scale decreases with depth,
+and rows are drawn around a random leaf center with gaussian noise.
+Node offsets are derived from a hash of (seed, node, feature) so that no tree has to be stored.
+*/
+typedef struct generator_t {
+    unsigned int features_count;
+    unsigned int depth;
+    unsigned int branching;
+    /** depth of tree nodes used as classes (1 = top level clusters) */
+    unsigned int label_depth;
+    double spread;
+    double decay;
+    double noise;
+    uint64_t seed;
+    uint64_t rand_state;
+    /** centers of all nodes at depth @p cached_depth, deeper offsets are added for each row */
+    double *cached_centers;
+    unsigned int cached_depth;
+} generator_t;
+
+// splitmix64 finalizer, used both as hash and as random generator step
+uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+uint64_t next_rand(generator_t *g) {
+    g->rand_state += 0x9e3779b97f4a7c15ULL;
+    return mix(g->rand_state);
+}
+
+// uniform double in (0, 1]
+double to_unit(uint64_t x) {
+    return ((x >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+double gaussian_from(uint64_t a, uint64_t b) {
+    return sqrt(-2.0 * log(to_unit(a))) * cos(2.0 * M_PI * to_unit(b));
+}
+
+// deterministic gaussian offset of tree node @p node_id (heap numbering) for feature @p feature
+double node_offset(generator_t *g, uint64_t node_id, unsigned int feature) {
+    uint64_t h = mix(g->seed ^ mix(node_id * 0x9e3779b97f4a7c15ULL + feature));
+    return gaussian_from(h, mix(h + 1));
+}
+
+// adds to @p center the offsets of nodes in [@p begin_depth, @p end_depth) along @p path
+void add_offsets(generator_t *g, unsigned int *path, unsigned int begin_depth, unsigned int end_depth, double *center) {
+    uint64_t node_id = 0;
+    double scale = g->spread;
+    for (unsigned int level = 0; level < end_depth; level++) {
+        node_id = node_id * g->branching + path[level] + 1;
+        if (level >= begin_depth) {
+            for (unsigned int j = 0; j < g->features_count; j++) {
+                center[j] += scale * node_offset(g, node_id, j);
+            }
+        }
+        scale *= g->decay;
+    }
+}
+
+void generator_init(generator_t *g) {
+    g->rand_state = mix(g->seed);
+
+    // cache centers of the deepest level that fits in memory
+    uint64_t nodes_count = 1;
+    g->cached_depth = 0;
+    while (g->cached_depth < g->depth && nodes_count * g->branching * g->features_count * sizeof(double) <= MAX_CENTERS_CACHE_SIZE) {
+        nodes_count *= g->branching;
+        g->cached_depth++;
+    }
+
+    g->cached_centers = malloc(sizeof(double) * nodes_count * g->features_count);
+    unsigned int *path = malloc(sizeof(unsigned int) * g->depth);
+    for (uint64_t node = 0; node < nodes_count; node++) {
+        uint64_t rest = node;
+        for (int level = g->cached_depth - 1; level >= 0; level--) {
+            path[level] = rest % g->branching;
+            rest /= g->branching;
+        }
+
+        double *center = &g->cached_centers[node * g->features_count];
+        for (unsigned int j = 0; j < g->features_count; j++) {
+            center[j] = 0.5;
+        }
+        add_offsets(g, path, 0, g->cached_depth, center);
+    }
+    free(path);
+}
+
+void generator_clear(generator_t *g) {
+    free(g->cached_centers);
+    g->cached_centers = NULL;
+}
+
+unsigned int classes_count(generator_t *g) {
+    unsigned int count = 1;
+    for (unsigned int i = 0; i < g->label_depth; i++) {
+        count *= g->branching;
+    }
+    return count;
+}
+
+// class names are the path of label-level nodes, eg "c2.0" for second top cluster, first child
+void class_name(generator_t *g, unsigned int label, char *name, size_t name_length) {
+    size_t length = snprintf(name, name_length, "c");
+    unsigned int divisor = classes_count(g) / g->branching;
+    for (unsigned int i = 0; i < g->label_depth; i++) {
+        length += snprintf(name + length, name_length - length, (i == 0) ? "%u" : ".%u", (label / divisor) % g->branching);
+        divisor /= g->branching;
+    }
+}
+
+// draws one row: picks a random leaf and adds noise to its center
+void generate_row(generator_t *g, unsigned int *path, double *center, double *row, int32_t *label) {
+    uint64_t cached_node = 0;
+    *label = 0;
+    for (unsigned int level = 0; level < g->depth; level++) {
+        path[level] = next_rand(g) % g->branching;
+        if (level < g->cached_depth) {
+            cached_node = cached_node * g->branching + path[level];
+        }
+        if (level < g->label_depth) {
+            *label = *label * g->branching + path[level];
+        }
+    }
+
+    memcpy(center, &g->cached_centers[cached_node * g->features_count], sizeof(double) * g->features_count);
+    if (g->cached_depth < g->depth) {
+        add_offsets(g, path, g->cached_depth, g->depth, center);
+    }
+
+    for (unsigned int j = 0; j < g->features_count; j++) {
+        double value = center[j] + g->noise * gaussian_from(next_rand(g), next_rand(g));
+        // keep values in [0, 1] as expected by training
+        row[j] = (value < 0.0) ? 0.0 : (value > 1.0) ? 1.0 : value;
+    }
+}
+
+void write_binary_header(FILE *file, generator_t *g, uint64_t rows_count) {
+    uint32_t features_count = g->features_count;
+    uint32_t count = classes_count(g);
+    fwrite(SOMR_DATASET_MAGIC, 1, SOMR_DATASET_MAGIC_LENGTH, file);
+    fwrite(&features_count, sizeof(uint32_t), 1, file);
+    fwrite(&count, sizeof(uint32_t), 1, file);
+    fwrite(&rows_count, sizeof(uint64_t), 1, file);
+
+    char name[256];
+    for (uint32_t i = 0; i < count; i++) {
+        class_name(g, i, name, sizeof(name));
+        uint32_t name_length = strlen(name);
+        fwrite(&name_length, sizeof(uint32_t), 1, file);
+        fwrite(name, 1, name_length, file);
+    }
+}
+
+void usage(char *exec_name) {
+    fprintf(stderr, "Usage: %s -n <nb_vectors> -f <nb_features> [options] <out.csv|out.bin|->\n", exec_name);
+    fprintf(stderr, "Required:\n");
+    fprintf(stderr, "  -n <nb_vectors>\t\tNumber of vectors to generate\n");
+    fprintf(stderr, "  -f <nb_features>\t\tNumber of values per vector\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -D <depth>\t\t\tDepth of cluster hierarchy [default: 3]\n");
+    fprintf(stderr, "  -B <branching>\t\tNumber of sub-clusters per cluster [default: 3]\n");
+    fprintf(stderr, "  -L <label_depth>\t\tDepth of clusters used as classes [default: 1]\n");
+    fprintf(stderr, "  -S <spread>\t\t\tStandard deviation of top level cluster centers [default: 0.2]\n");
+    fprintf(stderr, "  -k <decay>\t\t\tSpread factor applied at each level [default: 0.3]\n");
+    fprintf(stderr, "  -e <noise>\t\t\tStandard deviation of vectors around leaf centers [default: 0.01]\n");
+    fprintf(stderr, "  -r <random_seed>\t\tSeed for random number generator\n");
+    fprintf(stderr, "  -b\t\t\t\tWrite binary format instead of csv\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    long long rows_count = -1;
+    int features_count = -1;
+    int depth = 3;
+    int branching = 3;
+    int label_depth = 1;
+    double spread = 0.2;
+    double decay = 0.3;
+    double noise = 0.01;
+    uint64_t seed = 0;
+    bool has_seed = false;
+    bool binary = false;
+
+    char opt;
+    while ((opt = getopt(argc, argv, "n:f:D:B:L:S:k:e:r:b")) != -1) {
+        switch (opt) {
+        case 'n':
+            rows_count = atoll(optarg);
+            if (rows_count <= 0 || rows_count > UINT32_MAX) {
+                fprintf(stderr, "Invalid number of vectors\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            features_count = atoi(optarg);
+            if (features_count <= 0) {
+                fprintf(stderr, "Invalid number of values per vector\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'D':
+            depth = atoi(optarg);
+            if (depth <= 0) {
+                fprintf(stderr, "Invalid depth\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'B':
+            branching = atoi(optarg);
+            if (branching <= 0) {
+                fprintf(stderr, "Invalid branching\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'L':
+            label_depth = atoi(optarg);
+            if (label_depth < 0) {
+                fprintf(stderr, "Invalid label depth\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'S':
+            spread = atof(optarg);
+            if (spread < 0.0) {
+                fprintf(stderr, "Invalid spread\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'k':
+            decay = atof(optarg);
+            if (decay <= 0.0 || decay > 1.0) {
+                fprintf(stderr, "Invalid decay\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'e':
+            noise = atof(optarg);
+            if (noise < 0.0) {
+                fprintf(stderr, "Invalid noise\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+            seed = strtoull(optarg, NULL, 10);
+            has_seed = true;
+            break;
+        case 'b':
+            binary = true;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    if (argc - optind != 1) {
+        fprintf(stderr, "Positional argument missing\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (rows_count <= 0) {
+        fprintf(stderr, "Number of vectors missing\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (features_count <= 0) {
+        fprintf(stderr, "Number of values per vector missing\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (label_depth > depth) {
+        fprintf(stderr, "Label depth can't exceed depth\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (pow(branching, label_depth) > 1e6) {
+        fprintf(stderr, "Too many classes\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (!has_seed) {
+        struct timeval time;
+        gettimeofday(&time, NULL);
+        seed = (time.tv_sec * 1000000) + time.tv_usec;
+    }
+
+    char *out_filename = argv[optind];
+    FILE *file = stdout;
+    if (strcmp(out_filename, "-") != 0) {
+        file = fopen(out_filename, binary ? "wb" : "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open %s\n", out_filename);
+            exit(EXIT_FAILURE);
+        }
+    }
+    static char output_buffer[OUTPUT_BUFFER_SIZE];
+    setvbuf(file, output_buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    generator_t g = {
+        features_count, depth, branching, label_depth, spread, decay, noise, seed, 0, NULL, 0
+    };
+    generator_init(&g);
+
+    if (binary) {
+        write_binary_header(file, &g, rows_count);
+    }
+
+    // rows are generated and written one at a time, so memory use does not depend on rows count
+    unsigned int *path = malloc(sizeof(unsigned int) * depth);
+    double *center = malloc(sizeof(double) * features_count);
+    double *row = malloc(sizeof(double) * features_count);
+    char name[256];
+    for (long long i = 0; i < rows_count; i++) {
+        int32_t label;
+        generate_row(&g, path, center, row, &label);
+        if (binary) {
+            fwrite(&label, sizeof(int32_t), 1, file);
+            fwrite(row, sizeof(double), features_count, file);
+        } else {
+            class_name(&g, label, name, sizeof(name));
+            fputs(name, file);
+            for (int j = 0; j < features_count; j++) {
+                fprintf(file, ",%.6f", row[j]);
+            }
+            fputc('\n', file);
+        }
+    }
+
+    if (fflush(file) != 0) {
+        fprintf(stderr, "Could not write to %s\n", out_filename);
+        exit(EXIT_FAILURE);
+    }
+    if (file != stdout) {
+        fclose(file);
+    }
+    free(row);
+    free(center);
+    free(path);
+    generator_clear(&g);
+}
@@ -0,0 +1,272 @@
+#include <getopt.h>
+#include <somr/somr.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** max number of values of each swept setting */
+#define MAX_VALUES 64
+
+void usage(char *exec_name) {
+    fprintf(stderr, "Usage: %s -n <nb_vectors> -f <nb_features> [options] <in.csv>\n", exec_name);
+    fprintf(stderr, "       %s -b [options] <in.bin>\n", exec_name);
+    fprintf(stderr, "Trains a network for each combination of swept settings (comma-separated values) on the same data set\n");
+    fprintf(stderr, "Required (csv input):\n");
+    fprintf(stderr, "  -n <nb_vectors>\t\tNumber of input vectors\n");
+    fprintf(stderr, "  -f <nb_features>\t\tNumber of values per input vector\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -b\t\t\t\tRead input in binary format (as written by somrgen -b)\n");
+    fprintf(stderr, "  -V\t\t\t\tRead input in sparse libsvm format (<class> <index>:<value>...)\n");
+    fprintf(stderr, "  -l <learning_rates>\t\tInitial learning rates [default: 0.8]\n");
+    fprintf(stderr, "  -i <nb_iters>\t\t\tNumbers of full training passes [default: 100]\n");
+    fprintf(stderr, "  -s <spread_thresholds>\t\tUnit insertion tresholds [default: 0.05]\n");
+    fprintf(stderr, "  -d <depth_thresholds>\t\tChild map creation tresholds [default: 0.01]\n");
+    fprintf(stderr, "  -r <random_seeds>\t\tSeeds for random number generator [default: 1]\n");
+    fprintf(stderr, "  -e <encoding>\t\t\tStorage of input features: double, uint8, uint16 or float16 [default: double]\n");
+    fprintf(stderr, "  -m <metric>\t\t\tDistance between units and input vectors: euclid, cosine or manhattan [default: euclid]\n");
+    fprintf(stderr, "  -j <nb_threads>\t\tNumber of networks trained at once [default: number of cpus]\n");
+    fprintf(stderr, "  -M <max_memory>\t\tMemory in MB that trainings may take on top of the data set [default: 0, no limit]\n");
+    fprintf(stderr, "  -o <results.json>\t\tWrite results to json file instead of printing a table\n");
+}
+
+// parses comma-separated list of positive values, @return number of values or -1 if invalid
+int parse_values(char *arg, double *values) {
+    int count = 0;
+    char *c = arg;
+    while (count < MAX_VALUES) {
+        char *end;
+        values[count] = strtod(c, &end);
+        if (end == c || values[count] <= 0.0 || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        count++;
+        if (*end == '\0') {
+            return count;
+        }
+        c = end + 1;
+    }
+    return -1;
+}
+
+void read_dataset(somr_dataset_t *dataset, char *filename, bool is_binary, bool is_sparse, somr_encoding_t encoding, unsigned int size, unsigned int features_count) {
+    FILE *file = fopen(filename, is_binary ? "rb" : "r");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    if (is_binary) {
+        somr_dataset_init_from_binary_file(dataset, file);
+    } else if (is_sparse) {
+        somr_dataset_init_from_sparse_file(dataset, file, size, features_count);
+    } else {
+        somr_dataset_init_from_normalized_file(dataset, file, size, features_count);
+    }
+    fclose(file);
+    // csv input vectors are normalized as they are parsed
+    if (is_binary || is_sparse) {
+        somr_dataset_normalize(dataset);
+    }
+    somr_dataset_quantize(dataset, encoding);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 1) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int data_length = -1;
+    int features_count = -1;
+    double learn_rates[MAX_VALUES] = { 0.8 };
+    double spread_thresholds[MAX_VALUES] = { 0.05 };
+    double depth_thresholds[MAX_VALUES] = { 0.01 };
+    double iters_counts[MAX_VALUES] = { 100 };
+    double seeds[MAX_VALUES] = { 1 };
+    int learn_rates_count = 1;
+    int spread_thresholds_count = 1;
+    int depth_thresholds_count = 1;
+    int iters_counts_count = 1;
+    int seeds_count = 1;
+    somr_metric_t metric = SOMR_METRIC_EUCLID;
+    somr_encoding_t encoding = SOMR_ENCODING_DOUBLE;
+    bool is_binary = false;
+    bool is_sparse = false;
+    int threads_count = 0;
+    long max_memory = 0;
+    char *results_filename = NULL;
+
+    char opt;
+    while ((opt = getopt(argc, argv, "n:f:bVl:i:s:d:r:e:m:j:M:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            data_length = atoi(optarg);
+            if (data_length <= 0) {
+                fprintf(stderr, "Invalid number of input vectors\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            features_count = atoi(optarg);
+            if (features_count <= 0) {
+                fprintf(stderr, "Invalid number of values per input vector\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            is_binary = true;
+            break;
+        case 'V':
+            is_sparse = true;
+            break;
+        case 'l':
+            learn_rates_count = parse_values(optarg, learn_rates);
+            if (learn_rates_count < 0) {
+                fprintf(stderr, "Invalid learning rates\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            for (int i = 0; i < learn_rates_count; i++) {
+                if (learn_rates[i] >= 1.0) {
+                    fprintf(stderr, "Invalid learning rates\n");
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            break;
+        case 'i':
+            iters_counts_count = parse_values(optarg, iters_counts);
+            if (iters_counts_count < 0) {
+                fprintf(stderr, "Invalid numbers of iterations\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            spread_thresholds_count = parse_values(optarg, spread_thresholds);
+            if (spread_thresholds_count < 0) {
+                fprintf(stderr, "Invalid spread thresholds\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'd':
+            depth_thresholds_count = parse_values(optarg, depth_thresholds);
+            if (depth_thresholds_count < 0) {
+                fprintf(stderr, "Invalid depth thresholds\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+            seeds_count = parse_values(optarg, seeds);
+            if (seeds_count < 0) {
+                fprintf(stderr, "Invalid seeds\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'e':
+            if (!somr_encoding_find(optarg, &encoding)) {
+                fprintf(stderr, "Invalid encoding\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'm':
+            if (!somr_metric_find(optarg, &metric)) {
+                fprintf(stderr, "Invalid metric\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            threads_count = atoi(optarg);
+            if (threads_count <= 0) {
+                fprintf(stderr, "Invalid number of threads\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'M':
+            max_memory = atol(optarg);
+            if (max_memory <= 0) {
+                fprintf(stderr, "Invalid memory limit\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'o':
+            results_filename = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    if (argc - optind != 1) {
+        fprintf(stderr, "Positional argument missing\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (is_binary && is_sparse) {
+        fprintf(stderr, "Binary and sparse input formats are exclusive\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (is_sparse && encoding != SOMR_ENCODING_DOUBLE) {
+        fprintf(stderr, "Sparse input vectors cannot be quantized\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (!is_binary && (data_length <= 0 || features_count <= 0)) {
+        fprintf(stderr, "Number of input vectors or of values per input vector missing\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    // input data is read and normalized once for all trainings
+    somr_dataset_t dataset;
+    read_dataset(&dataset, argv[optind], is_binary, is_sparse, encoding, data_length, features_count);
+
+    somr_sweep_t sweep;
+    somr_sweep_init(&sweep, &dataset, threads_count, (size_t) max_memory << 20);
+    for (int a = 0; a < learn_rates_count; a++) {
+        for (int b = 0; b < spread_thresholds_count; b++) {
+            for (int c = 0; c < depth_thresholds_count; c++) {
+                for (int d = 0; d < iters_counts_count; d++) {
+                    for (int e = 0; e < seeds_count; e++) {
+                        somr_trainer_settings_t settings;
+                        somr_trainer_settings_init(&settings, learn_rates[a], spread_thresholds[b], depth_thresholds[c],
+                            (unsigned int) iters_counts[d], true, (unsigned int) seeds[e]);
+                        settings.metric = metric;
+                        somr_sweep_add(&sweep, &settings);
+                    }
+                }
+            }
+        }
+    }
+
+    printf("Training %u networks on %u threads...\n", sweep.runs_count, sweep.threads_count);
+    fflush(stdout);
+    somr_sweep_run(&sweep);
+
+    if (results_filename != NULL) {
+        FILE *file = fopen(results_filename, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open %s\n", results_filename);
+            exit(EXIT_FAILURE);
+        }
+        somr_sweep_write_json(&sweep, file);
+        fclose(file);
+    } else {
+        somr_sweep_write_table(&sweep, stdout);
+    }
+
+    somr_sweep_clear(&sweep);
+    somr_dataset_clear(&dataset);
+}
@@ -1,13 +1,22 @@
+#include <errno.h>
 #include <getopt.h>
 #include <png.h>
 #include <somr/somr.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 
 #define IMG_WIDTH 512
 #define IMG_HEIGHT 512
+/** number of image rows rendered at once before being streamed to png */
+#define BAND_HEIGHT 64
+/** width and height of tiles in pyramid mode */
+#define TILE_SIZE 256
+/** deepest zoom level allowed in pyramid mode */
+#define MAX_ZOOM 16
 
 unsigned char COLORS[] = {
     230, 25, 75,
@@ -22,24 +31,78 @@ unsigned char COLORS[] = {
     230, 190, 255,
 };
 
-// feed all input vectors to network and check they are mapped to correct class
-int print_errors(somr_network_t *network, somr_dataset_t *dataset, unsigned int seed) {
+// mkdir -p
+int make_dirs(char *path) {
+    for (char *c = path + 1; *c != '\0'; c++) {
+        if (*c != '/') {
+            continue;
+        }
+        *c = '\0';
+        int result = mkdir(path, 0755);
+        *c = '/';
+        if (result != 0 && errno != EEXIST) {
+            return -1;
+        }
+    }
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+void read_dataset(somr_dataset_t *dataset, char *filename, bool is_binary, bool is_sparse, somr_encoding_t encoding, unsigned int size, unsigned int features_count) {
+    FILE *file = fopen(filename, is_binary ? "rb" : "r");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    if (is_binary) {
+        somr_dataset_init_from_binary_file(dataset, file);
+    } else if (is_sparse) {
+        somr_dataset_init_from_sparse_file(dataset, file, size, features_count);
+    } else {
+        somr_dataset_init_from_normalized_file(dataset, file, size, features_count);
+    }
+    fclose(file);
+    // csv input vectors are normalized as they are parsed
+    if (is_binary || is_sparse) {
+        somr_dataset_normalize(dataset);
+    }
+    somr_dataset_quantize(dataset, encoding);
+}
+
+// feed all input vectors to network and check they are mapped to correct class,
+// with classification stopped at depth max_depth or after max_dist_evals distance evaluations (0 for no limit)
+int print_errors(somr_network_t *network, somr_dataset_t *dataset, unsigned int seed, unsigned int max_depth, unsigned long long max_dist_evals) {
     printf("Testing input vectors classification\n");
     int error_count = 0;
+    unsigned long long depth_sum = 0;
+    unsigned int early_count = 0;
     somr_dataset_shuffle(dataset, &seed);
     for (unsigned int i = 0; i < dataset->size; i++) {
         somr_data_vector_t *data_vector = somr_dataset_get_vector(dataset, i);
-        somr_label_t label = somr_network_classify(network, data_vector);
-        if (label != data_vector->label) {
+        unsigned int depth;
+        bool is_leaf;
+        somr_label_t label = somr_network_classify_bounded(network, data_vector, max_depth, max_dist_evals, &depth, &is_leaf);
+        depth_sum += depth;
+        early_count += !is_leaf;
+        // compare class names, as labels of network and data set may differ after an update
+        char *class = somr_network_get_class(network, label);
+        if (class == NULL || strcmp(class, somr_dataset_get_class(dataset, data_vector->label)) != 0) {
             //printf("Error: %u mapped to %u\n", data_vector->label, label);
             error_count++;
         }
     }
+    if (max_depth > 0 || max_dist_evals > 0) {
+        printf("Mean classification depth: %.2f, %u input vectors classified before reaching a leaf map\n",
+            (double) depth_sum / dataset->size, early_count);
+    }
     printf("Total number of classification errors: %u\n", error_count);
     return error_count;
 }
 
-void write_img_to_png(FILE *file, unsigned char *img, unsigned int width, unsigned int height) {
+void write_rows_to_png(FILE *file, unsigned char *img, unsigned int width, unsigned int height,
+    void (*write_rows)(void *ctx, unsigned char *rows, unsigned int y, unsigned int rows_count), void *ctx) {
     png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     png_infop png_info = png_create_info_struct(png);
     jmp_buf png_jmp;
@@ -59,34 +122,136 @@ void write_img_to_png(FILE *file, unsigned char *img, unsigned int width, unsign
 
     png_write_info(png, png_info);
 
-    // pointers to img data
-    png_bytep row = malloc(sizeof(png_byte) * width * 3);
-    for (unsigned int y = 0; y < height; y++) {
-        unsigned int row_offset = y * width * 3;
-        for (unsigned int i = 0; i < width * 3; i++) {
-            row[i] = img[row_offset + i];
+    // render image band by band in @p img and stream rows to png
+    for (unsigned int y = 0; y < height; y += BAND_HEIGHT) {
+        unsigned int rows_count = (height - y < BAND_HEIGHT) ? height - y : BAND_HEIGHT;
+        write_rows(ctx, img, y, rows_count);
+        for (unsigned int i = 0; i < rows_count; i++) {
+            png_write_row(png, &img[i * width * 3]);
         }
-        png_write_row(png, row);
     }
-    free(row);
-    row = NULL;
     png_write_end(png, NULL);
 
     png_destroy_write_struct(&png, &png_info);
 }
 
+typedef struct band_ctx_t {
+    somr_network_t *network;
+    unsigned int width;
+    unsigned int height;
+} band_ctx_t;
+
+void write_band(void *ctx, unsigned char *rows, unsigned int y, unsigned int rows_count) {
+    band_ctx_t *band = ctx;
+    somr_network_write_band_to_img(band->network, rows, band->width, band->height, y, rows_count, COLORS);
+}
+
+void write_network_to_png(FILE *file, somr_network_t *network, unsigned int width, unsigned int height) {
+    unsigned int band_height = (height < BAND_HEIGHT) ? height : BAND_HEIGHT;
+    unsigned char *band = malloc(sizeof(unsigned char) * 3 * width * band_height);
+    band_ctx_t ctx = { network, width, height };
+    write_rows_to_png(file, band, width, height, write_band, &ctx);
+    free(band);
+}
+
+typedef struct tile_ctx_t {
+    somr_network_t *network;
+    unsigned char *tile;
+    unsigned int zoom;
+    unsigned int tile_x;
+    unsigned int tile_y;
+} tile_ctx_t;
+
+void write_tile(void *ctx, unsigned char *rows, unsigned int y, unsigned int rows_count) {
+    tile_ctx_t *tile = ctx;
+    // whole tile is rendered at once, only copy rows requested
+    if (y == 0) {
+        somr_network_write_tile_to_img(tile->network, tile->tile, TILE_SIZE, tile->zoom, tile->tile_x, tile->tile_y, COLORS);
+    }
+    memcpy(rows, &tile->tile[y * TILE_SIZE * 3], sizeof(unsigned char) * 3 * TILE_SIZE * rows_count);
+}
+
+// write pyramid of tiles in <dir>/<zoom>/<x>/<y>.png, from zoom level 0 to @p max_zoom
+int write_network_to_tiles(char *dir, somr_network_t *network, unsigned int max_zoom) {
+    unsigned char *tile = malloc(sizeof(unsigned char) * 3 * TILE_SIZE * TILE_SIZE);
+    unsigned char *band = malloc(sizeof(unsigned char) * 3 * TILE_SIZE * BAND_HEIGHT);
+    size_t path_length = strlen(dir) + 64;
+    char *path = malloc(sizeof(char) * path_length);
+
+    for (unsigned int zoom = 0; zoom <= max_zoom; zoom++) {
+        unsigned int tiles_count = 1u << zoom;
+        for (unsigned int tile_x = 0; tile_x < tiles_count; tile_x++) {
+            snprintf(path, path_length, "%s/%u/%u", dir, zoom, tile_x);
+            if (make_dirs(path) != 0) {
+                fprintf(stderr, "Could not create directory %s\n", path);
+                return -1;
+            }
+            for (unsigned int tile_y = 0; tile_y < tiles_count; tile_y++) {
+                snprintf(path, path_length, "%s/%u/%u/%u.png", dir, zoom, tile_x, tile_y);
+                FILE *file = fopen(path, "wb");
+                if (file == NULL) {
+                    fprintf(stderr, "Could not open %s\n", path);
+                    return -1;
+                }
+                tile_ctx_t ctx = { network, tile, zoom, tile_x, tile_y };
+                write_rows_to_png(file, band, TILE_SIZE, TILE_SIZE, write_tile, &ctx);
+                fclose(file);
+            }
+        }
+    }
+
+    free(path);
+    free(band);
+    free(tile);
+    return 0;
+}
+
 void usage(char *exec_name) {
-    fprintf(stderr, "Usage: %s -n <nb_vectors> -f <nb_features> [options] <in.csv> <out.png>\n", exec_name);
-    fprintf(stderr, "Required:\n");
+    fprintf(stderr, "Usage: %s -n <nb_vectors> -f <nb_features> [options] <in.csv> <out.png|out_dir>\n", exec_name);
+    fprintf(stderr, "       %s -b [options] <in.bin> <out.png|out_dir>\n", exec_name);
+    fprintf(stderr, "       %s -w [host:]port\n", exec_name);
+    fprintf(stderr, "Required (csv input):\n");
     fprintf(stderr, "  -n <nb_vectors>\t\tNumber of input vectors\n");
     fprintf(stderr, "  -f <nb_features>\t\tNumber of values per input vector\n");
     fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -b\t\t\t\tRead input in binary format (as written by somrgen -b)\n");
+    fprintf(stderr, "  -V\t\t\t\tRead input in sparse libsvm format (<class> <index>:<value>...), for high-dimensional data\n");
     fprintf(stderr, "  -l <learning_rate>\t\tInitial learning rate [default: 0.8]\n");
     fprintf(stderr, "  -i <nb_iters>\t\t\tNumber of full training passes [default: 100]\n");
     fprintf(stderr, "  -s <spread_threshold>\t\tUnit insertion treshold [default: 0.05]\n");
     fprintf(stderr, "  -d <depth_threshold>\t\tChild map creation treshold  [default: 0.01]\n");
     fprintf(stderr, "  -o\t\t\t\tSwitch off orientation\n");
+    fprintf(stderr, "  -t <tolerance>\t\tEnd training passes early when error improves by less than tolerance [default: 0, off]\n");
+    fprintf(stderr, "  -E <ratio>\t\t\tSpread early when estimated error exceeds ratio times threshold [default: 0, off]\n");
+    fprintf(stderr, "  -g <insertions>\t\tMax number of rows and columns inserted at once when spreading [default: 1]\n");
+    fprintf(stderr, "  -F <period>\t\t\tOnly run full passes every period spreads, fine-tune around insertions otherwise [default: 0, off]\n");
+    fprintf(stderr, "  -S <samples>\t\t\tTrain and estimate errors on samples of this many vectors per unit [default: 0, off]\n");
+    fprintf(stderr, "  -e <encoding>\t\t\tStorage of input features: double, uint8, uint16 or float16 [default: double]\n");
+    fprintf(stderr, "  -m <metric>\t\t\tDistance between units and input vectors: euclid, cosine or manhattan [default: euclid]\n");
+    fprintf(stderr, "  -P <nb_dims>\t\t\tProject input vectors to nb_dims dimensions with a randomized PCA before training [default: 0, off]\n");
+    fprintf(stderr, "  -Q\t\t\t\tUse a random projection instead of PCA (with -P)\n");
     fprintf(stderr, "  -r <random_seed>\t\t\tSeed for random number generator\n");
+    fprintf(stderr, "  -W <img_width>\t\tWidth of output image [default: 512]\n");
+    fprintf(stderr, "  -H <img_height>\t\tHeight of output image [default: 512]\n");
+    fprintf(stderr, "  -c <checkpoint>\t\tWrite training checkpoints to file\n");
+    fprintf(stderr, "  -C <nb_epochs>\t\tNumber of epochs between checkpoints [default: 100]\n");
+    fprintf(stderr, "  -R\t\t\t\tResume training from checkpoint file (same input and options required)\n");
+    fprintf(stderr, "  -u <update.csv>\t\tUpdate trained network with input vectors of file (same format as input)\n");
+    fprintf(stderr, "  -N <nb_vectors>\t\tNumber of input vectors in update file (csv input)\n");
+    fprintf(stderr, "  -D <max_depth>\t\t\tStop classification at this depth (label of subtree) [default: 0, no limit]\n");
+    fprintf(stderr, "  -B <max_dist_evals>\t\tStop classification before exceeding this number of distance evaluations [default: 0, no limit]\n");
+    fprintf(stderr, "  -j <stats.json>\t\tWrite training statistics to json file\n");
+    fprintf(stderr, "  -T <trace.json>\t\tWrite training timeline to json file (Chrome trace event format)\n");
+    fprintf(stderr, "  -a\t\t\t\tTrain child maps best-first, unit of highest error in the whole network first\n");
+    fprintf(stderr, "  -x <seconds>\t\t\tStop creating child maps after this wall time (best-first) [default: 0, no limit]\n");
+    fprintf(stderr, "  -X <max_dist_evals>\t\tStop creating child maps after this number of distance evaluations (best-first) [default: 0, no limit]\n");
+    fprintf(stderr, "  -M <memory_budget>\t\tStop growing maps once training would take more than this many MB [default: 0, no limit]\n");
+    fprintf(stderr, "  -A <memory.json>\t\tWrite memory of training (by category and at peak) to json file\n");
+    fprintf(stderr, "  -L <nb_workers>\t\tTrain subtrees in this many local worker processes\n");
+    fprintf(stderr, "  -p <host:port>\t\tTrain subtrees on worker listening at host and port (repeat for several workers)\n");
+    fprintf(stderr, "  -G <depth>\t\t\tDepth of maps whose child maps are trained by workers [default: 1, top map]\n");
+    fprintf(stderr, "  -w [host:]port\t\tRun as worker listening on port (of loopback by default), training subtrees for other somrviz processes\n");
+    fprintf(stderr, "  -z <max_zoom>\t\t\tWrite a pyramid of %ux%u tiles in out_dir/<zoom>/<x>/<y>.png instead of a single image\n", TILE_SIZE, TILE_SIZE);
 }
 
 int main(int argc, char *argv[]) {
@@ -101,12 +266,46 @@ int main(int argc, char *argv[]) {
     double spread_threshold = -1.0;
     double depth_threshold = -1.0;
     int iters_count = -1.0;
-    unsigned int seed;
+    unsigned int seed = 0;
     bool has_seed = false;
     bool should_orient = true;
+    double convergence_tolerance = 0.0;
+    double early_spread_ratio = 0.0;
+    int samples_per_unit = 0;
+    int max_insertions = 1;
+    int full_pass_period = 0;
+    int projection_count = 0;
+    somr_metric_t metric = SOMR_METRIC_EUCLID;
+    somr_encoding_t encoding = SOMR_ENCODING_DOUBLE;
+    somr_projection_kind_t projection_kind = SOMR_PROJECTION_PCA;
+    int img_width = IMG_WIDTH;
+    int img_height = IMG_HEIGHT;
+    int max_zoom = -1;
+    bool is_binary = false;
+    bool is_sparse = false;
+    char *stats_filename = NULL;
+    char *trace_filename = NULL;
+    double memory_budget = 0.0;
+    bool is_best_first = false;
+    double time_budget = 0.0;
+    long long dist_evals_budget = 0;
+    char *memory_filename = NULL;
+    char *update_filename = NULL;
+    char *checkpoint_filename = NULL;
+    int checkpoint_period = 100;
+    bool should_resume = false;
+    int update_length = -1;
+    int max_classify_depth = 0;
+    long long max_classify_evals = 0;
+    int local_workers_count = 0;
+    int shard_depth = 1;
+    char *worker_host = NULL;
+    char *worker_port = NULL;
+    char **worker_addresses = NULL;
+    int worker_addresses_count = 0;
 
     char opt;
-    while ((opt = getopt(argc, argv, "n:f:l:i:s:d:or:")) != -1) {
+    while ((opt = getopt(argc, argv, "n:f:l:i:s:d:or:W:H:z:bj:T:t:E:S:g:F:u:N:c:C:RVP:Qm:e:D:B:L:p:G:w:M:A:ax:X:")) != -1) {
         switch (opt) {
         case 'n':
             data_length = atoi(optarg);
@@ -164,6 +363,216 @@ int main(int argc, char *argv[]) {
         case 'o':
             should_orient = false;
             break;
+        case 'b':
+            is_binary = true;
+            break;
+        case 'V':
+            is_sparse = true;
+            break;
+        case 't':
+            convergence_tolerance = atof(optarg);
+            if (convergence_tolerance < 0.0 || convergence_tolerance >= 1.0) {
+                fprintf(stderr, "Invalid convergence tolerance\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'E':
+            early_spread_ratio = atof(optarg);
+            if (early_spread_ratio != 0.0 && early_spread_ratio < 1.0) {
+                fprintf(stderr, "Invalid early spread ratio\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'P':
+            projection_count = atoi(optarg);
+            if (projection_count < 0) {
+                fprintf(stderr, "Invalid number of projected dimensions\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'Q':
+            projection_kind = SOMR_PROJECTION_RANDOM;
+            break;
+        case 'm':
+            if (!somr_metric_find(optarg, &metric)) {
+                fprintf(stderr, "Invalid metric\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'e':
+            if (!somr_encoding_find(optarg, &encoding)) {
+                fprintf(stderr, "Invalid encoding\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'S':
+            samples_per_unit = atoi(optarg);
+            if (samples_per_unit < 0) {
+                fprintf(stderr, "Invalid number of samples per unit\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'g':
+            max_insertions = atoi(optarg);
+            if (max_insertions < 1) {
+                fprintf(stderr, "Invalid max number of insertions\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'F':
+            full_pass_period = atoi(optarg);
+            if (full_pass_period < 0) {
+                fprintf(stderr, "Invalid full pass period\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            stats_filename = optarg;
+            break;
+        case 'T':
+            trace_filename = optarg;
+            break;
+        case 'M':
+            memory_budget = atof(optarg);
+            if (memory_budget <= 0.0) {
+                fprintf(stderr, "Invalid memory budget\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'A':
+            memory_filename = optarg;
+            break;
+        case 'a':
+            is_best_first = true;
+            break;
+        case 'x':
+            time_budget = atof(optarg);
+            if (time_budget <= 0.0) {
+                fprintf(stderr, "Invalid time budget\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            is_best_first = true;
+            break;
+        case 'X':
+            dist_evals_budget = atoll(optarg);
+            if (dist_evals_budget <= 0) {
+                fprintf(stderr, "Invalid distance evaluation budget\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            is_best_first = true;
+            break;
+        case 'c':
+            checkpoint_filename = optarg;
+            break;
+        case 'C':
+            checkpoint_period = atoi(optarg);
+            if (checkpoint_period <= 0) {
+                fprintf(stderr, "Invalid checkpoint period\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'R':
+            should_resume = true;
+            break;
+        case 'u':
+            update_filename = optarg;
+            break;
+        case 'D':
+            max_classify_depth = atoi(optarg);
+            if (max_classify_depth < 0) {
+                fprintf(stderr, "Invalid classification depth\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'B':
+            max_classify_evals = atoll(optarg);
+            if (max_classify_evals < 0) {
+                fprintf(stderr, "Invalid classification budget\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'L':
+            local_workers_count = atoi(optarg);
+            if (local_workers_count <= 0) {
+                fprintf(stderr, "Invalid number of workers\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            if (strrchr(optarg, ':') == NULL) {
+                fprintf(stderr, "Invalid worker address\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            worker_addresses = realloc(worker_addresses, sizeof(char *) * (worker_addresses_count + 1));
+            worker_addresses[worker_addresses_count] = optarg;
+            worker_addresses_count++;
+            break;
+        case 'G':
+            shard_depth = atoi(optarg);
+            if (shard_depth <= 0) {
+                fprintf(stderr, "Invalid shard depth\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'w':
+            worker_port = strrchr(optarg, ':');
+            if (worker_port != NULL) {
+                *worker_port = '\0';
+                worker_port++;
+                worker_host = optarg;
+            } else {
+                worker_port = optarg;
+            }
+            break;
+        case 'N':
+            update_length = atoi(optarg);
+            if (update_length <= 0) {
+                fprintf(stderr, "Invalid number of update input vectors\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'W':
+            img_width = atoi(optarg);
+            if (img_width <= 0) {
+                fprintf(stderr, "Invalid image width\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'H':
+            img_height = atoi(optarg);
+            if (img_height <= 0) {
+                fprintf(stderr, "Invalid image height\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'z':
+            max_zoom = atoi(optarg);
+            if (max_zoom < 0 || max_zoom > MAX_ZOOM) {
+                fprintf(stderr, "Invalid max zoom level\n");
+                usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
         default:
             usage(argv[0]);
             exit(EXIT_FAILURE);
@@ -171,17 +580,53 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (worker_port != NULL) {
+        printf("Serving workers on %s:%s\n", (worker_host != NULL) ? worker_host : "127.0.0.1", worker_port);
+        fflush(stdout);
+        somr_shard_listen(worker_host, worker_port);
+    }
+
     if (argc - optind != 2) {
         fprintf(stderr, "Positional arguments missing\n");
         usage(argv[0]);
         exit(EXIT_FAILURE);
     }
-    if (data_length <= 0) {
+    if (is_binary && is_sparse) {
+        fprintf(stderr, "Binary and sparse input formats are exclusive\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (is_sparse && encoding != SOMR_ENCODING_DOUBLE) {
+        fprintf(stderr, "Sparse input vectors cannot be quantized\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (!is_binary && data_length <= 0) {
         fprintf(stderr, "Number of input vectors missing\n");
         usage(argv[0]);
         exit(EXIT_FAILURE);
     }
-    if (features_count <= 0) {
+    if (should_resume && checkpoint_filename == NULL) {
+        fprintf(stderr, "Checkpoint file missing\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (checkpoint_filename != NULL && (local_workers_count > 0 || worker_addresses_count > 0)) {
+        fprintf(stderr, "Checkpoints cannot be written when training on workers\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (is_best_first && (checkpoint_filename != NULL || local_workers_count > 0 || worker_addresses_count > 0)) {
+        fprintf(stderr, "Best-first training cannot write checkpoints or use workers\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (!is_binary && update_filename != NULL && update_length <= 0) {
+        fprintf(stderr, "Number of update input vectors missing\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (!is_binary && features_count <= 0) {
         fprintf(stderr, "Number of values per input vector missing\n");
         usage(argv[0]);
         exit(EXIT_FAILURE);
@@ -208,17 +653,26 @@ int main(int argc, char *argv[]) {
     char *csv_filename = argv[optind];
     char *png_filename = argv[optind + 1];
 
-    // read input data;
-    FILE *file = fopen(csv_filename, "r");
-    if (file == NULL) {
-        fprintf(stderr, "Could not open %s\n", csv_filename);
-        exit(EXIT_FAILURE);
+    // local workers are started before input data is read, so that they do not hold a copy of it
+    somr_shard_t shard;
+    somr_shard_init(&shard, shard_depth);
+    somr_shard_spawn(&shard, local_workers_count);
+    for (int i = 0; i < worker_addresses_count; i++) {
+        char *port = strrchr(worker_addresses[i], ':');
+        *port = '\0';
+        somr_shard_connect(&shard, worker_addresses[i], port + 1);
     }
+    free(worker_addresses);
+
+    // read input data;
     somr_dataset_t dataset;
-    somr_dataset_init_from_file(&dataset, file, data_length, features_count);
-    fclose(file);
-    somr_dataset_normalize(&dataset);
+    read_dataset(&dataset, csv_filename, is_binary, is_sparse, encoding, data_length, features_count);
+    features_count = dataset.features_count;
 
+    if (projection_count >= features_count) {
+        fprintf(stderr, "Number of projected dimensions must be lower than number of values per input vector\n");
+        exit(EXIT_FAILURE);
+    }
     if (dataset.class_list->size > 10) {
         fprintf(stderr, "Too many classes (> 10) found in input data\n");
         exit(EXIT_FAILURE);
@@ -226,30 +680,147 @@ int main(int argc, char *argv[]) {
 
     // init and train network
     somr_network_t network;
-    somr_network_init(&network, features_count);
 
     printf("Training settings:\n");
     printf("  spread_threshold=%f\n  depth_threshold=%f\n  iters_count=%u\n  learning_rate=%f\n  orient=%s\n  seed=%u\n",
         spread_threshold, depth_threshold, iters_count, learn_rate, should_orient ? "true" : "false", seed);
+    printf("  metric=%s\n", somr_metric_get_name(metric));
+    printf("  encoding=%s\n", somr_encoding_get_name(encoding));
+    printf("  convergence_tolerance=%f\n  early_spread_ratio=%f\n  samples_per_unit=%d\n  max_insertions=%d\n  full_pass_period=%d\n",
+        convergence_tolerance, early_spread_ratio, samples_per_unit, max_insertions, full_pass_period);
     printf("Training network...\n");
 
-    somr_network_train(&network, &dataset, learn_rate, spread_threshold, depth_threshold, iters_count, should_orient, seed);
+    somr_trainer_settings_t settings;
+    somr_trainer_settings_init(&settings, learn_rate, spread_threshold, depth_threshold, iters_count, should_orient, seed);
+    settings.convergence_tolerance = convergence_tolerance;
+    settings.early_spread_ratio = early_spread_ratio;
+    settings.samples_per_unit = samples_per_unit;
+    settings.max_insertions = max_insertions;
+    settings.full_pass_period = full_pass_period;
+    settings.metric = metric;
+    settings.memory_budget = (size_t) (memory_budget * (1 << 20));
+    settings.is_best_first = is_best_first;
+    settings.time_budget = time_budget;
+    settings.dist_evals_budget = dist_evals_budget;
+    if (is_best_first) {
+        printf("Best-first growth: time_budget=%f dist_evals_budget=%lld\n", time_budget, dist_evals_budget);
+    }
+    if (settings.memory_budget > 0) {
+        printf("Memory budget: %zu bytes\n", settings.memory_budget);
+    }
 
-    print_errors(&network, &dataset, seed);
+    somr_checkpoint_t checkpoint;
+    somr_checkpoint_init(&checkpoint, checkpoint_filename, checkpoint_period);
+    if (checkpoint_filename != NULL) {
+        settings.checkpoint = &checkpoint;
+    }
+    somr_trace_t trace;
+    somr_trace_init(&trace);
+    if (trace_filename != NULL) {
+        settings.trace = &trace;
+    }
+    if (shard.workers_count > 0) {
+        printf("Training subtrees at depth %d on %u workers\n", shard_depth, shard.workers_count);
+        settings.shard = &shard;
+    }
 
-    // gen image
-    unsigned char *img = malloc(sizeof(unsigned char) * 3 * IMG_WIDTH * IMG_HEIGHT);
-    somr_network_write_to_img(&network, img, IMG_WIDTH, IMG_HEIGHT, COLORS);
+    if (should_resume) {
+        FILE *checkpoint_file = fopen(checkpoint_filename, "rb");
+        if (checkpoint_file == NULL) {
+            fprintf(stderr, "Could not open %s\n", checkpoint_filename);
+            exit(EXIT_FAILURE);
+        }
+        printf("Resuming from %s\n", checkpoint_filename);
+        somr_network_resume(&network, &dataset, &settings, checkpoint_file);
+        fclose(checkpoint_file);
+    } else if (projection_count > 0) {
+        // projection is fitted on the same data set and stored with network, that applies it to all input vectors
+        printf("Fitting %s projection to %d dimensions...\n", (projection_kind == SOMR_PROJECTION_PCA) ? "PCA" : "random", projection_count);
+        unsigned int projection_state = seed;
+        somr_projection_t *projection = malloc(sizeof(somr_projection_t));
+        somr_projection_init(projection, &dataset, projection_kind, projection_count, &projection_state);
+        somr_network_init(&network, projection_count);
+        somr_network_set_projection(&network, projection);
+        somr_network_train_with_settings(&network, &dataset, &settings);
+    } else {
+        somr_network_init(&network, features_count);
+        somr_network_train_with_settings(&network, &dataset, &settings);
+    }
 
-    file = fopen(png_filename, "wb");
-    if (file == NULL) {
-        fprintf(stderr, "Could not open %s\n", png_filename);
-        exit(EXIT_FAILURE);
+    if (network.stats.pending_children_count > 0) {
+        printf("Budget spent with %u units left without child map\n", network.stats.pending_children_count);
+    }
+    printf("Memory: %zu bytes at peak, %zu bytes after training\n", network.memory.peak, network.memory.total);
+    if (network.memory.refused_spreads_count > 0 || network.memory.refused_children_count > 0) {
+        printf("  %u spreads and %u child maps refused by memory budget\n", network.memory.refused_spreads_count, network.memory.refused_children_count);
+    }
+    print_errors(&network, &dataset, seed, max_classify_depth, max_classify_evals);
+
+    if (update_filename != NULL) {
+        somr_dataset_t update_dataset;
+        read_dataset(&update_dataset, update_filename, is_binary, is_sparse, encoding, update_length, features_count);
+        if (update_dataset.features_count != (unsigned int) features_count) {
+            fprintf(stderr, "Number of values per input vector differs in %s\n", update_filename);
+            exit(EXIT_FAILURE);
+        }
+
+        // short schedule with low learning rate, so that network adapts without forgetting
+        somr_trainer_settings_t update_settings = settings;
+        update_settings.learn_rate = learn_rate / 40.0;
+        update_settings.iters_count = (iters_count >= 20) ? iters_count / 20 : 1;
+        printf("Updating network with %u input vectors...\n", update_dataset.size);
+        somr_network_update(&network, &update_dataset, &update_settings);
+
+        print_errors(&network, &update_dataset, seed, max_classify_depth, max_classify_evals);
+        print_errors(&network, &dataset, seed, max_classify_depth, max_classify_evals);
+        somr_dataset_clear(&update_dataset);
+    }
+
+    FILE *file;
+    if (stats_filename != NULL) {
+        file = fopen(stats_filename, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open %s\n", stats_filename);
+            exit(EXIT_FAILURE);
+        }
+        somr_stats_write_json(&network.stats, file);
+        fclose(file);
+    }
+    if (trace_filename != NULL) {
+        file = fopen(trace_filename, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open %s\n", trace_filename);
+            exit(EXIT_FAILURE);
+        }
+        somr_trace_write_json(&trace, file);
+        fclose(file);
+    }
+    if (memory_filename != NULL) {
+        file = fopen(memory_filename, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open %s\n", memory_filename);
+            exit(EXIT_FAILURE);
+        }
+        somr_memory_write_json(&network.memory, file);
+        fclose(file);
+    }
+    somr_trace_clear(&trace);
+    somr_shard_clear(&shard);
+
+    // gen image
+    if (max_zoom >= 0) {
+        if (write_network_to_tiles(png_filename, &network, max_zoom) != 0) {
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        file = fopen(png_filename, "wb");
+        if (file == NULL) {
+            fprintf(stderr, "Could not open %s\n", png_filename);
+            exit(EXIT_FAILURE);
+        }
+        write_network_to_png(file, &network, img_width, img_height);
+        fclose(file);
     }
-    write_img_to_png(file, img, IMG_WIDTH, IMG_HEIGHT);
-    free(img);
-    img = NULL;
-    fclose(file);
 
     // clean up
     somr_network_clear(&network);
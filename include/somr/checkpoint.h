@@ -0,0 +1,63 @@
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+Binary checkpoint format (native endianness):
+- magic string SOMR_CHECKPOINT_MAGIC (8 bytes)
+- uint32 random state of trainer settings
+- partially trained network, in binary network format
+- uint32 frames count, then frames from top map to map being trained, each made of:
+  uint32 parent unit id, uint32 deepened unit id, uint32 spreads count, uint32 schedule index, uint8 deepening flag,
+  uint8 fine-tuned flag, doubles schedule progress, step and previous error, uint32 schedule epoch index,
+  uint32 schedule epochs count, uint32 data set size followed by data set size uint32 shuffle indices
+*/
+#define SOMR_CHECKPOINT_MAGIC "SOMRCP02"
+#define SOMR_CHECKPOINT_MAGIC_LENGTH 8
+
+typedef struct somr_network_t somr_network_t;
+typedef struct somr_trainer_t somr_trainer_t;
+
+/** training state of one map among the maps being trained (a map and its ancestors) */
+typedef struct somr_checkpoint_frame_t {
+    /** id of unit of parent map to which map is attached, unused for top map */
+    unsigned int parent_unit_id;
+    /** true if map is done growing and trains the child map of unit @p deepen_unit_id */
+    bool is_deepening;
+    unsigned int deepen_unit_id;
+    unsigned int spreads_count;
+    bool was_fine_tuned;
+    /** 0 for first schedule of a pass, 1 for schedule resumed after an early stop */
+    unsigned int schedule_index;
+    double progress;
+    double step;
+    double previous_error;
+    unsigned int schedule_epoch_index;
+    unsigned int schedule_epochs_count;
+    /** order of input vectors of map data set */
+    unsigned int dataset_size;
+    unsigned int *indices;
+} somr_checkpoint_frame_t;
+
+/** Checkpoints written periodically during training, or read to resume it */
+typedef struct somr_checkpoint_t {
+    /** file to write, replaced atomically at each checkpoint */
+    char *path;
+    /** number of epochs between two checkpoints */
+    unsigned int period;
+    /** number of epochs run since last checkpoint */
+    unsigned int epochs_count;
+    /** network being trained */
+    somr_network_t *network;
+    /** frames read from checkpoint file */
+    somr_checkpoint_frame_t *frames;
+    unsigned int frames_count;
+} somr_checkpoint_t;
+
+void somr_checkpoint_init(somr_checkpoint_t *c, char *path, unsigned int period);
+void somr_checkpoint_clear(somr_checkpoint_t *c);
+/** counts an epoch of trainer @p t, and writes a checkpoint of its state and of its ancestors one every period epochs */
+void somr_checkpoint_tick(somr_checkpoint_t *c, somr_trainer_t *t);
+void somr_checkpoint_write(somr_checkpoint_t *c, somr_trainer_t *t, FILE *file);
+/** reads network @p n (uninitialized), random state and frames of @p c from @p file */
+void somr_checkpoint_read(somr_checkpoint_t *c, somr_network_t *n, unsigned int *rand_state, FILE *file);
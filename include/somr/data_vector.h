@@ -1,15 +1,56 @@
 #pragma once
+#include "quantizer.h"
+#include <stdbool.h>
 
 /** index of class assigned to a unit or a vector */
 typedef int somr_label_t;
 /** label value for units with no labels */
 #define SOMR_EMPTY_LABEL -1
 
+/**
+Input vector, either dense (all features in @p weights), quantized (@p weights is NULL, and all features are encoded
+in @p codes by @p quantizer) or sparse (only non-zero features, in compressed row format: @p weights and @p codes are
+NULL, and feature @p nnz_indices[i] has value @p nnz_values[i], with increasing indices)
+*/
 typedef struct somr_data_vector_t {
     double *weights;
+    void *codes;
+    somr_quantizer_t *quantizer;
+    unsigned int nnz_count;
+    unsigned int *nnz_indices;
+    double *nnz_values;
+    /**
+    squared norm, used with unit norms to get distances from dot products: always set for sparse vectors,
+    set for dense vectors once they are normalized or quantized (negative otherwise)
+    */
+    double norm_squared;
     somr_label_t label;
 } somr_data_vector_t;
 
 void somr_data_vector_init_batch(somr_data_vector_t *batch, unsigned int batch_size, unsigned int features_count);
+/**
+inits sparse vectors pointing to shared arrays @p nnz_indices and @p nnz_values (taken over by batch),
+vector i holding values from @p offsets[i] to @p offsets[i + 1]
+*/
+void somr_data_vector_init_sparse_batch(somr_data_vector_t *batch, unsigned int batch_size, unsigned int *offsets, unsigned int *nnz_indices, double *nnz_values);
+/**
+replaces weights of dense vectors of @p batch by their codes for @p quantizer (not taken over by batch),
+and sets their squared norms from decoded weights
+*/
+void somr_data_vector_quantize_batch(somr_data_vector_t *batch, unsigned int batch_size, somr_quantizer_t *quantizer);
 void somr_data_vector_clear_batch(somr_data_vector_t *batch, unsigned int batch_size);
+bool somr_data_vector_is_sparse(somr_data_vector_t *v);
+bool somr_data_vector_is_quantized(somr_data_vector_t *v);
+/**
+@return features @p begin to @p begin + @p count of dense or quantized vector @p v, pointing into its weights
+or decoded into @p buffer (of at least @p count values)
+*/
+double *somr_data_vector_get_block(somr_data_vector_t *v, unsigned int begin, unsigned int count, double *buffer);
+/**
+@return @p v if it is not quantized, otherwise @p decoded, set as a dense copy of @p v with weights decoded into
+@p buffer (of features count values), so that kernels running on many units decode it only once
+*/
+somr_data_vector_t *somr_data_vector_decode(somr_data_vector_t *v, unsigned int features_count, somr_data_vector_t *decoded, double *buffer);
 void somr_data_vector_normalize(somr_data_vector_t *v, unsigned int features_count);
+/** adds values of @p v to dense vector @p sum */
+void somr_data_vector_add_to(somr_data_vector_t *v, double *sum, unsigned int features_count);
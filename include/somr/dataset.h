@@ -1,25 +1,79 @@
 #pragma once
 #include "data_vector.h"
 #include "list.h"
+#include "quantizer.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 
+/**
+Binary dataset format (native endianness):
+- magic string SOMR_DATASET_MAGIC (8 bytes)
+- uint32 features count, uint32 classes count, uint64 number of vectors
+- for each class: uint32 name length followed by name bytes (no terminating null)
+- for each vector: int32 label followed by features count doubles
+*/
+#define SOMR_DATASET_MAGIC "SOMRDS01"
+#define SOMR_DATASET_MAGIC_LENGTH 8
+
 typedef struct somr_dataset_t {
     somr_data_vector_t *data_vectors;
     unsigned int size;
     unsigned int features_count;
     somr_list_t *class_list;
-    /** shuffle indices used to acces input vectors in random order */
+    /** shuffle indices used to acces input vectors in random order, a range of the parent indices for a child data set */
     unsigned int *indices;
+    /** true if input vectors, class list and quantizer belong to another data set (parent or shared source) */
     bool has_parent;
+    /** true if @p indices are freed with data set (false for child data sets, that share those of their parent) */
+    bool owns_indices;
+    /** true if input vectors are sparse (all vectors of a data set have the same representation) */
+    bool is_sparse;
+    /** shared by quantized input vectors, NULL if they are not quantized */
+    somr_quantizer_t *quantizer;
+    /** mean of input vectors, computed while reading them (NULL if unknown or outdated) */
+    double *mean;
 } somr_dataset_t;
 
 void somr_dataset_init(somr_dataset_t *d, somr_data_vector_t *data_vectors, unsigned int *indices, unsigned int size, unsigned int features_count, somr_list_t *class_list);
-void somr_dataset_init_from_parent(somr_dataset_t *d, somr_dataset_t *parent, unsigned int *indices, unsigned int size);
+/**
+inits data set of the input vectors at indices @p begin to @p begin + @p size of @p parent, sharing its indices
+(shuffling the child data set reorders this range of the parent data set)
+*/
+void somr_dataset_init_from_parent(somr_dataset_t *d, somr_dataset_t *parent, unsigned int begin, unsigned int size);
+/**
+inits data set sharing the input vectors of @p source, which must outlive it and not change, with its own copy of
+the indices, so that several trainings can reorder their data sets concurrently on the same input vectors
+*/
+void somr_dataset_init_shared(somr_dataset_t *d, somr_dataset_t *source);
 void somr_dataset_shuffle(somr_dataset_t *d, unsigned int *rand_state);
+/** moves a uniform random sample of @p count input vectors to the first @p count indices (remaining ones are left in any order) */
+void somr_dataset_shuffle_head(somr_dataset_t *d, unsigned int count, unsigned int *rand_state);
 somr_data_vector_t *somr_dataset_get_vector(somr_dataset_t *t, unsigned int index);
 char *somr_dataset_get_class(somr_dataset_t *d, somr_label_t label);
 void somr_dataset_clear(somr_dataset_t *d);
+/** @p[out] mean_weights: mean of input vectors, copied from the one computed while reading them if known */
 void somr_dataset_compute_mean_weights(somr_dataset_t *d, double *mean_weights);
+/** reads dataset from @p file in csv text format, lines being parsed by several threads while the file is read */
 void somr_dataset_init_from_file(somr_dataset_t *d, FILE *file, unsigned int size, unsigned int features_count);
+/**
+same as somr_dataset_init_from_file followed by somr_dataset_normalize and somr_dataset_compute_mean_weights,
+input vectors being normalized and summed as they are parsed instead of in later passes
+*/
+void somr_dataset_init_from_normalized_file(somr_dataset_t *d, FILE *file, unsigned int size, unsigned int features_count);
+/**
+reads dataset of sparse vectors from @p file in libsvm text format: one vector per line, made of its class followed by
+space-separated index:value pairs of its non-zero features, with increasing indices from 1 to @p features_count
+*/
+void somr_dataset_init_from_sparse_file(somr_dataset_t *d, FILE *file, unsigned int size, unsigned int features_count);
+/** reads dataset from @p file in binary format (size and features count are read from file header) */
+void somr_dataset_init_from_binary_file(somr_dataset_t *d, FILE *file);
+/** normalizes input vectors (mean computed while reading them is dropped, as it no longer matches them) */
 void somr_dataset_normalize(somr_dataset_t *d);
+/**
+stores dense input vectors of @p d (not a child data set) with @p encoding, levels being fitted to the range of each
+feature; should be called after somr_dataset_normalize
+*/
+void somr_dataset_quantize(somr_dataset_t *d, somr_encoding_t encoding);
+/** @return number of bytes stored per feature of dense input vectors (meaningless for sparse ones) */
+size_t somr_dataset_get_feature_size(somr_dataset_t *d);
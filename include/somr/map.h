@@ -1,10 +1,23 @@
 #pragma once
 #include "data_vector.h"
+#include "metric.h"
 #include "unit.h"
+#include <stdbool.h>
 #include <stdio.h>
 
 typedef unsigned int somr_unit_id_t;
 
+/** maps with fewer units (or more, as the index grows with their square) are searched without index */
+#define SOMR_MAP_INDEX_MIN_UNITS 16
+#define SOMR_MAP_INDEX_MAX_UNITS 1024
+
+/** distance between two units of a map, in a row of the map index */
+typedef struct somr_unit_dist_t {
+    /** rounded down, so that bounds built on it never skip a unit that might be best matching */
+    float dist;
+    unsigned int unit_id;
+} somr_unit_dist_t;
+
 /** Main structure for SOM map */
 typedef struct somr_map_t {
     /** width of map */
@@ -17,23 +30,76 @@ typedef struct somr_map_t {
     unsigned int features_count;
     /** flat array of units */
     somr_unit_t *units;
+    /** number of units allocated in @p units, grown geometrically when rows or columns are inserted */
+    unsigned int units_capacity;
     double mean_error;
+    /** distance used to activate units, same for a map and its child maps */
+    somr_metric_t metric;
+    /** quantized input vector being searched or taught, decoded once for all units (allocated when first needed) */
+    double *decoded_weights;
+    /**
+    for each unit, distances to all other units in increasing order (units count - 1 entries per unit),
+    that let searches skip units too far from the best matching unit found so far (allocated when first needed)
+    */
+    somr_unit_dist_t *index;
+    /** true if @p index matches current weights, set by somr_map_build_index and reset when weights change */
+    bool is_indexed;
 } somr_map_t;
 
 void somr_map_init(somr_map_t *m, unsigned int features_count);
+/**
+reads map written by somr_map_write, with its child maps
+(format, native endianness: uint32 width and height, double mean error, then for each unit:
+features count doubles of weights, double error, int32 label, uint32 label count, uint8 1 if unit has a child map
+followed by child map, 0 otherwise)
+*/
+void somr_map_init_from_binary_file(somr_map_t *m, FILE *file, unsigned int features_count);
 void somr_map_clear(somr_map_t *m);
+/** sets metric of map and of its child maps */
+void somr_map_set_metric(somr_map_t *m, somr_metric_t metric);
+/** writes map and its child maps to @p file in binary format (write errors are to be checked with ferror) */
+void somr_map_write(somr_map_t *m, FILE *file);
 void somr_map_init_random_weights(somr_map_t *m, unsigned int *rand_state);
+/** applies pending scales of unit weights and computes unit norms, needed by dot product kernels */
+void somr_map_update_norms(somr_map_t *m);
 void somr_map_activate(somr_map_t *m, somr_data_vector_t *data_vector);
-/** @return first best matching unit found for @p data_vector */
+/**
+@return first best matching unit found for @p data_vector (lowest id on ties), only activating units that
+the index does not rule out by triangle inequality if map is indexed (other units keep stale activations)
+*/
 somr_unit_id_t somr_map_find_bmu(somr_map_t *m, somr_data_vector_t *data_vector);
 /**
+builds index of distances between units, so that best matching unit searches skip most units, to be called before
+passes that do not change weights (the index is dropped by the next change), no-op if map is too small or too big
+*/
+void somr_map_build_index(somr_map_t *m);
+/** builds indexes of @p m and of its child maps */
+void somr_map_build_indexes(somr_map_t *m);
+/**
 fills @p[out] bmus with all equally-activated best matching units for @p vector
 @pre @p bmus must be allocated with enough space (ie potentially the number of units in map)
 */
 //void somr_map_find_bmus(somr_map_t *m, somr_data_vector_t *data_vector, somr_unit_id_t *bmus, unsigned int *bmu_count);
-void somr_map_teach_nbhd(somr_map_t *m, somr_unit_id_t unit_id, somr_data_vector_t *data_vector, double learn_rate, double radius);
+/** @return number of units whose weights were updated */
+unsigned int somr_map_teach_nbhd(somr_map_t *m, somr_unit_id_t unit_id, somr_data_vector_t *data_vector, double learn_rate, double radius);
 unsigned int somr_map_get_depth(somr_map_t *m);
 /** maps input vector @p vector to a class, by returnig label of its best matching unit */
 somr_label_t somr_map_classify(somr_map_t *m, somr_data_vector_t *data_vector);
+/**
+same as somr_map_classify, but stops at best matching unit of the map at depth @p max_depth (1 for top map), or of the
+last map whose search keeps the number of distance evaluations within @p max_dist_evals (the top map is always searched),
+so that latency is bounded: the label of a unit with a child map is the most frequent label of its subtree
+(0 for no limit)
+@p[out] depth: number of maps searched
+@p[out] is_leaf: true if best matching unit of the last map searched has no child map (the label is then exact)
+*/
+somr_label_t somr_map_classify_bounded(somr_map_t *m, somr_data_vector_t *data_vector, unsigned int max_depth,
+    unsigned long long max_dist_evals, unsigned int *depth, bool *is_leaf);
 //void somr_map_find_error_range(somr_map_t *, double *min_error, double *max_error);
 void somr_map_write_to_img(somr_map_t *m, unsigned char *img, unsigned int img_width, unsigned int img_height, unsigned char *colors, unsigned int border);
+/**
+renders only a rectangular region of the @p img_width x @p img_height image that somr_map_write_to_img would produce
+@p[out] region: RGB buffer of @p region_width x @p region_height pixels
+*/
+void somr_map_write_region_to_img(somr_map_t *m, unsigned char *region, unsigned int img_width, unsigned int img_height,
+    unsigned int region_x, unsigned int region_y, unsigned int region_width, unsigned int region_height, unsigned char *colors, unsigned int border);
@@ -0,0 +1,55 @@
+#pragma once
+#include "dataset.h"
+#include "map.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** kinds of allocations accounted during training */
+typedef enum somr_memory_category_t {
+    /** weight vectors of units */
+    SOMR_MEMORY_WEIGHTS,
+    /** unit and map structures, and buffers of maps */
+    SOMR_MEMORY_UNITS,
+    /** distance indexes of maps (see somr_map_build_index) */
+    SOMR_MEMORY_INDEXES,
+    /** input vectors and indices of data sets */
+    SOMR_MEMORY_DATASET,
+    /** buffers of trainers, released once they are done */
+    SOMR_MEMORY_SCRATCH,
+    SOMR_MEMORY_CATEGORIES_COUNT
+} somr_memory_category_t;
+
+/**
+Bytes allocated by a training (and held by the network and data sets it uses), by category and at peak,
+with an optional budget that maps stop spreading and deepening at
+*/
+typedef struct somr_memory_t {
+    size_t bytes[SOMR_MEMORY_CATEGORIES_COUNT];
+    /** sum of bytes of all categories */
+    size_t total;
+    /** highest total since init */
+    size_t peak;
+    /** total that growth must not exceed, 0 for no limit */
+    size_t budget;
+    /** number of spreads and child maps not done because they did not fit in budget */
+    unsigned int refused_spreads_count;
+    unsigned int refused_children_count;
+} somr_memory_t;
+
+void somr_memory_init(somr_memory_t *m, size_t budget);
+void somr_memory_add(somr_memory_t *m, somr_memory_category_t category, size_t bytes);
+void somr_memory_remove(somr_memory_t *m, somr_memory_category_t category, size_t bytes);
+/** @return true if @p bytes can be allocated without exceeding budget */
+bool somr_memory_fits(somr_memory_t *m, size_t bytes);
+/**
+adds bytes of map @p m to @p bytes (by category), and those of its child maps if @p is_recursive
+(index is counted at the size of the current map once allocated)
+*/
+void somr_memory_measure_map(somr_map_t *m, size_t *bytes, bool is_recursive);
+/** @return bytes of input vectors and indices of @p d (indices only for a data set sharing its input vectors) */
+size_t somr_memory_measure_dataset(somr_dataset_t *d);
+/** @return bytes of a new 2x2 map */
+size_t somr_memory_measure_child_map(unsigned int features_count);
+char *somr_memory_get_category_name(somr_memory_category_t category);
+void somr_memory_write_json(somr_memory_t *m, FILE *file);
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdbool.h>
+
+/**
+distance used to find best matching units and to compute errors, chosen per network
+(unit activations hold squared distances, whose square roots are summed into unit errors)
+*/
+typedef enum somr_metric_t {
+    /**
+    euclidean distance, computed from cached unit norms and a dot product for sparse input vectors and normalized
+    ones with enough features (same bmu as the full distance, as |w - x|^2 = |w|^2 - 2 w.x + |x|^2)
+    */
+    SOMR_METRIC_EUCLID,
+    /** chord distance between directions of unit weights and input vector, sqrt(2 - 2 cos), from a dot product */
+    SOMR_METRIC_COSINE,
+    /** sum of absolute differences (not specialized for sparse input vectors, which are read densely) */
+    SOMR_METRIC_MANHATTAN,
+    SOMR_METRICS_COUNT
+} somr_metric_t;
+
+char *somr_metric_get_name(somr_metric_t metric);
+/** @return false if @p name is not the name of a metric */
+bool somr_metric_find(char *name, somr_metric_t *metric);
@@ -1,18 +1,86 @@
 #pragma once
 #include "dataset.h"
 #include "list.h"
+#include "memory.h"
+#include "projection.h"
+#include "stats.h"
+#include "trainer.h"
 #include "unit.h"
 #include <stdio.h>
 
+/**
+Binary network format (native endianness):
+- magic string SOMR_NETWORK_MAGIC (8 bytes)
+- uint32 features count (of maps), uint32 classes count
+- for each class: uint32 name length followed by name bytes (no terminating null)
+- uint8 1 if network has a projection followed by projection as written by somr_projection_write, 0 otherwise
+- uint32 metric of maps
+- root unit: features count doubles of weights, double error
+- top map and its child maps, as written by somr_map_write
+*/
+#define SOMR_NETWORK_MAGIC "SOMRNW04"
+#define SOMR_NETWORK_MAGIC_LENGTH 8
+
 typedef struct somr_network_t {
     somr_unit_t root;
     somr_list_t class_list;
+    /** projection applied to input vectors before they are fed to maps, NULL if none */
+    somr_projection_t *projection;
+    /** statistics of last training */
+    somr_stats_t stats;
+    /** memory of last training or update (with its input data sets), by category and at peak */
+    somr_memory_t memory;
 } somr_network_t;
 
+/** @p features_count: number of features of input vectors, or output count of projection if one is set */
 void somr_network_init(somr_network_t *n, unsigned int features_count);
 void somr_network_clear(somr_network_t *n);
+/**
+sets projection @p p (allocated with malloc, network takes it over) applied to input vectors of data sets and
+to classified vectors: they have the input count of @p p as features count
+*/
+void somr_network_set_projection(somr_network_t *n, somr_projection_t *p);
+/** reads trained network from @p file in binary format */
+void somr_network_init_from_binary_file(somr_network_t *n, FILE *file);
+/** writes trained network to @p file in binary format (write errors are to be checked with ferror) */
+void somr_network_write(somr_network_t *n, FILE *file);
 void somr_network_train(somr_network_t *n, somr_dataset_t *dataset,
     double learn_rate, double spread_threshold, double depth_threshold, unsigned int iters_count, bool should_orient, unsigned int seed);
+/** trains network with full control over trainer settings (@p settings is not modified) */
+void somr_network_train_with_settings(somr_network_t *n, somr_dataset_t *dataset, somr_trainer_settings_t *settings);
+/**
+resumes training interrupted after checkpoint read from @p checkpoint_file, initializing network @p n (uninitialized),
+@p dataset and @p settings must be the same as those of interrupted training (random state is read from checkpoint),
+the network is then the same as the one of an uninterrupted training (stats only cover resumed part)
+*/
+void somr_network_resume(somr_network_t *n, somr_dataset_t *dataset, somr_trainer_settings_t *settings, FILE *checkpoint_file);
+/**
+updates trained network with new input vectors of @p dataset, in a time proportional to their number
+(previous input vectors are not needed): they are routed through the hierarchy, and only maps they are mapped to
+are trained on them, with a @p settings schedule starting from a small radius (that should use a low learning rate
+and a few iterations), spread or deepened if their errors now exceed the thresholds
+(root unit weights are kept, classes of @p dataset unknown to network are added to it)
+*/
+void somr_network_update(somr_network_t *n, somr_dataset_t *dataset, somr_trainer_settings_t *settings);
+/** @p[out] memory: current bytes of maps, units and projection of trained network, by category */
+void somr_network_get_memory(somr_network_t *n, somr_memory_t *memory);
 somr_label_t somr_network_classify(somr_network_t *n, somr_data_vector_t *data_vector);
+/** classifies with bounded latency, as somr_map_classify_bounded (projection is not accounted in distance evaluations) */
+somr_label_t somr_network_classify_bounded(somr_network_t *n, somr_data_vector_t *data_vector, unsigned int max_depth,
+    unsigned long long max_dist_evals, unsigned int *depth, bool *is_leaf);
 char *somr_network_get_class(somr_network_t *n, somr_label_t label);
 void somr_network_write_to_img(somr_network_t *n, unsigned char *img, unsigned int img_width, unsigned int img_height, unsigned char *colors);
+/**
+renders rows [@p band_y, @p band_y + @p band_height) of the @p img_width x @p img_height network image,
+so that big images can be produced band by band without holding the whole frame
+@p[out] band: RGB buffer of @p img_width x @p band_height pixels
+*/
+void somr_network_write_band_to_img(somr_network_t *n, unsigned char *band, unsigned int img_width, unsigned int img_height,
+    unsigned int band_y, unsigned int band_height, unsigned char *colors);
+/**
+renders tile (@p tile_x, @p tile_y) of zoom level @p zoom in a tile pyramid,
+where level z is a square image of (@p tile_size << z) pixels split in 2^z x 2^z tiles
+@p[out] tile: RGB buffer of @p tile_size x @p tile_size pixels
+*/
+void somr_network_write_tile_to_img(somr_network_t *n, unsigned char *tile, unsigned int tile_size,
+    unsigned int zoom, unsigned int tile_x, unsigned int tile_y, unsigned char *colors);
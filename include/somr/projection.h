@@ -0,0 +1,47 @@
+#pragma once
+#include "data_vector.h"
+#include "dataset.h"
+#include <stdio.h>
+
+typedef enum somr_projection_kind_t {
+    /** sparse random matrix with entries in {-1, 0, 1}, fitted in a single pass (for the mean) */
+    SOMR_PROJECTION_RANDOM,
+    /** principal components of data set, estimated by randomized subspace iteration with a few passes */
+    SOMR_PROJECTION_PCA
+} somr_projection_kind_t;
+
+/**
+Linear projection of input vectors to a lower dimension, applied before training and classification:
+output i is 0.5 + SOMR_PROJECTION_SCALE * (row i of matrix . (x - mean)), rows having unit norm, so that the outputs
+of normalized input vectors (with non-negative features) stay in [0, 1] as the inputs of maps,
+while all distances are scaled by the same factor
+*/
+typedef struct somr_projection_t {
+    somr_projection_kind_t kind;
+    unsigned int input_count;
+    unsigned int output_count;
+    /** output count x input count, row-major */
+    double *matrix;
+    /** mean of input vectors of fitted data set */
+    double *mean;
+    /** projections of mean, subtracted after projecting so that sparse input vectors are not densified by centering */
+    double *mean_outputs;
+} somr_projection_t;
+
+/**
+fits projection of @p kind from input vectors of @p d (that should be normalized) to @p output_count dimensions
+(@p output_count must be lower than features count)
+*/
+void somr_projection_init(somr_projection_t *p, somr_dataset_t *d, somr_projection_kind_t kind, unsigned int output_count, unsigned int *rand_state);
+void somr_projection_clear(somr_projection_t *p);
+/**
+reads projection written by somr_projection_write
+(format, native endianness: uint32 kind, uint32 input count, uint32 output count, input count doubles of mean,
+then output count x input count doubles of matrix, row-major)
+*/
+void somr_projection_init_from_binary_file(somr_projection_t *p, FILE *file);
+void somr_projection_write(somr_projection_t *p, FILE *file);
+/** @p[out] outputs: output count values */
+void somr_projection_apply(somr_projection_t *p, somr_data_vector_t *v, double *outputs);
+/** inits dense data set @p d with projections of input vectors of @p source (same classes and order of input vectors) */
+void somr_projection_apply_dataset(somr_projection_t *p, somr_dataset_t *source, somr_dataset_t *d);
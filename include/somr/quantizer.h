@@ -0,0 +1,44 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+/** storage of features of dense input vectors */
+typedef enum somr_encoding_t {
+    /** full precision, 8 bytes per feature */
+    SOMR_ENCODING_DOUBLE,
+    /** 256 levels evenly spread between minimum and maximum of each feature, 1 byte per feature */
+    SOMR_ENCODING_UINT8,
+    /** 65536 levels evenly spread between minimum and maximum of each feature, 2 bytes per feature */
+    SOMR_ENCODING_UINT16,
+    /** IEEE half precision value of feature (11 significant bits), 2 bytes per feature */
+    SOMR_ENCODING_FLOAT16,
+    SOMR_ENCODINGS_COUNT
+} somr_encoding_t;
+
+/** number of features decoded at once by kernels of quantized input vectors, in a buffer that stays in L1 cache */
+#define SOMR_QUANTIZER_BLOCK_SIZE 256
+
+/**
+Per-feature quantization of dense input vectors: feature i of code c decodes to offsets[i] + steps[i] * c
+for integer encodings, and to the half precision value c for SOMR_ENCODING_FLOAT16.
+Shared by all input vectors of a data set, that only store their codes.
+*/
+typedef struct somr_quantizer_t {
+    somr_encoding_t encoding;
+    unsigned int features_count;
+    double *offsets;
+    double *steps;
+} somr_quantizer_t;
+
+/** fits integer levels to per-feature ranges [@p mins[i], @p maxs[i]] (ignored for SOMR_ENCODING_FLOAT16) */
+void somr_quantizer_init(somr_quantizer_t *q, somr_encoding_t encoding, unsigned int features_count, double *mins, double *maxs);
+void somr_quantizer_clear(somr_quantizer_t *q);
+/** @return size of code of one feature, in bytes */
+size_t somr_quantizer_get_code_size(somr_quantizer_t *q);
+/** @p[out] codes: features count codes of @p weights, rounded to nearest level */
+void somr_quantizer_encode(somr_quantizer_t *q, double *weights, void *codes);
+/** @p[out] weights: decoded values of features @p begin to @p begin + @p count of @p codes (of all features) */
+void somr_quantizer_decode(somr_quantizer_t *q, void *codes, unsigned int begin, unsigned int count, double *weights);
+char *somr_encoding_get_name(somr_encoding_t encoding);
+/** @return false if @p name is not the name of an encoding */
+bool somr_encoding_find(char *name, somr_encoding_t *encoding);
@@ -0,0 +1,74 @@
+#pragma once
+#include "dataset.h"
+#include "map.h"
+#include "trainer.h"
+#include <stdio.h>
+#include <sys/types.h>
+
+/**
+Shard protocol (native endianness, over stream sockets, coordinator and workers running the same build):
+- job sent by coordinator:
+  magic string SOMR_SHARD_MAGIC (8 bytes), uint32 features count, uint32 metric,
+  doubles learn rate, spread threshold, depth threshold, convergence tolerance, early spread ratio, error confidence,
+  root mean error and error of parent unit,
+  uint32 iters count, uint8 orientation flag, uint32 random state, uint32 samples per unit, uint32 max insertions,
+  uint32 full pass period,
+  child map as written by somr_map_write,
+  uint32 number of vectors, uint32 encoding of vectors (SOMR_ENCODINGS_COUNT for sparse vectors),
+  uint32 number of network classes, for quantized vectors features count doubles of quantizer offsets
+  followed by features count doubles of steps,
+  then for each vector: int32 label (of network, -1 or below classes count), double squared norm, followed by
+  features count doubles (dense), features count codes (quantized), or uint32 non-zero count followed by
+  as many uint32 strictly increasing indices (below features count) and doubles (sparse)
+- result sent by worker: trained child map and its child maps, as written by somr_map_write
+Workers check jobs as input files are checked, but run the jobs of any coordinator that connects to them.
+*/
+#define SOMR_SHARD_MAGIC "SOMRSJ02"
+#define SOMR_SHARD_MAGIC_LENGTH 8
+
+/** training of the subtree of a child map, shipped to a worker */
+typedef struct somr_shard_job_t {
+    /** child map, as added to its parent unit, replaced by the trained map */
+    somr_map_t *map;
+    /** input vectors mapped to parent unit */
+    somr_dataset_t dataset;
+    double root_mean_error;
+    double parent_mean_error;
+    /** random state of child training, drawn for each job so that results do not depend on workers */
+    unsigned int rand_state;
+} somr_shard_job_t;
+
+/**
+Workers training the subtrees of child maps at a given depth in other processes, local or remote:
+maps above are trained by the coordinator, that grafts the trained subtrees in its network
+*/
+typedef struct somr_shard_t {
+    /** depth of maps whose child maps are trained by workers (1 for child maps of top map) */
+    unsigned int depth;
+    unsigned int workers_count;
+    /** streams of sockets connected to workers */
+    FILE **inputs;
+    FILE **outputs;
+    /** ids of local worker processes, 0 for remote workers */
+    pid_t *pids;
+} somr_shard_t;
+
+void somr_shard_init(somr_shard_t *s, unsigned int depth);
+/** stops and closes connections to workers, waiting for local worker processes */
+void somr_shard_clear(somr_shard_t *s);
+/** adds worker listening at @p host and @p port (see somr_shard_listen) */
+void somr_shard_connect(somr_shard_t *s, char *host, char *port);
+/** adds @p workers_count workers running in forked processes, connected by socket pairs */
+void somr_shard_spawn(somr_shard_t *s, unsigned int workers_count);
+/**
+trains @p jobs on workers, each worker training one job at a time, and grafts the trained maps
+(@p settings are the trainer settings of parent map, @p labels_map the translation of data set labels to network labels)
+*/
+void somr_shard_run(somr_shard_t *s, somr_shard_job_t *jobs, unsigned int jobs_count, somr_trainer_settings_t *settings, somr_label_t *labels_map);
+/** trains jobs read from @p input and writes trained maps to @p output, until @p input is closed */
+void somr_shard_serve(FILE *input, FILE *output);
+/**
+serves coordinators connecting on @p host (loopback if NULL) and @p port, in a forked process per connection,
+until killed
+*/
+void somr_shard_listen(char *host, char *port);
@@ -1,8 +1,17 @@
 #pragma once
 
+#include "checkpoint.h"
 #include "data_vector.h"
 #include "dataset.h"
 #include "list.h"
 #include "map.h"
+#include "memory.h"
+#include "metric.h"
 #include "network.h"
+#include "projection.h"
+#include "quantizer.h"
+#include "shard.h"
+#include "sweep.h"
+#include "stats.h"
+#include "trace.h"
 #include "trainer.h"
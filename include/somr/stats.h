@@ -0,0 +1,68 @@
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+
+/** training phases timed separately (time spent training child maps is not included in deepen) */
+typedef enum somr_phase_t {
+    SOMR_PHASE_EPOCH,
+    SOMR_PHASE_ERROR,
+    SOMR_PHASE_SPREAD,
+    SOMR_PHASE_DEEPEN,
+    SOMR_PHASE_LABEL,
+    SOMR_PHASES_COUNT
+} somr_phase_t;
+
+/** hot-path counters, for a single map or aggregated for a whole network */
+typedef struct somr_counters_t {
+    unsigned long long epochs_count;
+    unsigned long long bmu_searches_count;
+    unsigned long long dist_evals_count;
+    /** number of unit weight updates in neighborhoods */
+    unsigned long long nbhd_updates_count;
+    unsigned long long row_spreads_count;
+    unsigned long long col_spreads_count;
+    unsigned long long children_count;
+    /** bytes of input vectors read */
+    unsigned long long dataset_bytes;
+    /** in seconds */
+    double wall_time[SOMR_PHASES_COUNT];
+    /** in seconds */
+    double cpu_time[SOMR_PHASES_COUNT];
+} somr_counters_t;
+
+typedef struct somr_map_stats_t {
+    /** index of parent map stats, -1 for top map */
+    int parent_index;
+    /** index of unit to which map is attached in parent map */
+    unsigned int parent_unit_id;
+    unsigned int depth;
+    /** final size of map */
+    unsigned int width;
+    unsigned int height;
+    unsigned int dataset_size;
+    somr_counters_t counters;
+} somr_map_stats_t;
+
+/** Training statistics of a network, per map and aggregated */
+typedef struct somr_stats_t {
+    /** false if library was built without counters (STATS=0) */
+    bool enabled;
+    somr_counters_t total;
+    /** maps in training order */
+    somr_map_stats_t *maps;
+    unsigned int maps_count;
+    unsigned int maps_capacity;
+    /** units left without child map when best-first growth ran out of budget */
+    unsigned int pending_children_count;
+} somr_stats_t;
+
+void somr_stats_init(somr_stats_t *s);
+void somr_stats_clear(somr_stats_t *s);
+/** removes all map stats and resets total counters */
+void somr_stats_reset(somr_stats_t *s);
+/** @return index of new map stats entry */
+unsigned int somr_stats_add_map(somr_stats_t *s, int parent_index, unsigned int parent_unit_id, unsigned int dataset_size);
+/** sums counters of all maps into total counters */
+void somr_stats_compute_total(somr_stats_t *s);
+void somr_stats_write_json(somr_stats_t *s, FILE *file);
+char *somr_phase_get_name(somr_phase_t phase);
@@ -0,0 +1,59 @@
+#pragma once
+#include "dataset.h"
+#include "network.h"
+#include "trainer.h"
+#include <stddef.h>
+#include <stdio.h>
+
+/** measures of a network trained by a sweep, which is cleared once measured */
+typedef struct somr_sweep_result_t {
+    /** mean distance of input vectors to their best matching unit in a leaf map */
+    double quantization_error;
+    /** number of input vectors classified with a label other than their own */
+    unsigned int classification_errors_count;
+    unsigned int maps_count;
+    unsigned int units_count;
+    /** bytes allocated for maps, units, weights and indexes of network */
+    size_t model_bytes;
+    /** peak bytes accounted during training (see somr_memory_t), without shared input vectors */
+    size_t peak_bytes;
+    /** wall time in seconds, longer when trainings share cpus */
+    double train_time;
+    unsigned long long epochs_count;
+} somr_sweep_result_t;
+
+typedef struct somr_sweep_run_t {
+    somr_trainer_settings_t settings;
+    somr_sweep_result_t result;
+} somr_sweep_run_t;
+
+/**
+Trainings of networks with different settings on the same data set, run concurrently by a pool of threads:
+input vectors are shared and only read, each training reordering its own copy of the indices
+*/
+typedef struct somr_sweep_t {
+    /** normalized data set, which must not change while the sweep runs */
+    somr_dataset_t *dataset;
+    somr_sweep_run_t *runs;
+    unsigned int runs_count;
+    unsigned int runs_capacity;
+    /** number of trainings run at once */
+    unsigned int threads_count;
+    /**
+    bytes that running trainings may take on top of the shared data set (0 for no limit): fewer trainings are run
+    at once if needed, from an estimate of their memory that grows with the highest peak of trainings so far
+    */
+    size_t max_memory;
+} somr_sweep_t;
+
+/** @p threads_count: number of trainings run at once, 0 for one per cpu */
+void somr_sweep_init(somr_sweep_t *s, somr_dataset_t *dataset, unsigned int threads_count, size_t max_memory);
+void somr_sweep_clear(somr_sweep_t *s);
+/** adds training with @p settings (copied, without stats, checkpoint, trace, shard or memory) */
+void somr_sweep_add(somr_sweep_t *s, somr_trainer_settings_t *settings);
+/** runs all trainings and sets their results */
+void somr_sweep_run(somr_sweep_t *s);
+/** writes settings and results of runs as a json array */
+void somr_sweep_write_json(somr_sweep_t *s, FILE *file);
+/** writes settings and results of runs as a text table, one line per run */
+void somr_sweep_write_table(somr_sweep_t *s, FILE *file);
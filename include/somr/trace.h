@@ -0,0 +1,54 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdio.h>
+
+/** span recorded by a thread, opened by a begin event and closed by the next end event of the same thread */
+typedef struct somr_trace_event_t {
+    /** 'B' (begin) or 'E' (end) */
+    char type;
+    /** static name of span, NULL for end events */
+    const char *name;
+    /** for map spans: path of map in the tree (owned by buffer), NULL otherwise */
+    char *path;
+    /** in microseconds since trace start */
+    double timestamp;
+    /** for map spans: data set size on begin, map size on end */
+    unsigned int dataset_size;
+    unsigned int width;
+    unsigned int height;
+} somr_trace_event_t;
+
+/** events of one thread, only written by this thread until trace is written */
+typedef struct somr_trace_buffer_t {
+    somr_trace_event_t *events;
+    unsigned int events_count;
+    unsigned int events_capacity;
+    unsigned int thread_index;
+    struct somr_trace_buffer_t *next;
+} somr_trace_buffer_t;
+
+/**
+Timeline of training spans (maps, and phases as in somr_phase_t), written in Chrome trace event format
+(chrome://tracing or ui.perfetto.dev). Each thread records its events in its own buffer, without locks.
+*/
+typedef struct somr_trace_t {
+    /** identifies trace in the thread-local buffer caches */
+    unsigned long id;
+    /** in seconds, monotonic clock */
+    double start_time;
+    /** buffers of threads that recorded events */
+    _Atomic(somr_trace_buffer_t *) buffers;
+    atomic_uint threads_count;
+} somr_trace_t;
+
+void somr_trace_init(somr_trace_t *t);
+void somr_trace_clear(somr_trace_t *t);
+/**
+opens span @p name (static string) on calling thread,
+@p path (copied) and @p dataset_size describe the map of map spans (NULL and 0 for other spans)
+*/
+void somr_trace_begin(somr_trace_t *t, const char *name, char *path, unsigned int dataset_size);
+/** closes last span opened on calling thread, @p width and @p height being the final size of map of map spans */
+void somr_trace_end(somr_trace_t *t, unsigned int width, unsigned int height);
+/** writes events of all threads, which must be done recording */
+void somr_trace_write_json(somr_trace_t *t, FILE *file);
@@ -1,8 +1,14 @@
 #pragma once
+#include "checkpoint.h"
 #include "dataset.h"
 #include "map.h"
+#include "memory.h"
+#include "stats.h"
+#include "trace.h"
 #include <stdbool.h>
 
+typedef struct somr_shard_t somr_shard_t;
+
 typedef struct somr_trainer_settings_t {
     double learn_rate;
     double spread_threshold;
@@ -10,8 +16,86 @@ typedef struct somr_trainer_settings_t {
     unsigned int iters_count;
     bool should_orient;
     unsigned int rand_state;
+    /** stats to fill during training, NULL if not needed */
+    somr_stats_t *stats;
+    /**
+    relative improvement of quantization error between two epochs below which
+    the learning schedule is accelerated so that the pass ends early, 0 to always run @p iters_count epochs
+    */
+    double convergence_tolerance;
+    /**
+    if quantization error estimated during the second half of a pass exceeds the spread threshold
+    by this factor, the pass is ended and the map spread right away, 0 to disable
+    */
+    double early_spread_ratio;
+    /**
+    number of input vectors per unit of the map drawn at random for each epoch and error estimation,
+    0 to always use the whole data set of the map
+    */
+    unsigned int samples_per_unit;
+    /**
+    number of standard errors that a sampled error estimate must be away from the spread or depth threshold
+    to be trusted, the error is computed exactly on the whole data set otherwise
+    */
+    double error_confidence;
+    /**
+    max number of rows and columns inserted at once when a map spreads, the actual number grows with the gap
+    between map mean error and spread threshold, 1 to insert one row or column at a time
+    */
+    unsigned int max_insertions;
+    /**
+    if greater than 1, a full training pass is only run after every @p full_pass_period spreads,
+    other spreads are followed by a short fine-tuning of the area around inserted rows and columns, 0 to disable
+    */
+    unsigned int full_pass_period;
+    /** distance of network maps, set on top map when network training starts (maps being updated keep theirs) */
+    somr_metric_t metric;
+    /** checkpoints to write during training, NULL if not needed */
+    somr_checkpoint_t *checkpoint;
+    /** timeline of maps and phases to record during training, NULL if not needed */
+    somr_trace_t *trace;
+    /** workers training subtrees at shard depth in other processes, NULL to train all maps locally (not with checkpoints) */
+    somr_shard_t *shard;
+    /** bytes that training may allocate (see somr_memory_t), maps stop growing when more would be needed, 0 for no limit */
+    size_t memory_budget;
+    /** memory accounting to update during training, NULL if not needed */
+    somr_memory_t *memory;
+    /**
+    if true, child maps are trained best-first across the whole network, the unit of highest error being expanded next,
+    instead of depth-first map after map (see somr_trainer_train_best_first)
+    */
+    bool is_best_first;
+    /** wall time in seconds after which best-first growth stops expanding units, 0 for no limit */
+    double time_budget;
+    /** number of distance evaluations after which best-first growth stops expanding units (needs stats), 0 for no limit */
+    unsigned long long dist_evals_budget;
 } somr_trainer_settings_t;
 
+/** state of a linearly decaying learning schedule */
+typedef struct somr_schedule_t {
+    /** position in schedule, in [0, 1] */
+    double progress;
+    /** number of epochs run since the beginning of the schedule, drives decay when steps are fixed */
+    unsigned int epoch_index;
+    /** progress made by each epoch */
+    double step;
+    /** estimated error of previous epoch, -1 if none */
+    double previous_error;
+    unsigned int epochs_count;
+} somr_schedule_t;
+
+/** input vector and its bmu found during last error computation */
+typedef struct somr_bmu_cache_entry_t {
+    somr_data_vector_t *data_vector;
+    somr_unit_id_t bmu_id;
+} somr_bmu_cache_entry_t;
+
+/** row or column inserted by a spread, with index of row or column after which it was inserted (before insertion) */
+typedef struct somr_insertion_t {
+    bool is_row;
+    unsigned int before;
+} somr_insertion_t;
+
 /** Structure responsible of the training of a SOM network */
 typedef struct somr_trainer_t {
     /** network to train */
@@ -21,8 +105,41 @@ typedef struct somr_trainer_t {
     double root_mean_error;
     double parent_mean_error;
     somr_trainer_settings_t *settings;
+    /** index of map entry in settings stats, -1 if none */
+    int stats_index;
+    /** bmus of input vectors, filled by error computation when fine-tuning is enabled, NULL otherwise */
+    somr_bmu_cache_entry_t *bmu_cache;
+    unsigned int bmu_cache_count;
+    /** width of map when bmu cache was filled */
+    unsigned int bmu_cache_width;
+    /** insertions done since bmu cache was filled */
+    somr_insertion_t *insertions;
+    unsigned int insertions_count;
+    unsigned int insertions_capacity;
+    /** labels of network classes indexed by labels of data set classes, NULL if they are the same */
+    somr_label_t *labels_map;
+    /** trainer of parent map, NULL for top map */
+    struct somr_trainer_t *parent;
+    /** id of unit of parent map to which map is attached */
+    somr_unit_id_t parent_unit_id;
+    /** training loop state, saved in checkpoints */
+    bool is_deepening;
+    somr_unit_id_t deepen_unit_id;
+    unsigned int spreads_count;
+    bool was_fine_tuned;
+    unsigned int schedule_index;
+    somr_schedule_t schedule;
+    /** frames of map and of the child maps being trained when checkpoint was written, NULL if not resuming */
+    somr_checkpoint_frame_t *resume_frames;
+    unsigned int resume_frames_count;
+    /** bytes of map by category when last accounted in settings memory */
+    size_t map_bytes[SOMR_MEMORY_CATEGORIES_COUNT];
 } somr_trainer_t;
 
+/** sets required settings, other settings are set to defaults (fixed schedule, no sampling, no stats) */
+void somr_trainer_settings_init(somr_trainer_settings_t *s, double learn_rate, double spread_threshold, double depth_threshold,
+    unsigned int iters_count, bool should_orient, unsigned int seed);
+
 void somr_trainer_init(somr_trainer_t *t, somr_map_t *map, somr_dataset_t *dataset, double root_mean_error, double parent_mean_error, somr_trainer_settings_t *settings);
 
 /**
@@ -32,5 +149,38 @@ main training function
 @p learn: initial learning rate
 */
 void somr_trainer_train(somr_trainer_t *t);
+/**
+trains map, then child maps of units above depth threshold in order of decreasing unit error across all maps trained
+so far, until none is left or the time or distance evaluation budget of settings is spent: the network is then labelled
+and valid, refined where its error was highest (not with checkpoints or shard workers)
+*/
+void somr_trainer_train_best_first(somr_trainer_t *t);
+/**
+runs one pass on data set (or on a random sample of it if sampling is enabled), teaching the neighborhood of the bmu of each input vector
+@return estimated mean quantization error of units, computed from bmu distances before each update
+*/
+double somr_trainer_run_epoch(somr_trainer_t *t, double radius, double learn_rate);
+/**
+computes quantization error of all units and mean error of map
+(estimated from a sample if sampling is enabled and the estimate is far enough from the thresholds)
+@return id of unit with highest error
+*/
+somr_unit_id_t somr_trainer_compute_error(somr_trainer_t *t);
+/** inserts a row or a column between unit @p error_unit_id and its most distant neighbor */
+void somr_trainer_spread(somr_trainer_t *t, somr_unit_id_t error_unit_id);
+/**
+inserts rows and columns around up to @p max_count units of highest error, as somr_trainer_spread does for a single unit
+(units next to an already picked unit, or that would insert the same row or column, are skipped)
+@return number of rows and columns inserted
+*/
+unsigned int somr_trainer_spread_many(somr_trainer_t *t, unsigned int max_count);
 /** label units using labels of input vectors (to be run when training is over */
 void somr_trainer_label(somr_trainer_t *t);
+/**
+updates already trained map with new input vectors of data set (only), recursively:
+runs a short low radius schedule on them, adds their distances to unit errors,
+spreads the map if its mean error now exceeds the spread threshold (errors of previous input vectors being split between
+units around insertions), updates child maps of units they are mapped to, creates child maps for units whose
+error now exceeds the depth threshold and labels units they are mapped to
+*/
+void somr_trainer_update(somr_trainer_t *t);
@@ -1,17 +1,30 @@
 #pragma once
 #include "data_vector.h"
 #include "dataset.h"
+#include "metric.h"
 
 typedef struct somr_map_t somr_map_t;
 
 typedef struct somr_unit_t {
     /** memory vector */
     double *weights;
+    /**
+    factor applied to @p weights when learning from sparse input vectors, so that updates only touch their non-zero
+    features (weights are scale times @p weights until somr_unit_update_norm is called)
+    */
+    double scale;
+    /** squared norm of weights, valid after somr_unit_update_norm and maintained by updates */
+    double norm_squared;
     /** activation value for current input vector */
     double activation;
     double error;
     /** label assigned to unit after training */
     somr_label_t label;
+    /**
+    for a unit with a child map, number of input vectors of its subtree with its label, that vectors of later updates
+    add to (0 for other units)
+    */
+    unsigned int label_count;
     somr_map_t *child;
 } somr_unit_t;
 
@@ -19,8 +32,10 @@ void somr_unit_init(somr_unit_t *n, unsigned int features_count);
 void somr_unit_init_weights(somr_unit_t *n, double *weights, unsigned int features_count);
 void somr_unit_init_random_weights(somr_unit_t *n, unsigned int *rand_state, unsigned int features_count);
 void somr_unit_clear(somr_unit_t *n);
-/** activate unit with euclidean distance from @p vector */
-void somr_unit_activate(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count);
+/** applies pending scale to weights and computes their squared norm, needed by dot product kernels */
+void somr_unit_update_norm(somr_unit_t *n, unsigned int features_count);
+/** activate unit with squared distance from @p vector for @p metric */
+void somr_unit_activate(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count, somr_metric_t metric);
 /**
 brings weights of unit closer to values of input vector @p vector
 @p learn: learing rate
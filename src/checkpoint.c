@@ -0,0 +1,154 @@
+#include "checkpoint.h"
+#include "network.h"
+#include "trainer.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** suffix of file written before replacing checkpoint */
+#define SOMR_CHECKPOINT_TMP_SUFFIX ".tmp"
+
+void somr_checkpoint_init(somr_checkpoint_t *c, char *path, unsigned int period) {
+    c->path = path;
+    c->period = period;
+    c->epochs_count = 0;
+    c->network = NULL;
+    c->frames = NULL;
+    c->frames_count = 0;
+}
+
+void somr_checkpoint_clear(somr_checkpoint_t *c) {
+    for (unsigned int i = 0; i < c->frames_count; i++) {
+        free(c->frames[i].indices);
+    }
+    free(c->frames);
+    c->frames = NULL;
+    c->frames_count = 0;
+}
+
+void somr_checkpoint_tick(somr_checkpoint_t *c, somr_trainer_t *t) {
+    c->epochs_count++;
+    if (c->path == NULL || c->period == 0 || c->epochs_count < c->period) {
+        return;
+    }
+    c->epochs_count = 0;
+
+    // write to temporary file first, so that a kill while writing does not lose previous checkpoint
+    char *tmp_path = malloc(strlen(c->path) + strlen(SOMR_CHECKPOINT_TMP_SUFFIX) + 1);
+    strcpy(tmp_path, c->path);
+    strcat(tmp_path, SOMR_CHECKPOINT_TMP_SUFFIX);
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s\n", tmp_path);
+        exit(EXIT_FAILURE);
+    }
+    somr_checkpoint_write(c, t, file);
+    if (ferror(file) || fclose(file) != 0 || rename(tmp_path, c->path) != 0) {
+        fprintf(stderr, "Error writing checkpoint %s\n", c->path);
+        exit(EXIT_FAILURE);
+    }
+    free(tmp_path);
+}
+
+void somr_checkpoint_write(somr_checkpoint_t *c, somr_trainer_t *t, FILE *file) {
+    assert(c->network != NULL);
+
+    // frames are written from top map, trainers are linked from map being trained
+    uint32_t frames_count = 0;
+    for (somr_trainer_t *trainer = t; trainer != NULL; trainer = trainer->parent) {
+        frames_count++;
+    }
+    somr_trainer_t **trainers = malloc(sizeof(somr_trainer_t *) * frames_count);
+    unsigned int index = frames_count;
+    for (somr_trainer_t *trainer = t; trainer != NULL; trainer = trainer->parent) {
+        index--;
+        trainers[index] = trainer;
+    }
+
+    uint32_t rand_state = t->settings->rand_state;
+    fwrite(SOMR_CHECKPOINT_MAGIC, 1, SOMR_CHECKPOINT_MAGIC_LENGTH, file);
+    fwrite(&rand_state, sizeof(uint32_t), 1, file);
+    somr_network_write(c->network, file);
+    fwrite(&frames_count, sizeof(uint32_t), 1, file);
+
+    for (unsigned int i = 0; i < frames_count; i++) {
+        somr_trainer_t *trainer = trainers[i];
+        uint32_t header[4] = { trainer->parent_unit_id, trainer->deepen_unit_id, trainer->spreads_count, trainer->schedule_index };
+        uint8_t flags[2] = { trainer->is_deepening, trainer->was_fine_tuned };
+        double schedule[3] = { trainer->schedule.progress, trainer->schedule.step, trainer->schedule.previous_error };
+        uint32_t schedule_counts[2] = { trainer->schedule.epoch_index, trainer->schedule.epochs_count };
+        uint32_t dataset_size = trainer->dataset->size;
+        fwrite(header, sizeof(uint32_t), 4, file);
+        fwrite(flags, sizeof(uint8_t), 2, file);
+        fwrite(schedule, sizeof(double), 3, file);
+        fwrite(schedule_counts, sizeof(uint32_t), 2, file);
+        fwrite(&dataset_size, sizeof(uint32_t), 1, file);
+        fwrite(trainer->dataset->indices, sizeof(uint32_t), dataset_size, file);
+    }
+
+    free(trainers);
+}
+
+void somr_checkpoint_read(somr_checkpoint_t *c, somr_network_t *n, unsigned int *rand_state, FILE *file) {
+    char magic[SOMR_CHECKPOINT_MAGIC_LENGTH];
+    uint32_t state;
+    if (fread(magic, 1, SOMR_CHECKPOINT_MAGIC_LENGTH, file) != SOMR_CHECKPOINT_MAGIC_LENGTH
+        || memcmp(magic, SOMR_CHECKPOINT_MAGIC, SOMR_CHECKPOINT_MAGIC_LENGTH) != 0
+        || fread(&state, sizeof(uint32_t), 1, file) != 1) {
+        fprintf(stderr, "Invalid checkpoint header\n");
+        exit(EXIT_FAILURE);
+    }
+    *rand_state = state;
+    somr_network_init_from_binary_file(n, file);
+
+    uint32_t frames_count;
+    if (fread(&frames_count, sizeof(uint32_t), 1, file) != 1 || frames_count == 0) {
+        fprintf(stderr, "Invalid checkpoint frames\n");
+        exit(EXIT_FAILURE);
+    }
+    somr_checkpoint_clear(c);
+    c->frames = calloc(frames_count, sizeof(somr_checkpoint_frame_t));
+    c->frames_count = frames_count;
+
+    for (unsigned int i = 0; i < frames_count; i++) {
+        somr_checkpoint_frame_t *frame = &c->frames[i];
+        uint32_t header[4];
+        uint8_t flags[2];
+        double schedule[3];
+        uint32_t schedule_counts[2];
+        uint32_t dataset_size;
+        if (fread(header, sizeof(uint32_t), 4, file) != 4
+            || fread(flags, sizeof(uint8_t), 2, file) != 2
+            || fread(schedule, sizeof(double), 3, file) != 3
+            || fread(schedule_counts, sizeof(uint32_t), 2, file) != 2
+            || fread(&dataset_size, sizeof(uint32_t), 1, file) != 1
+            || dataset_size == 0) {
+            fprintf(stderr, "Invalid checkpoint frame\n");
+            exit(EXIT_FAILURE);
+        }
+        frame->parent_unit_id = header[0];
+        frame->deepen_unit_id = header[1];
+        frame->spreads_count = header[2];
+        frame->schedule_index = header[3];
+        frame->is_deepening = flags[0];
+        frame->was_fine_tuned = flags[1];
+        frame->progress = schedule[0];
+        frame->step = schedule[1];
+        frame->previous_error = schedule[2];
+        frame->schedule_epoch_index = schedule_counts[0];
+        frame->schedule_epochs_count = schedule_counts[1];
+        frame->dataset_size = dataset_size;
+        frame->indices = malloc(sizeof(unsigned int) * dataset_size);
+        if (fread(frame->indices, sizeof(uint32_t), dataset_size, file) != dataset_size) {
+            fprintf(stderr, "Invalid checkpoint frame\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // frames other than last one must be deepening, last one must be growing
+        if (frame->is_deepening != (i + 1 < frames_count)) {
+            fprintf(stderr, "Invalid checkpoint frame\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
@@ -10,18 +10,136 @@ void somr_data_vector_init_batch(somr_data_vector_t *batch, unsigned int batch_s
     double *all_weights = malloc(sizeof(double) * features_count * batch_size);
     for (unsigned int i = 0; i < batch_size; i++) {
         batch[i].weights = &all_weights[i * features_count];
+        batch[i].codes = NULL;
+        batch[i].quantizer = NULL;
+        batch[i].nnz_count = 0;
+        batch[i].nnz_indices = NULL;
+        batch[i].nnz_values = NULL;
+        batch[i].norm_squared = -1.0;
+    }
+}
+
+void somr_data_vector_init_sparse_batch(somr_data_vector_t *batch, unsigned int batch_size, unsigned int *offsets, unsigned int *nnz_indices, double *nnz_values) {
+    assert(batch_size > 0);
+    assert(nnz_indices != NULL && nnz_values != NULL);
+    assert(offsets[0] == 0);
+
+    for (unsigned int i = 0; i < batch_size; i++) {
+        somr_data_vector_t *v = &batch[i];
+        v->weights = NULL;
+        v->codes = NULL;
+        v->quantizer = NULL;
+        v->nnz_count = offsets[i + 1] - offsets[i];
+        v->nnz_indices = &nnz_indices[offsets[i]];
+        v->nnz_values = &nnz_values[offsets[i]];
+        v->norm_squared = 0.0;
+        for (unsigned int j = 0; j < v->nnz_count; j++) {
+            v->norm_squared += v->nnz_values[j] * v->nnz_values[j];
+        }
+    }
+}
+
+void somr_data_vector_quantize_batch(somr_data_vector_t *batch, unsigned int batch_size, somr_quantizer_t *quantizer) {
+    assert(batch_size > 0);
+    assert(!somr_data_vector_is_sparse(&batch[0]) && !somr_data_vector_is_quantized(&batch[0]));
+
+    unsigned int features_count = quantizer->features_count;
+    size_t code_size = somr_quantizer_get_code_size(quantizer) * features_count;
+    char *all_codes = malloc(code_size * batch_size);
+    double *block = malloc(sizeof(double) * features_count);
+    for (unsigned int i = 0; i < batch_size; i++) {
+        somr_data_vector_t *v = &batch[i];
+        v->codes = &all_codes[i * code_size];
+        v->quantizer = quantizer;
+        somr_quantizer_encode(quantizer, v->weights, v->codes);
+        // norm of decoded weights, so that distances from dot products match full distances
+        somr_quantizer_decode(quantizer, v->codes, 0, features_count, block);
+        v->norm_squared = somr_vector_dot(block, block, features_count);
+    }
+    free(block);
+
+    free(batch[0].weights);
+    for (unsigned int i = 0; i < batch_size; i++) {
+        batch[i].weights = NULL;
     }
 }
 
 void somr_data_vector_clear_batch(somr_data_vector_t *batch, unsigned int batch_size) {
     assert(batch_size > 0);
     free(batch[0].weights);
+    free(batch[0].codes);
+    free(batch[0].nnz_indices);
+    free(batch[0].nnz_values);
     for (unsigned int i = 0; i < batch_size; i++) {
         batch[i].weights = NULL;
+        batch[i].codes = NULL;
+        batch[i].nnz_indices = NULL;
+        batch[i].nnz_values = NULL;
     }
 }
 
+bool somr_data_vector_is_sparse(somr_data_vector_t *v) {
+    return v->weights == NULL && v->codes == NULL;
+}
+
+bool somr_data_vector_is_quantized(somr_data_vector_t *v) {
+    return v->codes != NULL;
+}
+
+double *somr_data_vector_get_block(somr_data_vector_t *v, unsigned int begin, unsigned int count, double *buffer) {
+    assert(!somr_data_vector_is_sparse(v));
+    if (somr_data_vector_is_quantized(v)) {
+        somr_quantizer_decode(v->quantizer, v->codes, begin, count, buffer);
+        return buffer;
+    }
+    return &v->weights[begin];
+}
+
+somr_data_vector_t *somr_data_vector_decode(somr_data_vector_t *v, unsigned int features_count, somr_data_vector_t *decoded, double *buffer) {
+    if (!somr_data_vector_is_quantized(v)) {
+        return v;
+    }
+    *decoded = *v;
+    decoded->weights = buffer;
+    decoded->codes = NULL;
+    decoded->quantizer = NULL;
+    somr_quantizer_decode(v->quantizer, v->codes, 0, features_count, buffer);
+    return decoded;
+}
+
 void somr_data_vector_normalize(somr_data_vector_t *v, unsigned int features_count) {
     assert(features_count > 0);
-    somr_vector_normalize(v->weights, features_count);
+    // codes are fitted to normalized values, vectors are normalized before being quantized
+    assert(!somr_data_vector_is_quantized(v));
+    if (!somr_data_vector_is_sparse(v)) {
+        somr_vector_normalize(v->weights, features_count);
+        v->norm_squared = 1.0;
+    } else if (v->nnz_count > 0) {
+        somr_vector_normalize(v->nnz_values, v->nnz_count);
+        v->norm_squared = 1.0;
+    }
+}
+
+void somr_data_vector_add_to(somr_data_vector_t *v, double *sum, unsigned int features_count) {
+    if (somr_data_vector_is_quantized(v)) {
+        double block[SOMR_QUANTIZER_BLOCK_SIZE];
+        for (unsigned int begin = 0; begin < features_count; begin += SOMR_QUANTIZER_BLOCK_SIZE) {
+            unsigned int count = (features_count - begin < SOMR_QUANTIZER_BLOCK_SIZE) ? features_count - begin : SOMR_QUANTIZER_BLOCK_SIZE;
+            somr_quantizer_decode(v->quantizer, v->codes, begin, count, block);
+            for (unsigned int i = 0; i < count; i++) {
+                sum[begin + i] += block[i];
+            }
+        }
+        return;
+    }
+    if (!somr_data_vector_is_sparse(v)) {
+        for (unsigned int i = 0; i < features_count; i++) {
+            sum[i] += v->weights[i];
+        }
+        return;
+    }
+    for (unsigned int i = 0; i < v->nnz_count; i++) {
+        assert(v->nnz_indices[i] < features_count);
+        sum[v->nnz_indices[i]] += v->nnz_values[i];
+    }
 }
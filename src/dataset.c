@@ -1,8 +1,12 @@
-#define _GNU_SOURCE // for strtok_r and rand_r
+#define _GNU_SOURCE // for strtok_r, rand_r and sysconf
 #include "dataset.h"
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 void somr_dataset_init(somr_dataset_t *d, somr_data_vector_t *data_vectors, unsigned int *indices, unsigned int size, unsigned int features_count, somr_list_t *class_list) {
     assert(size > 0);
@@ -16,25 +20,47 @@ void somr_dataset_init(somr_dataset_t *d, somr_data_vector_t *data_vectors, unsi
     d->indices = malloc(sizeof(unsigned int) * d->size);
     memcpy(d->indices, indices, sizeof(unsigned int) * d->size);
     d->has_parent = false;
+    d->owns_indices = true;
+    d->is_sparse = somr_data_vector_is_sparse(&data_vectors[0]);
+    d->quantizer = NULL;
+    d->mean = NULL;
 }
 
-void somr_dataset_init_from_parent(somr_dataset_t *d, somr_dataset_t *parent, unsigned int *indices, unsigned int size) {
+void somr_dataset_init_from_parent(somr_dataset_t *d, somr_dataset_t *parent, unsigned int begin, unsigned int size) {
     assert(size > 0);
+    assert(begin + size <= parent->size);
 
     d->data_vectors = parent->data_vectors;
     d->size = size;
     d->features_count = parent->features_count;
     d->class_list = parent->class_list;
+    d->indices = &parent->indices[begin];
+    d->has_parent = true;
+    d->owns_indices = false;
+    d->is_sparse = parent->is_sparse;
+    d->quantizer = parent->quantizer;
+    d->mean = NULL;
+}
+
+void somr_dataset_init_shared(somr_dataset_t *d, somr_dataset_t *source) {
+    d->data_vectors = source->data_vectors;
+    d->size = source->size;
+    d->features_count = source->features_count;
+    d->class_list = source->class_list;
     d->indices = malloc(sizeof(unsigned int) * d->size);
-    for (unsigned int i = 0; i < size; i++) {
-        d->indices[i] = parent->indices[indices[i]];
-    }
+    memcpy(d->indices, source->indices, sizeof(unsigned int) * d->size);
     d->has_parent = true;
+    d->owns_indices = true;
+    d->is_sparse = source->is_sparse;
+    d->quantizer = source->quantizer;
+    // mean is read by trainings, but only freed with source
+    d->mean = source->mean;
 }
 
 void somr_dataset_clear(somr_dataset_t *d) {
-    free(d->indices);
-    d->indices = NULL;
+    if (d->owns_indices) {
+        free(d->indices);
+    }
     if (!d->has_parent) {
         somr_data_vector_clear_batch(d->data_vectors, d->size);
         free(d->data_vectors);
@@ -42,7 +68,15 @@ void somr_dataset_clear(somr_dataset_t *d) {
         somr_list_clear(d->class_list);
         free(d->class_list);
         d->class_list = NULL;
+        if (d->quantizer != NULL) {
+            somr_quantizer_clear(d->quantizer);
+            free(d->quantizer);
+        }
+        free(d->mean);
     }
+    d->indices = NULL;
+    d->quantizer = NULL;
+    d->mean = NULL;
 }
 
 somr_data_vector_t *somr_dataset_get_vector(somr_dataset_t *d, unsigned int index) {
@@ -68,14 +102,69 @@ void somr_dataset_shuffle(somr_dataset_t *d, unsigned int *rand_state) {
     }
 }
 
+void somr_dataset_shuffle_head(somr_dataset_t *d, unsigned int count, unsigned int *rand_state) {
+    assert(count <= d->size);
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int index = i + rand_r(rand_state) % (d->size - i);
+        unsigned int swap = d->indices[i];
+        d->indices[i] = d->indices[index];
+        d->indices[index] = swap;
+    }
+}
+
 void somr_dataset_normalize(somr_dataset_t *d) {
     for (unsigned int i = 0; i < d->size; i++) {
         unsigned int index = d->indices[i];
         somr_data_vector_normalize(&d->data_vectors[index], d->features_count);
     }
+    free(d->mean);
+    d->mean = NULL;
+}
+
+void somr_dataset_quantize(somr_dataset_t *d, somr_encoding_t encoding) {
+    assert(!d->has_parent);
+    if (d->quantizer != NULL || encoding == SOMR_ENCODING_DOUBLE) {
+        return;
+    }
+    if (d->is_sparse) {
+        fprintf(stderr, "Sparse input vectors cannot be quantized\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double *mins = malloc(sizeof(double) * d->features_count);
+    double *maxs = malloc(sizeof(double) * d->features_count);
+    for (unsigned int j = 0; j < d->features_count; j++) {
+        mins[j] = d->data_vectors[0].weights[j];
+        maxs[j] = d->data_vectors[0].weights[j];
+    }
+    for (unsigned int i = 1; i < d->size; i++) {
+        double *weights = d->data_vectors[i].weights;
+        for (unsigned int j = 0; j < d->features_count; j++) {
+            mins[j] = (weights[j] < mins[j]) ? weights[j] : mins[j];
+            maxs[j] = (weights[j] > maxs[j]) ? weights[j] : maxs[j];
+        }
+    }
+
+    d->quantizer = malloc(sizeof(somr_quantizer_t));
+    somr_quantizer_init(d->quantizer, encoding, d->features_count, mins, maxs);
+    somr_data_vector_quantize_batch(d->data_vectors, d->size, d->quantizer);
+    free(mins);
+    free(maxs);
+    // mean was computed from values before rounding
+    free(d->mean);
+    d->mean = NULL;
+}
+
+size_t somr_dataset_get_feature_size(somr_dataset_t *d) {
+    return (d->quantizer != NULL) ? somr_quantizer_get_code_size(d->quantizer) : sizeof(double);
 }
 
 void somr_dataset_compute_mean_weights(somr_dataset_t *d, double *mean_weights) {
+    if (d->mean != NULL) {
+        memcpy(mean_weights, d->mean, sizeof(double) * d->features_count);
+        return;
+    }
+
     for (unsigned int i = 0; i < d->features_count; i++) {
         mean_weights[i] = 0.0;
     }
@@ -83,10 +172,7 @@ void somr_dataset_compute_mean_weights(somr_dataset_t *d, double *mean_weights)
     // sum all vectors
     for (unsigned int i = 0; i < d->size; i++) {
         unsigned int real_index = d->indices[i];
-        somr_data_vector_t *data_vector = &d->data_vectors[real_index];
-        for (unsigned int j = 0; j < d->features_count; j++) {
-            mean_weights[j] += data_vector->weights[j];
-        }
+        somr_data_vector_add_to(&d->data_vectors[real_index], mean_weights, d->features_count);
     }
 
     // get average for each feature
@@ -96,10 +182,181 @@ void somr_dataset_compute_mean_weights(somr_dataset_t *d, double *mean_weights)
     }
 }
 
-void somr_dataset_init_from_file(somr_dataset_t *d, FILE *file, unsigned int size, unsigned int features_count) {
+/** number of csv lines handed at once to a parsing thread */
+#define SOMR_DATASET_BATCH_LINES 256
+/** number of batches per parsing thread, so that reading goes on while batches are parsed */
+#define SOMR_DATASET_BATCHES_PER_THREAD 4
+
+typedef enum somr_dataset_batch_state_t {
+    SOMR_DATASET_BATCH_FREE,
+    SOMR_DATASET_BATCH_READ,
+    SOMR_DATASET_BATCH_PARSING,
+    SOMR_DATASET_BATCH_PARSED
+} somr_dataset_batch_state_t;
+
+/** consecutive csv lines, without their labels (already read) */
+typedef struct somr_dataset_batch_t {
+    somr_dataset_batch_state_t state;
+    /** index of batch in file, batches are merged in this order */
+    unsigned int sequence;
+    unsigned int first_index;
+    unsigned int lines_count;
+    /** features of lines, one null-terminated string after the other */
+    char *text;
+    size_t text_length;
+    size_t text_capacity;
+    size_t line_offsets[SOMR_DATASET_BATCH_LINES];
+    /** mean of input vectors of batch */
+    double *mean;
+} somr_dataset_batch_t;
+
+/** csv reading pipeline: calling thread reads lines and labels, parsing threads parse and normalize features */
+typedef struct somr_dataset_loader_t {
+    somr_data_vector_t *data_vectors;
+    unsigned int features_count;
+    bool should_normalize;
+    /** ring of batches, batch of sequence i being in slot i % batches count */
+    somr_dataset_batch_t *batches;
+    unsigned int batches_count;
+    /** sequence of next batch to merge into mean */
+    unsigned int merged_count;
+    /** number of input vectors merged into mean */
+    unsigned int vectors_count;
+    double *mean;
+    bool is_done;
+    pthread_mutex_t mutex;
+    /** signaled on any change of batch state */
+    pthread_cond_t cond;
+} somr_dataset_loader_t;
+
+/** parses features of batch lines, normalizing them if requested, and computes their mean with Welford's method */
+static void somr_dataset_parse_batch(somr_dataset_loader_t *l, somr_dataset_batch_t *b) {
+    char *delims = ",\n";
+    for (unsigned int j = 0; j < l->features_count; j++) {
+        b->mean[j] = 0.0;
+    }
+    for (unsigned int i = 0; i < b->lines_count; i++) {
+        somr_data_vector_t *data_vector = &l->data_vectors[b->first_index + i];
+        char *strtok_save;
+        char *token = strtok_r(&b->text[b->line_offsets[i]], delims, &strtok_save);
+        for (unsigned int j = 0; j < l->features_count; j++) {
+            if (token == NULL) {
+                fprintf(stderr, "Error reading input data feature\n");
+                exit(EXIT_FAILURE);
+            }
+            data_vector->weights[j] = atof(token);
+            token = strtok_r(NULL, delims, &strtok_save);
+        }
+        if (l->should_normalize) {
+            somr_data_vector_normalize(data_vector, l->features_count);
+        }
+        for (unsigned int j = 0; j < l->features_count; j++) {
+            b->mean[j] += (data_vector->weights[j] - b->mean[j]) / (i + 1);
+        }
+    }
+}
+
+/** merges means of parsed batches into data set mean, in file order so that it does not depend on thread timings */
+static void somr_dataset_merge_batches(somr_dataset_loader_t *l) {
+    while (true) {
+        somr_dataset_batch_t *b = &l->batches[l->merged_count % l->batches_count];
+        if (b->state != SOMR_DATASET_BATCH_PARSED || b->sequence != l->merged_count) {
+            return;
+        }
+        // mean of union of two sets from their means (Chan et al.)
+        unsigned int count = l->vectors_count + b->lines_count;
+        for (unsigned int j = 0; j < l->features_count; j++) {
+            l->mean[j] += (b->mean[j] - l->mean[j]) * b->lines_count / count;
+        }
+        l->vectors_count = count;
+        l->merged_count++;
+        b->state = SOMR_DATASET_BATCH_FREE;
+    }
+}
+
+static void *somr_dataset_parse_worker(void *arg) {
+    somr_dataset_loader_t *l = arg;
+    pthread_mutex_lock(&l->mutex);
+    while (true) {
+        somr_dataset_batch_t *batch = NULL;
+        for (unsigned int i = 0; i < l->batches_count && batch == NULL; i++) {
+            if (l->batches[i].state == SOMR_DATASET_BATCH_READ) {
+                batch = &l->batches[i];
+            }
+        }
+        if (batch == NULL) {
+            if (l->is_done) {
+                break;
+            }
+            pthread_cond_wait(&l->cond, &l->mutex);
+            continue;
+        }
+
+        batch->state = SOMR_DATASET_BATCH_PARSING;
+        pthread_mutex_unlock(&l->mutex);
+        somr_dataset_parse_batch(l, batch);
+        pthread_mutex_lock(&l->mutex);
+        batch->state = SOMR_DATASET_BATCH_PARSED;
+        pthread_cond_broadcast(&l->cond);
+    }
+    pthread_mutex_unlock(&l->mutex);
+    return NULL;
+}
+
+/** appends @p line to text of batch, as its next line */
+static void somr_dataset_push_line(somr_dataset_batch_t *b, char *line) {
+    size_t length = strlen(line) + 1;
+    if (b->text_length + length > b->text_capacity) {
+        b->text_capacity = (b->text_length + length) * 2;
+        b->text = realloc(b->text, b->text_capacity);
+    }
+    memcpy(&b->text[b->text_length], line, length);
+    b->line_offsets[b->lines_count] = b->text_length;
+    b->text_length += length;
+    b->lines_count++;
+}
+
+/**
+reads csv @p file with one thread reading lines while others parse them, normalizing input vectors if
+@p should_normalize is true, and computing their mean in the same pass
+*/
+static void somr_dataset_read_csv(somr_dataset_t *d, FILE *file, unsigned int size, unsigned int features_count, bool should_normalize) {
+    assert(size > 0);
+    assert(features_count > 0);
+
     somr_data_vector_t *data_vectors = malloc(sizeof(somr_data_vector_t) * size);
     somr_data_vector_init_batch(data_vectors, size, features_count);
 
+    long cpus_count = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int threads_count = (cpus_count > 1) ? (unsigned int) cpus_count - 1 : 0;
+    unsigned int batches_needed = (size + SOMR_DATASET_BATCH_LINES - 1) / SOMR_DATASET_BATCH_LINES;
+    threads_count = (threads_count < batches_needed) ? threads_count : batches_needed - 1;
+
+    somr_dataset_loader_t l;
+    l.data_vectors = data_vectors;
+    l.features_count = features_count;
+    l.should_normalize = should_normalize;
+    l.batches_count = (threads_count > 0) ? threads_count * SOMR_DATASET_BATCHES_PER_THREAD : 1;
+    l.batches = calloc(l.batches_count, sizeof(somr_dataset_batch_t));
+    for (unsigned int i = 0; i < l.batches_count; i++) {
+        l.batches[i].mean = malloc(sizeof(double) * features_count);
+    }
+    l.merged_count = 0;
+    l.vectors_count = 0;
+    l.mean = calloc(features_count, sizeof(double));
+    l.is_done = false;
+    pthread_mutex_init(&l.mutex, NULL);
+    pthread_cond_init(&l.cond, NULL);
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * (threads_count + 1));
+    unsigned int started_count = 0;
+    for (unsigned int i = 0; i < threads_count; i++) {
+        if (pthread_create(&threads[started_count], NULL, somr_dataset_parse_worker, &l) != 0) {
+            break;
+        }
+        started_count++;
+    }
+
     somr_list_t class_list;
     somr_list_init(&class_list, true);
 
@@ -108,48 +365,231 @@ void somr_dataset_init_from_file(somr_dataset_t *d, FILE *file, unsigned int siz
     size_t max_line_length = 256;
     char *line = malloc(sizeof(char) * max_line_length);
 
+    unsigned int index = 0;
+    for (unsigned int sequence = 0; index < size; sequence++) {
+        somr_dataset_batch_t *batch = &l.batches[sequence % l.batches_count];
+        pthread_mutex_lock(&l.mutex);
+        somr_dataset_merge_batches(&l);
+        while (batch->state != SOMR_DATASET_BATCH_FREE) {
+            pthread_cond_wait(&l.cond, &l.mutex);
+            somr_dataset_merge_batches(&l);
+        }
+        pthread_mutex_unlock(&l.mutex);
+
+        batch->sequence = sequence;
+        batch->first_index = index;
+        batch->lines_count = 0;
+        batch->text_length = 0;
+        for (; index < size && batch->lines_count < SOMR_DATASET_BATCH_LINES; index++) {
+            if (getline(&line, &max_line_length, file) == -1) {
+                fprintf(stderr, "Error reading input data vector\n");
+                exit(EXIT_FAILURE);
+            }
+
+            // read label, classes are numbered in order of appearance
+            char *strtok_save;
+            char *token = strtok_r(line, delims, &strtok_save);
+            if (token == NULL) {
+                fprintf(stderr, "Error reading input data label\n");
+                exit(EXIT_FAILURE);
+            }
+            unsigned int class_index;
+            if (!somr_list_find(&class_list, token, &class_index)) {
+                class_index = class_list.size;
+                somr_list_push(&class_list, token);
+            }
+            data_vectors[index].label = class_index;
+            somr_dataset_push_line(batch, strtok_save);
+        }
+
+        // without parsing threads, batches are parsed as soon as they are read
+        if (started_count == 0) {
+            somr_dataset_parse_batch(&l, batch);
+            batch->state = SOMR_DATASET_BATCH_PARSED;
+            continue;
+        }
+        pthread_mutex_lock(&l.mutex);
+        batch->state = SOMR_DATASET_BATCH_READ;
+        pthread_cond_broadcast(&l.cond);
+        pthread_mutex_unlock(&l.mutex);
+    }
+    free(line);
+
+    pthread_mutex_lock(&l.mutex);
+    somr_dataset_merge_batches(&l);
+    while (l.vectors_count < size) {
+        pthread_cond_wait(&l.cond, &l.mutex);
+        somr_dataset_merge_batches(&l);
+    }
+    l.is_done = true;
+    pthread_cond_broadcast(&l.cond);
+    pthread_mutex_unlock(&l.mutex);
+    for (unsigned int i = 0; i < started_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_cond_destroy(&l.cond);
+    pthread_mutex_destroy(&l.mutex);
+    for (unsigned int i = 0; i < l.batches_count; i++) {
+        free(l.batches[i].text);
+        free(l.batches[i].mean);
+    }
+    free(l.batches);
+
+    // init array containing indices used to acces input vectors in random order
+    unsigned int *indices = malloc(sizeof(unsigned int) * size);
+    for (unsigned int i = 0; i < size; i++) {
+        indices[i] = i;
+    }
+    somr_dataset_init(d, data_vectors, indices, size, features_count, &class_list);
+    d->mean = l.mean;
+    somr_list_clear(&class_list);
+    free(indices);
+}
+
+void somr_dataset_init_from_file(somr_dataset_t *d, FILE *file, unsigned int size, unsigned int features_count) {
+    somr_dataset_read_csv(d, file, size, features_count, false);
+}
+
+void somr_dataset_init_from_normalized_file(somr_dataset_t *d, FILE *file, unsigned int size, unsigned int features_count) {
+    somr_dataset_read_csv(d, file, size, features_count, true);
+}
+
+void somr_dataset_init_from_sparse_file(somr_dataset_t *d, FILE *file, unsigned int size, unsigned int features_count) {
+    assert(size > 0);
+    assert(features_count > 0);
+
+    // values of all vectors are stored contiguously, vector i from offsets[i] to offsets[i + 1]
+    unsigned int *offsets = malloc(sizeof(unsigned int) * (size + 1));
+    unsigned int nnz_capacity = size;
+    unsigned int *nnz_indices = malloc(sizeof(unsigned int) * nnz_capacity);
+    double *nnz_values = malloc(sizeof(double) * nnz_capacity);
+    unsigned int nnz_count = 0;
+    somr_label_t *labels = malloc(sizeof(somr_label_t) * size);
+
+    somr_list_t class_list;
+    somr_list_init(&class_list, true);
+
+    char *delims = " \t\n";
+    size_t max_line_length = 256;
+    char *line = malloc(sizeof(char) * max_line_length);
+
     for (unsigned int i = 0; i < size; i++) {
-        int line_length = getline(&line, &max_line_length, file);
-        if (line_length == -1) {
+        if (getline(&line, &max_line_length, file) == -1) {
             fprintf(stderr, "Error reading input data vector\n");
             exit(EXIT_FAILURE);
         }
-
-        // pointer to memory for vector being read
-        somr_data_vector_t *data_vector = &data_vectors[i];
+        offsets[i] = nnz_count;
         char *strtok_save;
 
-        // read label
-        // first call to strtok: feed line
         char *token = strtok_r(line, delims, &strtok_save);
         if (token == NULL) {
             fprintf(stderr, "Error reading input data label\n");
             exit(EXIT_FAILURE);
         }
-
-        // add class if new and label vector with class index
         unsigned int class_index;
         if (!somr_list_find(&class_list, token, &class_index)) {
             class_index = class_list.size;
             somr_list_push(&class_list, token);
         }
-        data_vector->label = class_index;
+        labels[i] = class_index;
 
-        // read weights
-        for (unsigned int j = 0; j < features_count; j++) {
-            char *token = strtok_r(NULL, delims, &strtok_save);
-            if (token == NULL) {
+        unsigned int previous_index = 0;
+        for (token = strtok_r(NULL, delims, &strtok_save); token != NULL; token = strtok_r(NULL, delims, &strtok_save)) {
+            char *value_begin;
+            unsigned long index = strtoul(token, &value_begin, 10);
+            if (*value_begin != ':' || index <= previous_index || index > features_count) {
                 fprintf(stderr, "Error reading input data feature\n");
                 exit(EXIT_FAILURE);
             }
+            previous_index = index;
+            double value = atof(value_begin + 1);
+            if (value == 0.0) {
+                continue;
+            }
 
-            data_vector->weights[j] = atof(token);
+            if (nnz_count == nnz_capacity) {
+                nnz_capacity *= 2;
+                nnz_indices = realloc(nnz_indices, sizeof(unsigned int) * nnz_capacity);
+                nnz_values = realloc(nnz_values, sizeof(double) * nnz_capacity);
+            }
+            nnz_indices[nnz_count] = index - 1;
+            nnz_values[nnz_count] = value;
+            nnz_count++;
         }
     }
-
+    offsets[size] = nnz_count;
     free(line);
 
-    // init array containing indices used to acces input vectors in random order
+    somr_data_vector_t *data_vectors = malloc(sizeof(somr_data_vector_t) * size);
+    somr_data_vector_init_sparse_batch(data_vectors, size, offsets, nnz_indices, nnz_values);
+    for (unsigned int i = 0; i < size; i++) {
+        data_vectors[i].label = labels[i];
+    }
+
+    unsigned int *indices = malloc(sizeof(unsigned int) * size);
+    for (unsigned int i = 0; i < size; i++) {
+        indices[i] = i;
+    }
+    somr_dataset_init(d, data_vectors, indices, size, features_count, &class_list);
+    somr_list_clear(&class_list);
+    free(indices);
+    free(offsets);
+    free(labels);
+}
+
+void somr_dataset_init_from_binary_file(somr_dataset_t *d, FILE *file) {
+    char magic[SOMR_DATASET_MAGIC_LENGTH];
+    uint32_t features_count;
+    uint32_t classes_count;
+    uint64_t size;
+    if (fread(magic, 1, SOMR_DATASET_MAGIC_LENGTH, file) != SOMR_DATASET_MAGIC_LENGTH
+        || memcmp(magic, SOMR_DATASET_MAGIC, SOMR_DATASET_MAGIC_LENGTH) != 0) {
+        fprintf(stderr, "Invalid binary data header\n");
+        exit(EXIT_FAILURE);
+    }
+    if (fread(&features_count, sizeof(uint32_t), 1, file) != 1
+        || fread(&classes_count, sizeof(uint32_t), 1, file) != 1
+        || fread(&size, sizeof(uint64_t), 1, file) != 1
+        || features_count == 0 || size == 0 || size > UINT_MAX) {
+        fprintf(stderr, "Invalid binary data header\n");
+        exit(EXIT_FAILURE);
+    }
+
+    somr_list_t class_list;
+    somr_list_init(&class_list, true);
+    for (uint32_t i = 0; i < classes_count; i++) {
+        uint32_t name_length;
+        if (fread(&name_length, sizeof(uint32_t), 1, file) != 1) {
+            fprintf(stderr, "Error reading input data class\n");
+            exit(EXIT_FAILURE);
+        }
+        char *name = malloc(sizeof(char) * (name_length + 1));
+        if (fread(name, 1, name_length, file) != name_length) {
+            fprintf(stderr, "Error reading input data class\n");
+            exit(EXIT_FAILURE);
+        }
+        name[name_length] = '\0';
+        somr_list_push(&class_list, name);
+        free(name);
+    }
+
+    somr_data_vector_t *data_vectors = malloc(sizeof(somr_data_vector_t) * size);
+    somr_data_vector_init_batch(data_vectors, size, features_count);
+    for (unsigned int i = 0; i < size; i++) {
+        int32_t label;
+        if (fread(&label, sizeof(int32_t), 1, file) != 1
+            || (label != SOMR_EMPTY_LABEL && (label < 0 || (uint32_t) label >= classes_count))) {
+            fprintf(stderr, "Error reading input data label\n");
+            exit(EXIT_FAILURE);
+        }
+        data_vectors[i].label = label;
+        if (fread(data_vectors[i].weights, sizeof(double), features_count, file) != features_count) {
+            fprintf(stderr, "Error reading input data feature\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     unsigned int *indices = malloc(sizeof(unsigned int) * size);
     for (unsigned int i = 0; i < size; i++) {
         indices[i] = i;
@@ -1,4 +1,5 @@
 #include "map.h"
+#include "map_render.h"
 #include "unit.h"
 #include "vector.h"
 #include <assert.h>
@@ -12,6 +13,9 @@
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
+/** relative margin by which unit distances of index are shrunk */
+#define SOMR_MAP_INDEX_MARGIN 1e-6
+
 void somr_map_init(somr_map_t *m, unsigned int features_count) {
     assert(features_count > 0);
 
@@ -19,31 +23,137 @@ void somr_map_init(somr_map_t *m, unsigned int features_count) {
     m->height = 2;
     m->units_count = m->width * m->height;
     m->features_count = features_count;
+    m->metric = SOMR_METRIC_EUCLID;
+    m->decoded_weights = NULL;
+    m->index = NULL;
+    m->is_indexed = false;
 
-    m->units = malloc(sizeof(somr_unit_t) * m->units_count);
+    m->units_capacity = m->units_count;
+    m->units = malloc(sizeof(somr_unit_t) * m->units_capacity);
     for (somr_unit_id_t i = 0; i < m->units_count; i++) {
         somr_unit_init(&m->units[i], m->features_count);
     }
 }
 
+void somr_map_init_from_binary_file(somr_map_t *m, FILE *file, unsigned int features_count) {
+    assert(features_count > 0);
+
+    uint32_t size[2];
+    if (fread(size, sizeof(uint32_t), 2, file) != 2 || size[0] < 2 || size[1] < 2 || (uint64_t) size[0] * size[1] > UINT32_MAX
+        || fread(&m->mean_error, sizeof(double), 1, file) != 1) {
+        fprintf(stderr, "Invalid binary map header\n");
+        exit(EXIT_FAILURE);
+    }
+    m->width = size[0];
+    m->height = size[1];
+    m->units_count = m->width * m->height;
+    m->features_count = features_count;
+    m->metric = SOMR_METRIC_EUCLID;
+    m->decoded_weights = NULL;
+    m->index = NULL;
+    m->is_indexed = false;
+    m->units_capacity = m->units_count;
+    m->units = malloc(sizeof(somr_unit_t) * m->units_capacity);
+
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        somr_unit_t *unit = &m->units[i];
+        somr_unit_init(unit, features_count);
+        int32_t label;
+        uint32_t label_count;
+        uint8_t has_child;
+        if (fread(unit->weights, sizeof(double), features_count, file) != features_count
+            || fread(&unit->error, sizeof(double), 1, file) != 1
+            || fread(&label, sizeof(int32_t), 1, file) != 1
+            || fread(&label_count, sizeof(uint32_t), 1, file) != 1
+            || fread(&has_child, sizeof(uint8_t), 1, file) != 1) {
+            fprintf(stderr, "Error reading map unit\n");
+            exit(EXIT_FAILURE);
+        }
+        unit->label = label;
+        unit->label_count = label_count;
+        somr_unit_update_norm(unit, features_count);
+        if (has_child) {
+            unit->child = malloc(sizeof(somr_map_t));
+            somr_map_init_from_binary_file(unit->child, file, features_count);
+        }
+    }
+}
+
+void somr_map_write(somr_map_t *m, FILE *file) {
+    uint32_t size[2] = { m->width, m->height };
+    fwrite(size, sizeof(uint32_t), 2, file);
+    fwrite(&m->mean_error, sizeof(double), 1, file);
+
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        somr_unit_t *unit = &m->units[i];
+        int32_t label = unit->label;
+        uint32_t label_count = unit->label_count;
+        uint8_t has_child = unit->child != NULL;
+        fwrite(unit->weights, sizeof(double), m->features_count, file);
+        fwrite(&unit->error, sizeof(double), 1, file);
+        fwrite(&label, sizeof(int32_t), 1, file);
+        fwrite(&label_count, sizeof(uint32_t), 1, file);
+        fwrite(&has_child, sizeof(uint8_t), 1, file);
+        if (has_child) {
+            somr_map_write(unit->child, file);
+        }
+    }
+}
+
 void somr_map_clear(somr_map_t *m) {
     for (somr_unit_id_t i = 0; i < m->units_count; i++) {
         somr_unit_clear(&m->units[i]);
     }
     free(m->units);
     m->units = NULL;
+    m->units_capacity = 0;
+    free(m->decoded_weights);
+    m->decoded_weights = NULL;
+    free(m->index);
+    m->index = NULL;
+    m->is_indexed = false;
+}
+
+void somr_map_set_metric(somr_map_t *m, somr_metric_t metric) {
+    m->metric = metric;
+    m->is_indexed = false;
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        if (m->units[i].child != NULL) {
+            somr_map_set_metric(m->units[i].child, metric);
+        }
+    }
 }
 
 void somr_map_init_random_weights(somr_map_t *m, unsigned int *rand_state) {
+    m->is_indexed = false;
     for (somr_unit_id_t i = 0; i < m->units_count; i++) {
         somr_unit_init_random_weights(&m->units[i], rand_state, m->features_count);
     }
 }
 
+void somr_map_update_norms(somr_map_t *m) {
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        somr_unit_update_norm(&m->units[i], m->features_count);
+    }
+}
+
+/** @return @p data_vector, or its dense copy @p decoded, decoded in buffer of map, if it is quantized */
+static somr_data_vector_t *somr_map_decode(somr_map_t *m, somr_data_vector_t *data_vector, somr_data_vector_t *decoded) {
+    if (!somr_data_vector_is_quantized(data_vector)) {
+        return data_vector;
+    }
+    if (m->decoded_weights == NULL) {
+        m->decoded_weights = malloc(sizeof(double) * m->features_count);
+    }
+    return somr_data_vector_decode(data_vector, m->features_count, decoded, m->decoded_weights);
+}
+
 void somr_map_activate(somr_map_t *m, somr_data_vector_t *data_vector) {
+    somr_data_vector_t decoded;
+    data_vector = somr_map_decode(m, data_vector, &decoded);
     // TODO parallelize?
     for (somr_unit_id_t i = 0; i < m->units_count; i++) {
-        somr_unit_activate(&m->units[i], data_vector, m->features_count);
+        somr_unit_activate(&m->units[i], data_vector, m->features_count, m->metric);
     }
 }
 
@@ -74,8 +184,63 @@ all best matching unit with same activation value */
 //     *bmu_count = count;
 // }
 
+/** @return true if unit at @p x, @p y is one of the units evaluated first by indexed searches */
+static bool somr_map_is_pivot(unsigned int x, unsigned int y, unsigned int step_x, unsigned int step_y) {
+    return x % step_x == step_x / 2 && y % step_y == step_y / 2;
+}
+
+/**
+indexed search (sort-means): with c the best of a grid of pivot units and b the best unit found so far,
+unit j cannot beat b if d(c, j) > d(x, c) + d(x, b), as d(x, j) >= d(c, j) - d(x, c),
+so units are visited by increasing distance from c until that bound is exceeded
+*/
+static somr_unit_id_t somr_map_find_bmu_indexed(somr_map_t *m, somr_data_vector_t *data_vector) {
+    somr_data_vector_t decoded;
+    data_vector = somr_map_decode(m, data_vector, &decoded);
+
+    // about sqrt(units count) pivots, spread over the map
+    unsigned int step_x = (unsigned int) ceil(sqrt(m->width));
+    unsigned int step_y = (unsigned int) ceil(sqrt(m->height));
+    somr_unit_id_t bmu_id = 0;
+    double lowest_activation = DBL_MAX;
+    for (unsigned int y = step_y / 2; y < m->height; y += step_y) {
+        for (unsigned int x = step_x / 2; x < m->width; x += step_x) {
+            somr_unit_id_t unit_id = y * m->width + x;
+            somr_unit_activate(&m->units[unit_id], data_vector, m->features_count, m->metric);
+            double activation = m->units[unit_id].activation;
+            if (activation < lowest_activation || (activation == lowest_activation && unit_id < bmu_id)) {
+                lowest_activation = activation;
+                bmu_id = unit_id;
+            }
+        }
+    }
+
+    somr_unit_id_t pivot_id = bmu_id;
+    double pivot_dist = sqrt(lowest_activation);
+    somr_unit_dist_t *row = &m->index[(size_t) pivot_id * (m->units_count - 1)];
+    for (unsigned int i = 0; i < m->units_count - 1; i++) {
+        if (row[i].dist > pivot_dist + sqrt(lowest_activation)) {
+            break;
+        }
+        somr_unit_id_t unit_id = row[i].unit_id;
+        if (somr_map_is_pivot(unit_id % m->width, unit_id / m->width, step_x, step_y)) {
+            continue;
+        }
+        somr_unit_activate(&m->units[unit_id], data_vector, m->features_count, m->metric);
+        double activation = m->units[unit_id].activation;
+        if (activation < lowest_activation || (activation == lowest_activation && unit_id < bmu_id)) {
+            lowest_activation = activation;
+            bmu_id = unit_id;
+        }
+    }
+    return bmu_id;
+}
+
 /** computes activation value for all units in map, and returns first bmu encountered */
 somr_unit_id_t somr_map_find_bmu(somr_map_t *m, somr_data_vector_t *data_vector) {
+    if (m->is_indexed) {
+        return somr_map_find_bmu_indexed(m, data_vector);
+    }
     somr_map_activate(m, data_vector);
 
     somr_unit_id_t bmu_id = 0;
@@ -93,7 +258,55 @@ somr_unit_id_t somr_map_find_bmu(somr_map_t *m, somr_data_vector_t *data_vector)
     return bmu_id;
 }
 
-void somr_map_teach_nbhd(somr_map_t *m, somr_unit_id_t unit_id, somr_data_vector_t *data_vector, double learn_rate, double radius) {
+static int somr_unit_dist_compare(const void *a, const void *b) {
+    const somr_unit_dist_t *da = a;
+    const somr_unit_dist_t *db = b;
+    if (da->dist != db->dist) {
+        return (da->dist > db->dist) - (da->dist < db->dist);
+    }
+    return (da->unit_id > db->unit_id) - (da->unit_id < db->unit_id);
+}
+
+void somr_map_build_index(somr_map_t *m) {
+    if (m->is_indexed || m->units_count < SOMR_MAP_INDEX_MIN_UNITS || m->units_count > SOMR_MAP_INDEX_MAX_UNITS) {
+        return;
+    }
+    somr_map_update_norms(m);
+    unsigned int row_size = m->units_count - 1;
+    m->index = realloc(m->index, sizeof(somr_unit_dist_t) * m->units_count * row_size);
+
+    // distances are computed once per pair, with the same kernels as searches (weights of unit j seen as an input vector)
+    for (somr_unit_id_t j = 1; j < m->units_count; j++) {
+        somr_unit_t *unit = &m->units[j];
+        somr_data_vector_t unit_vector = { unit->weights, NULL, NULL, 0, NULL, NULL, unit->norm_squared, SOMR_EMPTY_LABEL };
+        for (somr_unit_id_t i = 0; i < j; i++) {
+            somr_unit_activate(&m->units[i], &unit_vector, m->features_count, m->metric);
+            // margin covers rounding of float and of kernels (dot products are not exact)
+            float dist = (float) (sqrt(m->units[i].activation) * (1.0 - SOMR_MAP_INDEX_MARGIN));
+            m->index[(size_t) i * row_size + j - 1] = (somr_unit_dist_t) { dist, j };
+            m->index[(size_t) j * row_size + i] = (somr_unit_dist_t) { dist, i };
+        }
+    }
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        qsort(&m->index[(size_t) i * row_size], row_size, sizeof(somr_unit_dist_t), somr_unit_dist_compare);
+    }
+    m->is_indexed = true;
+}
+
+void somr_map_build_indexes(somr_map_t *m) {
+    somr_map_build_index(m);
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        if (m->units[i].child != NULL) {
+            somr_map_build_indexes(m->units[i].child);
+        }
+    }
+}
+
+unsigned int somr_map_teach_nbhd(somr_map_t *m, somr_unit_id_t unit_id, somr_data_vector_t *data_vector, double learn_rate, double radius) {
+    m->is_indexed = false;
+    somr_data_vector_t decoded;
+    data_vector = somr_map_decode(m, data_vector, &decoded);
+    unsigned int taught_count = 0;
     double unit_y = unit_id / m->width;
     double unit_x = unit_id % m->width;
 
@@ -112,9 +325,11 @@ void somr_map_teach_nbhd(somr_map_t *m, somr_unit_id_t unit_id, somr_data_vector
             if (nbhd_factor > 0.0) {
                 // teach unit
                 somr_unit_learn(&m->units[unit_id], data_vector, m->features_count, nbhd_factor);
+                taught_count++;
             }
         }
     }
+    return taught_count;
 }
 
 unsigned int somr_map_get_depth(somr_map_t *m) {
@@ -139,6 +354,24 @@ somr_label_t somr_map_classify(somr_map_t *m, somr_data_vector_t *data_vector) {
     return somr_map_classify(bmu->child, data_vector);
 }
 
+somr_label_t somr_map_classify_bounded(somr_map_t *m, somr_data_vector_t *data_vector, unsigned int max_depth,
+    unsigned long long max_dist_evals, unsigned int *depth, bool *is_leaf) {
+    unsigned long long dist_evals_count = 0;
+    *depth = 0;
+    while (true) {
+        somr_unit_id_t bmu_id = somr_map_find_bmu(m, data_vector);
+        dist_evals_count += m->units_count;
+        (*depth)++;
+        somr_unit_t *bmu = &m->units[bmu_id];
+        *is_leaf = bmu->child == NULL;
+        if (*is_leaf || (max_depth > 0 && *depth >= max_depth)
+            || (max_dist_evals > 0 && dist_evals_count + bmu->child->units_count > max_dist_evals)) {
+            return bmu->label;
+        }
+        m = bmu->child;
+    }
+}
+
 void somr_map_find_error_range(somr_map_t *m, double *min_error, double *max_error) {
     *max_error = -1.0;
     *min_error = DBL_MAX;
@@ -166,84 +399,16 @@ void somr_map_find_error_range(somr_map_t *m, double *min_error, double *max_err
 }
 
 void somr_map_write_to_img(somr_map_t *m, unsigned char *img, unsigned int img_width, unsigned int img_height, unsigned char *colors, unsigned int border) {
+    somr_map_write_region_to_img(m, img, img_width, img_height, 0, 0, img_width, img_height, colors, border);
+}
+
+void somr_map_write_region_to_img(somr_map_t *m, unsigned char *region, unsigned int img_width, unsigned int img_height,
+    unsigned int region_x, unsigned int region_y, unsigned int region_width, unsigned int region_height, unsigned char *colors, unsigned int border) {
     assert(img_height > 0 && img_width > 0);
-    assert(border < img_height && border < img_width);
-
-    unsigned char white[] = { 255, 255, 255 };
-
-    // compute unit dimensions
-    unsigned int unit_height = round(img_height / m->height);
-    unsigned int unit_width = floor(img_width / m->width);
-    assert(unit_height > 0 && unit_height <= img_height);
-    assert(unit_width > 0 && unit_width <= img_width);
-
-    // fill with black (border color)
-    memset(img, 0, 3 * img_width * img_height);
-
-    for (unsigned int map_y = 0; map_y < m->height; map_y++) {
-        for (unsigned int map_x = 0; map_x < m->width; map_x++) {
-            somr_unit_id_t unit_id = map_y * m->width + map_x;
-            somr_unit_t *unit = &m->units[unit_id];
-
-            unsigned int img_y_begin = map_y * unit_height;
-            unsigned int img_x_begin = map_x * unit_width;
-            assert(img_y_begin < img_height);
-            assert(img_x_begin < img_width);
-
-            unsigned int img_y_end = img_y_begin + unit_height;
-            unsigned int img_x_end = img_x_begin + unit_width;
-            // if unit is a left or bottom border, make sure it fills all pixels left
-            if (map_y == m->height - 1) {
-                img_y_end = img_height;
-            }
-            if (map_x == m->width - 1) {
-                img_x_end = img_width;
-            }
-            assert(img_y_end > 0 && img_y_end <= img_height);
-            assert(img_x_end > 0 && img_x_end <= img_width);
-
-            // if unit has child, compute sub image for child map and copy it into parent image
-            if (unit->child != NULL) {
-                unsigned char *unit_img = malloc(sizeof(unsigned char) * 3 * unit_width * unit_height);
-                assert(border >= 2);
-                somr_map_write_to_img(unit->child, unit_img, unit_width, unit_height, colors, border - 2);
-
-                for (unsigned int unit_img_y = border; unit_img_y < unit_height - border; unit_img_y++) {
-                    for (unsigned int unit_img_x = border; unit_img_x < unit_width - border; unit_img_x++) {
-                        unsigned int pixel_src = unit_img_y * unit_width + unit_img_x;
-                        assert(pixel_src < unit_width * unit_height);
-
-                        unsigned int img_y = img_y_begin + unit_img_y;
-                        unsigned int img_x = img_x_begin + unit_img_x;
-                        unsigned int pixel_dest = img_y * img_width + img_x;
-                        assert(pixel_dest < img_width * img_height);
-
-                        memcpy(&img[pixel_dest * 3], &unit_img[pixel_src * 3], sizeof(unsigned char) * 3);
-                    }
-                }
-
-                free(unit_img);
-            } else {
-                unsigned char *color;
-                // white color if unit a no label
-                if (unit->label == SOMR_EMPTY_LABEL) {
-                    color = white;
-                } else {
-                    color = &colors[unit->label * 3];
-                }
-
-                for (unsigned int img_y = img_y_begin + border; img_y < img_y_end - border; img_y++) {
-                    assert(img_y < img_height);
-                    if (img_y >= img_height) {
-                        continue;
-                    }
-                    for (unsigned int img_x = img_x_begin + border; img_x < img_x_end - border; img_x++) {
-                        unsigned int pixel_dest = img_y * img_width + img_x;
-                        assert(pixel_dest < img_width * img_height);
-                        memcpy(&img[pixel_dest * 3], color, sizeof(unsigned char) * 3);
-                    }
-                }
-            }
-        }
-    }
+    assert(region_width > 0 && region_height > 0);
+    assert(region_x + region_width <= img_width && region_y + region_height <= img_height);
+
+    somr_canvas_t canvas = { region, (size_t) region_width * 3, region_x, region_y, region_width, region_height };
+    somr_rect_t viewport = { 0, 0, img_width, img_height };
+    somr_map_render(m, &canvas, viewport, colors, border, 0);
 }
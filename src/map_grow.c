@@ -23,26 +23,41 @@ static void somr_map_init_up_right_weights(somr_map_t *m, somr_unit_t *parent, s
 static void somr_map_init_down_left_weights(somr_map_t *m, somr_unit_t *parent, somr_unit_t **parent_nbs);
 static void somr_map_init_down_right_weights(somr_map_t *m, somr_unit_t *parent, somr_unit_t **parent_nbs);
 
+/**
+makes room for @p units_count units in @p m, doubling its capacity if needed
+(unit structures may move, but not their weights that are allocated separately)
+*/
+static void somr_map_reserve(somr_map_t *m, unsigned int units_count) {
+    if (units_count <= m->units_capacity) {
+        return;
+    }
+    unsigned int capacity = m->units_capacity * 2;
+    if (capacity < units_count) {
+        capacity = units_count;
+    }
+    m->units = realloc(m->units, sizeof(somr_unit_t) * capacity);
+    m->units_capacity = capacity;
+}
+
 void somr_map_insert_row(somr_map_t *m, unsigned int row_before) {
     assert(row_before + 1 < m->height);
 
     unsigned int new_units_count = m->units_count + m->width;
-    somr_unit_t *new_units = malloc(sizeof(somr_unit_t) * new_units_count);
+    somr_map_reserve(m, new_units_count);
     unsigned int units_count_before = (row_before + 1) * m->width;
     unsigned int units_count_after = m->units_count - units_count_before;
 
-    memcpy(&new_units[0], &m->units[0], sizeof(somr_unit_t) * units_count_before);
+    // only rows after inserted one are shifted
     somr_unit_id_t src_unit_id = units_count_before;
     somr_unit_id_t dest_unit_id = units_count_before + m->width;
 
     assert(src_unit_id < m->units_count);
     assert(dest_unit_id < new_units_count);
-    memcpy(&new_units[dest_unit_id], &m->units[src_unit_id], sizeof(somr_unit_t) * units_count_after);
+    memmove(&m->units[dest_unit_id], &m->units[src_unit_id], sizeof(somr_unit_t) * units_count_after);
 
-    free(m->units);
-    m->units = new_units;
     m->units_count = new_units_count;
     m->height += 1;
+    m->is_indexed = false;
 
     // init units in inserted row with meam weights
     for (somr_unit_id_t i = src_unit_id; i < dest_unit_id; i++) {
@@ -61,28 +76,25 @@ void somr_map_insert_col(somr_map_t *m, unsigned int col_before) {
     assert(col_before + 1 < m->width);
 
     unsigned int new_units_count = m->units_count + m->height;
-    somr_unit_t *new_units = malloc(sizeof(somr_unit_t) * new_units_count);
+    somr_map_reserve(m, new_units_count);
     unsigned int cols_count_before = col_before + 1;
     unsigned int cols_count_after = m->width - cols_count_before;
 
-    somr_unit_id_t src_unit_id = 0;
-    somr_unit_id_t dest_unit_id = 0;
-    while (src_unit_id < m->units_count) {
-        memcpy(&new_units[dest_unit_id], &m->units[src_unit_id], sizeof(somr_unit_t) * cols_count_before);
-        src_unit_id += cols_count_before;
-        dest_unit_id += cols_count_before + 1;
-
-        memcpy(&new_units[dest_unit_id], &m->units[src_unit_id], sizeof(somr_unit_t) * cols_count_after);
-        src_unit_id += cols_count_after;
-        dest_unit_id += cols_count_after;
+    // shift rows in place, starting from last one so that units are moved before being overwritten
+    // (units of row y before inserted column move by y, units after it by y + 1)
+    for (unsigned int y = m->height; y-- > 0;) {
+        somr_unit_id_t src_unit_id = y * m->width;
+        somr_unit_id_t dest_unit_id = y * (m->width + 1);
+        memmove(&m->units[dest_unit_id + cols_count_before + 1], &m->units[src_unit_id + cols_count_before],
+            sizeof(somr_unit_t) * cols_count_after);
+        if (y > 0) {
+            memmove(&m->units[dest_unit_id], &m->units[src_unit_id], sizeof(somr_unit_t) * cols_count_before);
+        }
     }
-    assert(src_unit_id == m->units_count);
-    assert(dest_unit_id == new_units_count);
 
-    free(m->units);
-    m->units = new_units;
     m->units_count = new_units_count;
     m->width += 1;
+    m->is_indexed = false;
 
     // init units in inserted column with mean weights
     for (somr_unit_id_t i = col_before + 1; i < m->units_count; i += m->width) {
@@ -100,6 +112,7 @@ void somr_map_insert_col(somr_map_t *m, unsigned int col_before) {
 void somr_map_add_child(somr_map_t *m, somr_unit_id_t unit_id, bool should_orient, unsigned int *rand_state) {
     somr_unit_t *unit = &m->units[unit_id];
     somr_unit_add_child(unit, m->features_count);
+    unit->child->metric = m->metric;
 
     if (should_orient) {
         somr_map_orient_child(m, unit_id);
@@ -0,0 +1,301 @@
+#define _GNU_SOURCE // for sysconf
+#include "map_render.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+/** below this number of visible pixels, rendering is not worth spawning threads */
+#define SOMR_RENDER_PARALLEL_MIN_PIXELS (1024 * 1024)
+/** number of tasks to generate per thread before dispatching work, for load balancing */
+#define SOMR_RENDER_TASKS_PER_THREAD 8
+
+static unsigned char SOMR_RENDER_BLACK[] = { 0, 0, 0 };
+static unsigned char SOMR_RENDER_WHITE[] = { 255, 255, 255 };
+
+/** either a subtree to render (map != NULL) or a plain rectangle to fill with color */
+typedef struct somr_render_task_t {
+    somr_map_t *map;
+    somr_rect_t viewport;
+    /** part of viewport that may be drawn to */
+    somr_rect_t clip;
+    unsigned int border;
+    unsigned char *color;
+} somr_render_task_t;
+
+typedef struct somr_render_task_list_t {
+    somr_render_task_t *tasks;
+    unsigned int size;
+    unsigned int capacity;
+} somr_render_task_list_t;
+
+typedef struct somr_render_worker_ctx_t {
+    somr_render_task_list_t *list;
+    somr_canvas_t *canvas;
+    unsigned char *colors;
+    atomic_uint next_task;
+} somr_render_worker_ctx_t;
+
+static void somr_render_map_cells(somr_render_task_t *task, somr_canvas_t *canvas, unsigned char *colors, somr_render_task_list_t *deferred);
+
+static bool somr_rect_is_empty(somr_rect_t r) {
+    return r.x_begin >= r.x_end || r.y_begin >= r.y_end;
+}
+
+static somr_rect_t somr_rect_intersect(somr_rect_t a, somr_rect_t b) {
+    somr_rect_t r = {
+        MAX(a.x_begin, b.x_begin),
+        MAX(a.y_begin, b.y_begin),
+        MIN(a.x_end, b.x_end),
+        MIN(a.y_end, b.y_end),
+    };
+    return r;
+}
+
+static void somr_render_fill_rect(somr_canvas_t *canvas, somr_rect_t r, unsigned char *color) {
+    if (somr_rect_is_empty(r)) {
+        return;
+    }
+    assert(r.x_begin >= canvas->x && r.x_end <= canvas->x + canvas->width);
+    assert(r.y_begin >= canvas->y && r.y_end <= canvas->y + canvas->height);
+
+    size_t row_length = (size_t) (r.x_end - r.x_begin) * 3;
+    unsigned char *first_row = canvas->pixels + (size_t) (r.y_begin - canvas->y) * canvas->stride + (size_t) (r.x_begin - canvas->x) * 3;
+
+    // fill first row pixel per pixel (or at once for grey colors) then duplicate it on following rows
+    if (color[0] == color[1] && color[1] == color[2]) {
+        memset(first_row, color[0], row_length);
+    } else {
+        for (size_t i = 0; i < row_length; i += 3) {
+            first_row[i] = color[0];
+            first_row[i + 1] = color[1];
+            first_row[i + 2] = color[2];
+        }
+    }
+    unsigned char *row = first_row;
+    for (unsigned int y = r.y_begin + 1; y < r.y_end; y++) {
+        row += canvas->stride;
+        memcpy(row, first_row, row_length);
+    }
+}
+
+/** fills with @p color all pixels of @p outer that are not in @p inner
+@pre @p inner must be contained in @p outer or empty */
+static void somr_render_fill_ring(somr_canvas_t *canvas, somr_rect_t outer, somr_rect_t inner, unsigned char *color) {
+    if (somr_rect_is_empty(inner)) {
+        somr_render_fill_rect(canvas, outer, color);
+        return;
+    }
+
+    somr_rect_t top = { outer.x_begin, outer.y_begin, outer.x_end, inner.y_begin };
+    somr_rect_t bottom = { outer.x_begin, inner.y_end, outer.x_end, outer.y_end };
+    somr_rect_t left = { outer.x_begin, inner.y_begin, inner.x_begin, inner.y_end };
+    somr_rect_t right = { inner.x_end, inner.y_begin, outer.x_end, inner.y_end };
+    somr_render_fill_rect(canvas, top, color);
+    somr_render_fill_rect(canvas, bottom, color);
+    somr_render_fill_rect(canvas, left, color);
+    somr_render_fill_rect(canvas, right, color);
+}
+
+static void somr_render_task_list_push(somr_render_task_list_t *l, somr_render_task_t *task) {
+    if (l->size == l->capacity) {
+        l->capacity = (l->capacity == 0) ? 16 : l->capacity * 2;
+        l->tasks = realloc(l->tasks, sizeof(somr_render_task_t) * l->capacity);
+    }
+    l->tasks[l->size] = *task;
+    l->size++;
+}
+
+static void somr_render_run_task(somr_render_task_t *task, somr_canvas_t *canvas, unsigned char *colors) {
+    if (task->map != NULL) {
+        somr_render_map_cells(task, canvas, colors, NULL);
+    } else {
+        somr_render_fill_rect(canvas, task->clip, task->color);
+    }
+}
+
+/** position of the first pixel of cell @p index when splitting @p length pixels in @p count cells
+of @p cell_length pixels (the last cell is stretched to fill pixels left) */
+static unsigned int somr_render_cell_begin(unsigned int begin, unsigned int length, unsigned int count, unsigned int cell_length, unsigned int index) {
+    if (index == count) {
+        return begin + length;
+    }
+    if (cell_length > 0) {
+        return begin + index * cell_length;
+    }
+    // more cells than pixels, spread cells proportionally (some will be empty)
+    return begin + (unsigned int) ((uint64_t) index * length / count);
+}
+
+/**
+draws all units of task map straight into their region of @p canvas,
+recursing into child maps (or pushing them to @p deferred if not NULL)
+*/
+static void somr_render_map_cells(somr_render_task_t *task, somr_canvas_t *canvas, unsigned char *colors, somr_render_task_list_t *deferred) {
+    somr_map_t *m = task->map;
+    somr_rect_t viewport = task->viewport;
+    unsigned int border = task->border;
+
+    unsigned int viewport_width = viewport.x_end - viewport.x_begin;
+    unsigned int viewport_height = viewport.y_end - viewport.y_begin;
+    unsigned int unit_width = viewport_width / m->width;
+    unsigned int unit_height = viewport_height / m->height;
+
+    for (unsigned int map_y = 0; map_y < m->height; map_y++) {
+        unsigned int y_begin = somr_render_cell_begin(viewport.y_begin, viewport_height, m->height, unit_height, map_y);
+        unsigned int y_end = somr_render_cell_begin(viewport.y_begin, viewport_height, m->height, unit_height, map_y + 1);
+        // skip whole rows of units outside of clip region
+        if (y_end <= task->clip.y_begin || y_begin >= task->clip.y_end) {
+            continue;
+        }
+
+        for (unsigned int map_x = 0; map_x < m->width; map_x++) {
+            unsigned int x_begin = somr_render_cell_begin(viewport.x_begin, viewport_width, m->width, unit_width, map_x);
+            unsigned int x_end = somr_render_cell_begin(viewport.x_begin, viewport_width, m->width, unit_width, map_x + 1);
+
+            somr_rect_t cell = { x_begin, y_begin, x_end, y_end };
+            somr_rect_t visible = somr_rect_intersect(cell, task->clip);
+            if (somr_rect_is_empty(visible)) {
+                continue;
+            }
+
+            somr_unit_t *unit = &m->units[map_y * m->width + map_x];
+
+            // child map is laid out on a regular cell (even if last one is stretched)
+            // and only drawn if it has room for at least one pixel per unit,
+            // otherwise the unit is clamped and drawn as a leaf
+            if (unit->child != NULL && border >= 2 && unit_width > 2 * border && unit_height > 2 * border) {
+                somr_rect_t child_viewport = { x_begin, y_begin, x_begin + unit_width, y_begin + unit_height };
+                somr_rect_t inner = { x_begin + border, y_begin + border, child_viewport.x_end - border, child_viewport.y_end - border };
+                if (inner.x_end - inner.x_begin >= unit->child->width && inner.y_end - inner.y_begin >= unit->child->height) {
+                    somr_rect_t child_clip = somr_rect_intersect(inner, task->clip);
+                    somr_render_fill_ring(canvas, visible, child_clip, SOMR_RENDER_BLACK);
+                    if (somr_rect_is_empty(child_clip)) {
+                        continue;
+                    }
+
+                    somr_render_task_t child_task = { unit->child, child_viewport, child_clip, border - 2, NULL };
+                    if (deferred != NULL) {
+                        somr_render_task_list_push(deferred, &child_task);
+                    } else {
+                        somr_render_map_cells(&child_task, canvas, colors, NULL);
+                    }
+                    continue;
+                }
+            }
+
+            // white color if unit has no label
+            unsigned char *color = SOMR_RENDER_WHITE;
+            if (unit->label != SOMR_EMPTY_LABEL) {
+                color = &colors[unit->label * 3];
+            }
+
+            somr_rect_t inner = { 0, 0, 0, 0 };
+            if (x_end - x_begin > 2 * border && y_end - y_begin > 2 * border) {
+                somr_rect_t unit_inner = { x_begin + border, y_begin + border, x_end - border, y_end - border };
+                inner = somr_rect_intersect(unit_inner, task->clip);
+            }
+            somr_render_fill_ring(canvas, visible, inner, SOMR_RENDER_BLACK);
+            if (somr_rect_is_empty(inner)) {
+                continue;
+            }
+
+            if (deferred != NULL) {
+                somr_render_task_t fill_task = { NULL, cell, inner, 0, color };
+                somr_render_task_list_push(deferred, &fill_task);
+            } else {
+                somr_render_fill_rect(canvas, inner, color);
+            }
+        }
+    }
+}
+
+static void *somr_render_worker(void *arg) {
+    somr_render_worker_ctx_t *ctx = arg;
+    while (true) {
+        unsigned int index = atomic_fetch_add(&ctx->next_task, 1);
+        if (index >= ctx->list->size) {
+            break;
+        }
+        somr_render_run_task(&ctx->list->tasks[index], ctx->canvas, ctx->colors);
+    }
+    return NULL;
+}
+
+void somr_map_render(somr_map_t *m, somr_canvas_t *canvas, somr_rect_t viewport, unsigned char *colors, unsigned int border, unsigned int threads_count) {
+    somr_rect_t canvas_rect = { canvas->x, canvas->y, canvas->x + canvas->width, canvas->y + canvas->height };
+    somr_rect_t clip = somr_rect_intersect(viewport, canvas_rect);
+    if (somr_rect_is_empty(clip)) {
+        return;
+    }
+    somr_render_task_t root_task = { m, viewport, clip, border, NULL };
+
+    if (threads_count == 0) {
+        long cpus_count = sysconf(_SC_NPROCESSORS_ONLN);
+        threads_count = (cpus_count > 0) ? (unsigned int) cpus_count : 1;
+    }
+    uint64_t pixels_count = (uint64_t) (clip.x_end - clip.x_begin) * (clip.y_end - clip.y_begin);
+    if (threads_count == 1 || pixels_count < SOMR_RENDER_PARALLEL_MIN_PIXELS) {
+        somr_render_map_cells(&root_task, canvas, colors, NULL);
+        return;
+    }
+
+    // expand the tree breadth-first until we have enough independent subtrees and fills
+    // to keep all threads busy (borders of expanded maps are drawn on the way)
+    somr_render_task_list_t list = { NULL, 0, 0 };
+    somr_render_task_list_push(&list, &root_task);
+    unsigned int min_tasks_count = threads_count * SOMR_RENDER_TASKS_PER_THREAD;
+    bool has_map_tasks = true;
+    while (list.size < min_tasks_count && has_map_tasks) {
+        somr_render_task_list_t next_list = { NULL, 0, 0 };
+        for (unsigned int i = 0; i < list.size; i++) {
+            somr_render_task_t *task = &list.tasks[i];
+            if (task->map != NULL) {
+                somr_render_map_cells(task, canvas, colors, &next_list);
+            } else {
+                somr_render_task_list_push(&next_list, task);
+            }
+        }
+        free(list.tasks);
+        list = next_list;
+
+        has_map_tasks = false;
+        for (unsigned int i = 0; i < list.size; i++) {
+            if (list.tasks[i].map != NULL) {
+                has_map_tasks = true;
+                break;
+            }
+        }
+    }
+
+    somr_render_worker_ctx_t ctx;
+    ctx.list = &list;
+    ctx.canvas = canvas;
+    ctx.colors = colors;
+    atomic_init(&ctx.next_task, 0);
+
+    // calling thread is one of the workers
+    unsigned int workers_count = MIN(threads_count, list.size);
+    pthread_t *threads = malloc(sizeof(pthread_t) * workers_count);
+    unsigned int started_count = 0;
+    for (unsigned int i = 1; i < workers_count; i++) {
+        if (pthread_create(&threads[started_count], NULL, somr_render_worker, &ctx) != 0) {
+            break;
+        }
+        started_count++;
+    }
+    somr_render_worker(&ctx);
+    for (unsigned int i = 0; i < started_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    free(list.tasks);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "map.h"
+#include <stddef.h>
+
+/** RGB pixel buffer covering a rectangular region of a (possibly much larger) virtual image */
+typedef struct somr_canvas_t {
+    unsigned char *pixels;
+    /** number of bytes between two consecutive rows of @p pixels */
+    size_t stride;
+    /** position of first pixel of buffer in virtual image */
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+} somr_canvas_t;
+
+/** pixel rectangle in virtual image coordinates, end bounds excluded */
+typedef struct somr_rect_t {
+    unsigned int x_begin;
+    unsigned int y_begin;
+    unsigned int x_end;
+    unsigned int y_end;
+} somr_rect_t;
+
+/**
+renders map @p m, laid out on @p viewport of the virtual image, into the part of @p canvas inside @p viewport
+@p border: width of border drawn around units at top level, decreased by 2 at each level
+@p threads_count: max number of threads to use, 0 to pick it automatically
+*/
+void somr_map_render(somr_map_t *m, somr_canvas_t *canvas, somr_rect_t viewport, unsigned char *colors, unsigned int border, unsigned int threads_count);
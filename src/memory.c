@@ -0,0 +1,93 @@
+#include "memory.h"
+#include <assert.h>
+
+static char *SOMR_MEMORY_CATEGORY_NAMES[] = { "weights", "units", "indexes", "dataset", "scratch" };
+
+void somr_memory_init(somr_memory_t *m, size_t budget) {
+    for (unsigned int i = 0; i < SOMR_MEMORY_CATEGORIES_COUNT; i++) {
+        m->bytes[i] = 0;
+    }
+    m->total = 0;
+    m->peak = 0;
+    m->budget = budget;
+    m->refused_spreads_count = 0;
+    m->refused_children_count = 0;
+}
+
+void somr_memory_add(somr_memory_t *m, somr_memory_category_t category, size_t bytes) {
+    m->bytes[category] += bytes;
+    m->total += bytes;
+    if (m->total > m->peak) {
+        m->peak = m->total;
+    }
+}
+
+void somr_memory_remove(somr_memory_t *m, somr_memory_category_t category, size_t bytes) {
+    assert(bytes <= m->bytes[category]);
+    m->bytes[category] -= bytes;
+    m->total -= bytes;
+}
+
+bool somr_memory_fits(somr_memory_t *m, size_t bytes) {
+    return m->budget == 0 || m->total + bytes <= m->budget;
+}
+
+void somr_memory_measure_map(somr_map_t *m, size_t *bytes, bool is_recursive) {
+    bytes[SOMR_MEMORY_WEIGHTS] += sizeof(double) * m->units_count * m->features_count;
+    bytes[SOMR_MEMORY_UNITS] += sizeof(somr_map_t) + sizeof(somr_unit_t) * m->units_capacity;
+    if (m->decoded_weights != NULL) {
+        bytes[SOMR_MEMORY_UNITS] += sizeof(double) * m->features_count;
+    }
+    if (m->index != NULL) {
+        bytes[SOMR_MEMORY_INDEXES] += sizeof(somr_unit_dist_t) * m->units_count * (m->units_count - 1);
+    }
+    if (!is_recursive) {
+        return;
+    }
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        if (m->units[i].child != NULL) {
+            somr_memory_measure_map(m->units[i].child, bytes, true);
+        }
+    }
+}
+
+size_t somr_memory_measure_dataset(somr_dataset_t *d) {
+    size_t bytes = d->owns_indices ? sizeof(unsigned int) * d->size : 0;
+    if (d->has_parent) {
+        return bytes;
+    }
+
+    bytes += sizeof(somr_data_vector_t) * d->size;
+    if (d->is_sparse) {
+        for (unsigned int i = 0; i < d->size; i++) {
+            bytes += (sizeof(unsigned int) + sizeof(double)) * d->data_vectors[i].nnz_count;
+        }
+    } else if (d->quantizer != NULL) {
+        bytes += somr_quantizer_get_code_size(d->quantizer) * d->size * d->features_count;
+        bytes += 2 * sizeof(double) * d->features_count;
+    } else {
+        bytes += sizeof(double) * d->size * d->features_count;
+    }
+    if (d->mean != NULL) {
+        bytes += sizeof(double) * d->features_count;
+    }
+    return bytes;
+}
+
+size_t somr_memory_measure_child_map(unsigned int features_count) {
+    return sizeof(somr_map_t) + 4 * (sizeof(somr_unit_t) + sizeof(double) * features_count);
+}
+
+char *somr_memory_get_category_name(somr_memory_category_t category) {
+    assert(category < SOMR_MEMORY_CATEGORIES_COUNT);
+    return SOMR_MEMORY_CATEGORY_NAMES[category];
+}
+
+void somr_memory_write_json(somr_memory_t *m, FILE *file) {
+    fprintf(file, "{\n");
+    for (unsigned int i = 0; i < SOMR_MEMORY_CATEGORIES_COUNT; i++) {
+        fprintf(file, "  \"%s\": %zu,\n", SOMR_MEMORY_CATEGORY_NAMES[i], m->bytes[i]);
+    }
+    fprintf(file, "  \"total\": %zu,\n  \"peak\": %zu,\n  \"budget\": %zu,\n", m->total, m->peak, m->budget);
+    fprintf(file, "  \"refused_spreads\": %u,\n  \"refused_children\": %u\n}\n", m->refused_spreads_count, m->refused_children_count);
+}
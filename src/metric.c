@@ -0,0 +1,20 @@
+#include "metric.h"
+#include <assert.h>
+#include <string.h>
+
+static char *SOMR_METRIC_NAMES[] = { "euclid", "cosine", "manhattan" };
+
+char *somr_metric_get_name(somr_metric_t metric) {
+    assert(metric < SOMR_METRICS_COUNT);
+    return SOMR_METRIC_NAMES[metric];
+}
+
+bool somr_metric_find(char *name, somr_metric_t *metric) {
+    for (unsigned int i = 0; i < SOMR_METRICS_COUNT; i++) {
+        if (strcmp(name, SOMR_METRIC_NAMES[i]) == 0) {
+            *metric = i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -3,62 +3,337 @@
 #include "trainer.h"
 #include "vector.h"
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-static void somr_network_compute_root_error(somr_network_t *n, somr_dataset_t *dataset);
+static void somr_network_compute_root_error(somr_network_t *n, somr_dataset_t *dataset, somr_metric_t metric);
+static somr_dataset_t *somr_network_project_dataset(somr_network_t *n, somr_dataset_t *dataset);
+static void somr_network_clear_projected_dataset(somr_network_t *n, somr_dataset_t *dataset);
+static void somr_network_measure(somr_network_t *n, somr_memory_t *memory);
+static void somr_network_start_accounting(somr_network_t *n, somr_dataset_t *input_dataset, somr_dataset_t *dataset, somr_trainer_settings_t *settings);
 
 void somr_network_init(somr_network_t *n, unsigned int features_count) {
     somr_unit_init(&n->root, features_count);
     somr_list_init(&n->class_list, true);
+    n->projection = NULL;
+    somr_stats_init(&n->stats);
+    somr_memory_init(&n->memory, 0);
+}
+
+void somr_network_set_projection(somr_network_t *n, somr_projection_t *p) {
+    if (n->projection != NULL) {
+        somr_projection_clear(n->projection);
+        free(n->projection);
+    }
+    n->projection = p;
 }
 
 void somr_network_clear(somr_network_t *n) {
     somr_list_clear(&n->class_list);
     somr_unit_clear(&n->root);
+    somr_stats_clear(&n->stats);
+    somr_network_set_projection(n, NULL);
+}
+
+void somr_network_init_from_binary_file(somr_network_t *n, FILE *file) {
+    char magic[SOMR_NETWORK_MAGIC_LENGTH];
+    uint32_t features_count;
+    uint32_t classes_count;
+    if (fread(magic, 1, SOMR_NETWORK_MAGIC_LENGTH, file) != SOMR_NETWORK_MAGIC_LENGTH
+        || memcmp(magic, SOMR_NETWORK_MAGIC, SOMR_NETWORK_MAGIC_LENGTH) != 0
+        || fread(&features_count, sizeof(uint32_t), 1, file) != 1
+        || fread(&classes_count, sizeof(uint32_t), 1, file) != 1
+        || features_count == 0) {
+        fprintf(stderr, "Invalid binary network header\n");
+        exit(EXIT_FAILURE);
+    }
+
+    somr_network_init(n, features_count);
+    for (uint32_t i = 0; i < classes_count; i++) {
+        uint32_t name_length;
+        if (fread(&name_length, sizeof(uint32_t), 1, file) != 1) {
+            fprintf(stderr, "Error reading network class\n");
+            exit(EXIT_FAILURE);
+        }
+        char *name = malloc(sizeof(char) * (name_length + 1));
+        if (fread(name, 1, name_length, file) != name_length) {
+            fprintf(stderr, "Error reading network class\n");
+            exit(EXIT_FAILURE);
+        }
+        name[name_length] = '\0';
+        somr_list_push(&n->class_list, name);
+        free(name);
+    }
+
+    uint8_t has_projection;
+    if (fread(&has_projection, sizeof(uint8_t), 1, file) != 1) {
+        fprintf(stderr, "Error reading network projection\n");
+        exit(EXIT_FAILURE);
+    }
+    if (has_projection) {
+        n->projection = malloc(sizeof(somr_projection_t));
+        somr_projection_init_from_binary_file(n->projection, file);
+        if (n->projection->output_count != features_count) {
+            fprintf(stderr, "Invalid network projection\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    uint32_t metric;
+    if (fread(&metric, sizeof(uint32_t), 1, file) != 1 || metric >= SOMR_METRICS_COUNT) {
+        fprintf(stderr, "Invalid network metric\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (fread(n->root.weights, sizeof(double), features_count, file) != features_count
+        || fread(&n->root.error, sizeof(double), 1, file) != 1) {
+        fprintf(stderr, "Error reading network root unit\n");
+        exit(EXIT_FAILURE);
+    }
+    somr_unit_update_norm(&n->root, features_count);
+    n->root.child = malloc(sizeof(somr_map_t));
+    somr_map_init_from_binary_file(n->root.child, file, features_count);
+    somr_map_set_metric(n->root.child, metric);
+    // so that classification of loaded networks skips most units
+    somr_map_build_indexes(n->root.child);
+}
+
+void somr_network_write(somr_network_t *n, FILE *file) {
+    assert(n->root.child != NULL);
+    uint32_t features_count = n->root.child->features_count;
+    uint32_t classes_count = n->class_list.size;
+    fwrite(SOMR_NETWORK_MAGIC, 1, SOMR_NETWORK_MAGIC_LENGTH, file);
+    fwrite(&features_count, sizeof(uint32_t), 1, file);
+    fwrite(&classes_count, sizeof(uint32_t), 1, file);
+    for (unsigned int i = 0; i < n->class_list.size; i++) {
+        char *name = somr_list_get(&n->class_list, i);
+        uint32_t name_length = strlen(name);
+        fwrite(&name_length, sizeof(uint32_t), 1, file);
+        fwrite(name, 1, name_length, file);
+    }
+    uint8_t has_projection = n->projection != NULL;
+    fwrite(&has_projection, sizeof(uint8_t), 1, file);
+    if (has_projection) {
+        somr_projection_write(n->projection, file);
+    }
+    uint32_t metric = n->root.child->metric;
+    fwrite(&metric, sizeof(uint32_t), 1, file);
+
+    fwrite(n->root.weights, sizeof(double), features_count, file);
+    fwrite(&n->root.error, sizeof(double), 1, file);
+    somr_map_write(n->root.child, file);
 }
 
 void somr_network_train(somr_network_t *n, somr_dataset_t *dataset,
     double learn_rate, double spread_threshold, double depth_threshold, unsigned int iters_count, bool should_orient, unsigned int seed) {
+    somr_trainer_settings_t settings;
+    somr_trainer_settings_init(&settings, learn_rate, spread_threshold, depth_threshold, iters_count, should_orient, seed);
+    somr_network_train_with_settings(n, dataset, &settings);
+}
 
+void somr_network_train_with_settings(somr_network_t *n, somr_dataset_t *input_dataset, somr_trainer_settings_t *user_settings) {
+    somr_dataset_t *dataset = somr_network_project_dataset(n, input_dataset);
     somr_list_clear(&n->class_list);
     somr_list_copy(&n->class_list, dataset->class_list);
 
     // assign data set mean to root unit
     somr_dataset_compute_mean_weights(dataset, n->root.weights);
+    somr_unit_update_norm(&n->root, dataset->features_count);
 
     // compute error
-    somr_network_compute_root_error(n, dataset);
-
-    // init and run trainer with settings
-    somr_trainer_settings_t settings = {
-        learn_rate,
-        spread_threshold,
-        depth_threshold,
-        iters_count,
-        should_orient,
-        seed
-    };
+    somr_network_compute_root_error(n, dataset, user_settings->metric);
+
+    // init and run trainer with settings (copied as random state is updated during training)
+    somr_trainer_settings_t settings = *user_settings;
+    settings.stats = &n->stats;
+    if (settings.checkpoint != NULL) {
+        settings.checkpoint->network = n;
+        settings.checkpoint->epochs_count = 0;
+    }
 
     somr_unit_add_child(&n->root, dataset->features_count);
+    somr_map_set_metric(n->root.child, settings.metric);
     somr_map_init_random_weights(n->root.child, &settings.rand_state);
+    somr_network_start_accounting(n, input_dataset, dataset, &settings);
+
+    somr_trainer_t trainer;
+    somr_trainer_init(&trainer, n->root.child, dataset, n->root.error, n->root.error, &settings);
+    somr_stats_reset(&n->stats);
+    trainer.stats_index = somr_stats_add_map(&n->stats, -1, 0, dataset->size);
+    if (settings.is_best_first) {
+        somr_trainer_train_best_first(&trainer);
+    } else {
+        somr_trainer_train(&trainer);
+    }
+    somr_stats_compute_total(&n->stats);
+    somr_network_clear_projected_dataset(n, dataset);
+}
+
+void somr_network_resume(somr_network_t *n, somr_dataset_t *input_dataset, somr_trainer_settings_t *user_settings, FILE *checkpoint_file) {
+    somr_trainer_settings_t settings = *user_settings;
+    somr_checkpoint_t resume;
+    somr_checkpoint_init(&resume, NULL, 0);
+    somr_checkpoint_read(&resume, n, &settings.rand_state, checkpoint_file);
+    somr_dataset_t *dataset = somr_network_project_dataset(n, input_dataset);
+    if (n->root.child->features_count != dataset->features_count || n->class_list.size != dataset->class_list->size
+        || n->root.child->metric != settings.metric) {
+        fprintf(stderr, "Checkpoint does not match input data\n");
+        exit(EXIT_FAILURE);
+    }
+
+    settings.stats = &n->stats;
+    if (settings.checkpoint != NULL) {
+        settings.checkpoint->network = n;
+        settings.checkpoint->epochs_count = 0;
+    }
+    somr_network_start_accounting(n, input_dataset, dataset, &settings);
 
     somr_trainer_t trainer;
     somr_trainer_init(&trainer, n->root.child, dataset, n->root.error, n->root.error, &settings);
+    trainer.resume_frames = resume.frames;
+    trainer.resume_frames_count = resume.frames_count;
+    somr_stats_reset(&n->stats);
+    trainer.stats_index = somr_stats_add_map(&n->stats, -1, 0, dataset->size);
     somr_trainer_train(&trainer);
+    somr_stats_compute_total(&n->stats);
+
+    somr_checkpoint_clear(&resume);
+    somr_network_clear_projected_dataset(n, dataset);
 }
 
-static void somr_network_compute_root_error(somr_network_t *n, somr_dataset_t *dataset) {
+void somr_network_update(somr_network_t *n, somr_dataset_t *input_dataset, somr_trainer_settings_t *user_settings) {
+    assert(n->root.child != NULL);
+    somr_dataset_t *dataset = somr_network_project_dataset(n, input_dataset);
+
+    // translate labels of data set to labels of network
+    somr_label_t *labels_map = malloc(sizeof(somr_label_t) * dataset->class_list->size);
+    for (unsigned int i = 0; i < dataset->class_list->size; i++) {
+        char *class = somr_list_get(dataset->class_list, i);
+        unsigned int index;
+        if (!somr_list_find(&n->class_list, class, &index)) {
+            index = somr_list_push(&n->class_list, class);
+        }
+        labels_map[i] = index;
+    }
+
+    // add errors of new input vectors to root error (root weights are not moved to the new mean)
+    for (unsigned int i = 0; i < dataset->size; i++) {
+        somr_data_vector_t *data_vector = somr_dataset_get_vector(dataset, i);
+        somr_unit_activate(&n->root, data_vector, dataset->features_count, n->root.child->metric);
+        n->root.error += sqrt(n->root.activation);
+    }
+
+    // updates are short, they are not checkpointed
+    somr_trainer_settings_t settings = *user_settings;
+    settings.stats = &n->stats;
+    settings.checkpoint = NULL;
+    somr_network_start_accounting(n, input_dataset, dataset, &settings);
+
+    somr_trainer_t trainer;
+    somr_trainer_init(&trainer, n->root.child, dataset, n->root.error, n->root.error, &settings);
+    trainer.labels_map = labels_map;
+    somr_stats_reset(&n->stats);
+    trainer.stats_index = somr_stats_add_map(&n->stats, -1, 0, dataset->size);
+    somr_trainer_update(&trainer);
+    somr_stats_compute_total(&n->stats);
+
+    free(labels_map);
+    somr_network_clear_projected_dataset(n, dataset);
+}
+
+static void somr_network_compute_root_error(somr_network_t *n, somr_dataset_t *dataset, somr_metric_t metric) {
     n->root.error = 0.0;
     for (unsigned int i = 0; i < dataset->size; i++) {
         somr_data_vector_t *data_vector = somr_dataset_get_vector(dataset, i);
-        n->root.error += somr_vector_euclid_dist(n->root.weights, data_vector->weights, dataset->features_count);
+        somr_unit_activate(&n->root, data_vector, dataset->features_count, metric);
+        n->root.error += sqrt(n->root.activation);
     }
     assert(n->root.error >= 0.0);
 }
 
+/** @return data set fed to maps: @p dataset itself, or a projection of it to clear with somr_network_clear_projected_dataset */
+static somr_dataset_t *somr_network_project_dataset(somr_network_t *n, somr_dataset_t *dataset) {
+    if (n->projection == NULL) {
+        return dataset;
+    }
+    if (dataset->features_count != n->projection->input_count) {
+        fprintf(stderr, "Number of values per input vector does not match network projection\n");
+        exit(EXIT_FAILURE);
+    }
+    somr_dataset_t *projected_dataset = malloc(sizeof(somr_dataset_t));
+    somr_projection_apply_dataset(n->projection, dataset, projected_dataset);
+    return projected_dataset;
+}
+
+static void somr_network_clear_projected_dataset(somr_network_t *n, somr_dataset_t *dataset) {
+    if (n->projection != NULL) {
+        somr_memory_remove(&n->memory, SOMR_MEMORY_DATASET, somr_memory_measure_dataset(dataset));
+        somr_dataset_clear(dataset);
+        free(dataset);
+    }
+}
+
+/** adds bytes of maps, root unit and projection of @p n to @p memory */
+static void somr_network_measure(somr_network_t *n, somr_memory_t *memory) {
+    size_t bytes[SOMR_MEMORY_CATEGORIES_COUNT] = { 0 };
+    if (n->root.child != NULL) {
+        somr_memory_measure_map(n->root.child, bytes, true);
+        bytes[SOMR_MEMORY_WEIGHTS] += sizeof(double) * n->root.child->features_count;
+    }
+    bytes[SOMR_MEMORY_UNITS] += sizeof(somr_network_t);
+    if (n->projection != NULL) {
+        somr_projection_t *p = n->projection;
+        bytes[SOMR_MEMORY_WEIGHTS] += sizeof(double) * (p->output_count * p->input_count + p->input_count + p->output_count);
+    }
+    for (unsigned int i = 0; i < SOMR_MEMORY_CATEGORIES_COUNT; i++) {
+        somr_memory_add(memory, i, bytes[i]);
+    }
+}
+
+/**
+resets memory accounting of @p n for a training on @p dataset (projected from @p input_dataset, both being accounted),
+to be updated by trainers through @p settings
+*/
+static void somr_network_start_accounting(somr_network_t *n, somr_dataset_t *input_dataset, somr_dataset_t *dataset, somr_trainer_settings_t *settings) {
+    somr_memory_init(&n->memory, settings->memory_budget);
+    somr_memory_add(&n->memory, SOMR_MEMORY_DATASET, somr_memory_measure_dataset(input_dataset));
+    if (dataset != input_dataset) {
+        somr_memory_add(&n->memory, SOMR_MEMORY_DATASET, somr_memory_measure_dataset(dataset));
+    }
+    somr_network_measure(n, &n->memory);
+    settings->memory = &n->memory;
+}
+
+void somr_network_get_memory(somr_network_t *n, somr_memory_t *memory) {
+    somr_memory_init(memory, 0);
+    somr_network_measure(n, memory);
+}
+
 somr_label_t somr_network_classify(somr_network_t *n, somr_data_vector_t *data_vector) {
-    return somr_map_classify(n->root.child, data_vector);
+    if (n->projection == NULL) {
+        return somr_map_classify(n->root.child, data_vector);
+    }
+    somr_data_vector_t projected_vector;
+    somr_data_vector_init_batch(&projected_vector, 1, n->projection->output_count);
+    somr_projection_apply(n->projection, data_vector, projected_vector.weights);
+    somr_label_t label = somr_map_classify(n->root.child, &projected_vector);
+    somr_data_vector_clear_batch(&projected_vector, 1);
+    return label;
+}
+
+somr_label_t somr_network_classify_bounded(somr_network_t *n, somr_data_vector_t *data_vector, unsigned int max_depth,
+    unsigned long long max_dist_evals, unsigned int *depth, bool *is_leaf) {
+    if (n->projection == NULL) {
+        return somr_map_classify_bounded(n->root.child, data_vector, max_depth, max_dist_evals, depth, is_leaf);
+    }
+    somr_data_vector_t projected_vector;
+    somr_data_vector_init_batch(&projected_vector, 1, n->projection->output_count);
+    somr_projection_apply(n->projection, data_vector, projected_vector.weights);
+    somr_label_t label = somr_map_classify_bounded(n->root.child, &projected_vector, max_depth, max_dist_evals, depth, is_leaf);
+    somr_data_vector_clear_batch(&projected_vector, 1);
+    return label;
 }
 
 char *somr_network_get_class(somr_network_t *n, somr_label_t label) {
@@ -73,3 +348,23 @@ void somr_network_write_to_img(somr_network_t *n, unsigned char *img, unsigned i
     unsigned int border = somr_map_get_depth(n->root.child) * 2;
     somr_map_write_to_img(n->root.child, img, img_width, img_height, colors, border);
 }
+
+void somr_network_write_band_to_img(somr_network_t *n, unsigned char *band, unsigned int img_width, unsigned int img_height,
+    unsigned int band_y, unsigned int band_height, unsigned char *colors) {
+    unsigned int border = somr_map_get_depth(n->root.child) * 2;
+    somr_map_write_region_to_img(n->root.child, band, img_width, img_height, 0, band_y, img_width, band_height, colors, border);
+}
+
+void somr_network_write_tile_to_img(somr_network_t *n, unsigned char *tile, unsigned int tile_size,
+    unsigned int zoom, unsigned int tile_x, unsigned int tile_y, unsigned char *colors) {
+    assert(tile_size > 0);
+    // whole level must be addressable with unsigned int pixel coordinates
+    assert(zoom < 32 && ((unsigned long long) tile_size << zoom) <= UINT_MAX);
+    unsigned int tiles_count = 1u << zoom;
+    assert(tile_x < tiles_count && tile_y < tiles_count);
+
+    unsigned int level_size = tile_size * tiles_count;
+    unsigned int border = somr_map_get_depth(n->root.child) * 2;
+    somr_map_write_region_to_img(n->root.child, tile, level_size, level_size,
+        tile_x * tile_size, tile_y * tile_size, tile_size, tile_size, colors, border);
+}
@@ -0,0 +1,242 @@
+#define _GNU_SOURCE // for rand_r
+#include "projection.h"
+#include "vector.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** 1 / (2 sqrt(2)): normalized non-negative vectors are at most sqrt(2) away from their mean */
+#define SOMR_PROJECTION_SCALE 0.35355339059327373
+/** number of passes on data set of randomized subspace iteration */
+#define SOMR_PROJECTION_PCA_PASSES 6
+/** rows whose norm falls below this value after orthogonalization are dropped (data set has lower rank) */
+#define SOMR_PROJECTION_MIN_NORM 1e-12
+
+static void somr_projection_alloc(somr_projection_t *p, somr_projection_kind_t kind, unsigned int input_count, unsigned int output_count);
+static void somr_projection_init_random_rows(somr_projection_t *p, unsigned int *rand_state);
+static void somr_projection_orthonormalize(somr_projection_t *p);
+static void somr_projection_iterate(somr_projection_t *p, somr_dataset_t *d);
+static void somr_projection_compute_mean_outputs(somr_projection_t *p);
+
+void somr_projection_init(somr_projection_t *p, somr_dataset_t *d, somr_projection_kind_t kind, unsigned int output_count, unsigned int *rand_state) {
+    assert(output_count > 0 && output_count < d->features_count);
+
+    somr_projection_alloc(p, kind, d->features_count, output_count);
+    somr_dataset_compute_mean_weights(d, p->mean);
+    somr_projection_init_random_rows(p, rand_state);
+
+    if (kind == SOMR_PROJECTION_PCA) {
+        // block power iteration on covariance matrix, starting from random rows
+        somr_projection_orthonormalize(p);
+        for (unsigned int i = 0; i < SOMR_PROJECTION_PCA_PASSES; i++) {
+            somr_projection_iterate(p, d);
+            somr_projection_orthonormalize(p);
+        }
+    } else {
+        // random rows of high dimension are nearly orthogonal, only their norm is fixed
+        for (unsigned int i = 0; i < output_count; i++) {
+            double *row = &p->matrix[(size_t) i * p->input_count];
+            somr_vector_normalize(row, p->input_count);
+        }
+    }
+    somr_projection_compute_mean_outputs(p);
+}
+
+void somr_projection_clear(somr_projection_t *p) {
+    free(p->matrix);
+    free(p->mean);
+    free(p->mean_outputs);
+    p->matrix = NULL;
+    p->mean = NULL;
+    p->mean_outputs = NULL;
+}
+
+void somr_projection_init_from_binary_file(somr_projection_t *p, FILE *file) {
+    uint32_t header[3];
+    if (fread(header, sizeof(uint32_t), 3, file) != 3 || header[0] > SOMR_PROJECTION_PCA
+        || header[1] == 0 || header[2] == 0 || header[2] >= header[1]) {
+        fprintf(stderr, "Invalid binary projection header\n");
+        exit(EXIT_FAILURE);
+    }
+    somr_projection_alloc(p, header[0], header[1], header[2]);
+    size_t matrix_size = (size_t) p->output_count * p->input_count;
+    if (fread(p->mean, sizeof(double), p->input_count, file) != p->input_count
+        || fread(p->matrix, sizeof(double), matrix_size, file) != matrix_size) {
+        fprintf(stderr, "Error reading projection\n");
+        exit(EXIT_FAILURE);
+    }
+    somr_projection_compute_mean_outputs(p);
+}
+
+void somr_projection_write(somr_projection_t *p, FILE *file) {
+    uint32_t header[3] = { p->kind, p->input_count, p->output_count };
+    fwrite(header, sizeof(uint32_t), 3, file);
+    fwrite(p->mean, sizeof(double), p->input_count, file);
+    fwrite(p->matrix, sizeof(double), (size_t) p->output_count * p->input_count, file);
+}
+
+void somr_projection_apply(somr_projection_t *p, somr_data_vector_t *v, double *outputs) {
+    // quantized vectors are decoded once for all rows
+    double *decoded = NULL;
+    double *weights = v->weights;
+    if (somr_data_vector_is_quantized(v)) {
+        decoded = malloc(sizeof(double) * p->input_count);
+        weights = somr_data_vector_get_block(v, 0, p->input_count, decoded);
+    }
+
+    for (unsigned int i = 0; i < p->output_count; i++) {
+        double *row = &p->matrix[(size_t) i * p->input_count];
+        double dot;
+        if (somr_data_vector_is_sparse(v)) {
+            dot = somr_vector_sparse_dot(row, v->nnz_indices, v->nnz_values, v->nnz_count);
+        } else {
+            dot = 0.0;
+            for (unsigned int j = 0; j < p->input_count; j++) {
+                dot += row[j] * weights[j];
+            }
+        }
+        outputs[i] = 0.5 + SOMR_PROJECTION_SCALE * (dot - p->mean_outputs[i]);
+    }
+    free(decoded);
+}
+
+void somr_projection_apply_dataset(somr_projection_t *p, somr_dataset_t *source, somr_dataset_t *d) {
+    assert(source->features_count == p->input_count);
+
+    unsigned int size = source->size;
+    somr_data_vector_t *data_vectors = malloc(sizeof(somr_data_vector_t) * size);
+    somr_data_vector_init_batch(data_vectors, size, p->output_count);
+    unsigned int *indices = malloc(sizeof(unsigned int) * size);
+    for (unsigned int i = 0; i < size; i++) {
+        somr_data_vector_t *v = somr_dataset_get_vector(source, i);
+        somr_projection_apply(p, v, data_vectors[i].weights);
+        data_vectors[i].label = v->label;
+        indices[i] = i;
+    }
+    somr_dataset_init(d, data_vectors, indices, size, p->output_count, source->class_list);
+    free(indices);
+}
+
+static void somr_projection_alloc(somr_projection_t *p, somr_projection_kind_t kind, unsigned int input_count, unsigned int output_count) {
+    p->kind = kind;
+    p->input_count = input_count;
+    p->output_count = output_count;
+    p->matrix = malloc(sizeof(double) * output_count * input_count);
+    p->mean = malloc(sizeof(double) * input_count);
+    p->mean_outputs = malloc(sizeof(double) * output_count);
+}
+
+/** fills matrix with {-1, 0, 1} entries (probabilities 1/6, 2/3, 1/6), which preserve distances as gaussian ones up to a scale */
+static void somr_projection_init_random_rows(somr_projection_t *p, unsigned int *rand_state) {
+    for (unsigned int i = 0; i < p->output_count; i++) {
+        double *row = &p->matrix[(size_t) i * p->input_count];
+        bool is_zero = true;
+        while (is_zero) {
+            for (unsigned int j = 0; j < p->input_count; j++) {
+                unsigned int draw = rand_r(rand_state) % 6;
+                row[j] = (draw == 0) ? -1.0 : (draw == 1) ? 1.0 : 0.0;
+                is_zero = is_zero && row[j] == 0.0;
+            }
+        }
+    }
+}
+
+/** modified Gram-Schmidt on rows of matrix, rows that are linearly dependent on previous ones are set to zero */
+static void somr_projection_orthonormalize(somr_projection_t *p) {
+    for (unsigned int i = 0; i < p->output_count; i++) {
+        double *row = &p->matrix[(size_t) i * p->input_count];
+        for (unsigned int k = 0; k < i; k++) {
+            double *previous = &p->matrix[(size_t) k * p->input_count];
+            double dot = 0.0;
+            for (unsigned int j = 0; j < p->input_count; j++) {
+                dot += row[j] * previous[j];
+            }
+            for (unsigned int j = 0; j < p->input_count; j++) {
+                row[j] -= dot * previous[j];
+            }
+        }
+
+        double norm = 0.0;
+        for (unsigned int j = 0; j < p->input_count; j++) {
+            norm += row[j] * row[j];
+        }
+        norm = sqrt(norm);
+        for (unsigned int j = 0; j < p->input_count; j++) {
+            row[j] = (norm > SOMR_PROJECTION_MIN_NORM) ? row[j] / norm : 0.0;
+        }
+    }
+}
+
+/**
+replaces rows V by V C, C being the (unnormalized) covariance matrix of data set, in a single pass:
+V C = sum over x of ((x - mean) . V) (x - mean), with (x - mean) . V = x . V - mean . V
+so that only non-zero features of sparse input vectors are read
+*/
+static void somr_projection_iterate(somr_projection_t *p, somr_dataset_t *d) {
+    unsigned int input_count = p->input_count;
+    unsigned int output_count = p->output_count;
+    double *result = calloc((size_t) output_count * input_count, sizeof(double));
+    double *coefs = malloc(sizeof(double) * output_count);
+    double *coefs_sum = calloc(output_count, sizeof(double));
+    double *decoded = malloc(sizeof(double) * input_count);
+
+    somr_projection_compute_mean_outputs(p);
+    for (unsigned int n = 0; n < d->size; n++) {
+        somr_data_vector_t *v = somr_dataset_get_vector(d, n);
+        double *weights = somr_data_vector_is_sparse(v) ? NULL : somr_data_vector_get_block(v, 0, input_count, decoded);
+        for (unsigned int i = 0; i < output_count; i++) {
+            double *row = &p->matrix[(size_t) i * input_count];
+            double dot;
+            if (somr_data_vector_is_sparse(v)) {
+                dot = somr_vector_sparse_dot(row, v->nnz_indices, v->nnz_values, v->nnz_count);
+            } else {
+                dot = 0.0;
+                for (unsigned int j = 0; j < input_count; j++) {
+                    dot += row[j] * weights[j];
+                }
+            }
+            coefs[i] = dot - p->mean_outputs[i];
+            coefs_sum[i] += coefs[i];
+        }
+
+        for (unsigned int i = 0; i < output_count; i++) {
+            double *result_row = &result[(size_t) i * input_count];
+            if (somr_data_vector_is_sparse(v)) {
+                for (unsigned int j = 0; j < v->nnz_count; j++) {
+                    result_row[v->nnz_indices[j]] += coefs[i] * v->nnz_values[j];
+                }
+            } else {
+                for (unsigned int j = 0; j < input_count; j++) {
+                    result_row[j] += coefs[i] * weights[j];
+                }
+            }
+        }
+    }
+
+    // subtract mean part of (x - mean) from sums
+    for (unsigned int i = 0; i < output_count; i++) {
+        double *result_row = &result[(size_t) i * input_count];
+        for (unsigned int j = 0; j < input_count; j++) {
+            result_row[j] -= coefs_sum[i] * p->mean[j];
+        }
+    }
+
+    free(p->matrix);
+    p->matrix = result;
+    free(coefs);
+    free(coefs_sum);
+    free(decoded);
+}
+
+static void somr_projection_compute_mean_outputs(somr_projection_t *p) {
+    for (unsigned int i = 0; i < p->output_count; i++) {
+        double *row = &p->matrix[(size_t) i * p->input_count];
+        double dot = 0.0;
+        for (unsigned int j = 0; j < p->input_count; j++) {
+            dot += row[j] * p->mean[j];
+        }
+        p->mean_outputs[i] = dot;
+    }
+}
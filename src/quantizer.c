@@ -0,0 +1,154 @@
+#include "quantizer.h"
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** largest finite half precision value, larger values are clamped to it */
+#define SOMR_QUANTIZER_HALF_MAX 65504.0f
+
+static char *SOMR_ENCODING_NAMES[] = { "double", "uint8", "uint16", "float16" };
+
+/** @return highest code of integer @p encoding */
+static double somr_quantizer_get_levels(somr_encoding_t encoding) {
+    return (encoding == SOMR_ENCODING_UINT8) ? UINT8_MAX : UINT16_MAX;
+}
+
+void somr_quantizer_init(somr_quantizer_t *q, somr_encoding_t encoding, unsigned int features_count, double *mins, double *maxs) {
+    assert(encoding < SOMR_ENCODINGS_COUNT);
+    assert(features_count > 0);
+
+    q->encoding = encoding;
+    q->features_count = features_count;
+    q->offsets = malloc(sizeof(double) * features_count);
+    q->steps = malloc(sizeof(double) * features_count);
+    for (unsigned int i = 0; i < features_count; i++) {
+        if (encoding == SOMR_ENCODING_UINT8 || encoding == SOMR_ENCODING_UINT16) {
+            assert(mins[i] <= maxs[i]);
+            q->offsets[i] = mins[i];
+            q->steps[i] = (maxs[i] - mins[i]) / somr_quantizer_get_levels(encoding);
+        } else {
+            q->offsets[i] = 0.0;
+            q->steps[i] = 1.0;
+        }
+    }
+}
+
+void somr_quantizer_clear(somr_quantizer_t *q) {
+    free(q->offsets);
+    q->offsets = NULL;
+    free(q->steps);
+    q->steps = NULL;
+}
+
+size_t somr_quantizer_get_code_size(somr_quantizer_t *q) {
+    switch (q->encoding) {
+    case SOMR_ENCODING_UINT8:
+        return sizeof(uint8_t);
+    case SOMR_ENCODING_UINT16:
+    case SOMR_ENCODING_FLOAT16:
+        return sizeof(uint16_t);
+    default:
+        return sizeof(double);
+    }
+}
+
+/** rounds @p value to nearest half precision value (ties to even) */
+static uint16_t somr_quantizer_encode_half(double value) {
+    assert(isfinite(value));
+    float magnitude = (float) fabs(value);
+    if (magnitude > SOMR_QUANTIZER_HALF_MAX) {
+        magnitude = SOMR_QUANTIZER_HALF_MAX;
+    }
+    // rebias exponent from 127 to 15, so that half subnormals become float subnormals with the same bits
+    magnitude *= 0x1p-112f;
+    uint32_t bits;
+    memcpy(&bits, &magnitude, sizeof(uint32_t));
+    bits += 0x0fff + ((bits >> 13) & 1);
+    uint16_t code = bits >> 13;
+    return (value < 0.0) ? code | 0x8000 : code;
+}
+
+/** inverse of somr_quantizer_encode_half, without branches so that loops calling it get vectorized */
+static inline double somr_quantizer_decode_half(uint16_t code) {
+    uint32_t bits = (uint32_t) (code & 0x7fff) << 13;
+    float magnitude;
+    memcpy(&magnitude, &bits, sizeof(float));
+    magnitude *= 0x1p112f;
+    return (code & 0x8000) ? -magnitude : magnitude;
+}
+
+void somr_quantizer_encode(somr_quantizer_t *q, double *weights, void *codes) {
+    if (q->encoding == SOMR_ENCODING_DOUBLE) {
+        memcpy(codes, weights, sizeof(double) * q->features_count);
+        return;
+    }
+    if (q->encoding == SOMR_ENCODING_FLOAT16) {
+        uint16_t *half_codes = codes;
+        for (unsigned int i = 0; i < q->features_count; i++) {
+            half_codes[i] = somr_quantizer_encode_half(weights[i]);
+        }
+        return;
+    }
+
+    double levels = somr_quantizer_get_levels(q->encoding);
+    for (unsigned int i = 0; i < q->features_count; i++) {
+        double level = (q->steps[i] > 0.0) ? round((weights[i] - q->offsets[i]) / q->steps[i]) : 0.0;
+        level = (level < 0.0) ? 0.0 : (level > levels) ? levels : level;
+        if (q->encoding == SOMR_ENCODING_UINT8) {
+            ((uint8_t *) codes)[i] = (uint8_t) level;
+        } else {
+            ((uint16_t *) codes)[i] = (uint16_t) level;
+        }
+    }
+}
+
+void somr_quantizer_decode(somr_quantizer_t *q, void *codes, unsigned int begin, unsigned int count, double *weights) {
+    assert(begin + count <= q->features_count);
+    double *offsets = &q->offsets[begin];
+    double *steps = &q->steps[begin];
+
+    // one plain loop per encoding, that the compiler vectorizes
+    switch (q->encoding) {
+    case SOMR_ENCODING_UINT8: {
+        uint8_t *block_codes = (uint8_t *) codes + begin;
+        for (unsigned int i = 0; i < count; i++) {
+            weights[i] = offsets[i] + steps[i] * block_codes[i];
+        }
+        break;
+    }
+    case SOMR_ENCODING_UINT16: {
+        uint16_t *block_codes = (uint16_t *) codes + begin;
+        for (unsigned int i = 0; i < count; i++) {
+            weights[i] = offsets[i] + steps[i] * block_codes[i];
+        }
+        break;
+    }
+    case SOMR_ENCODING_FLOAT16: {
+        uint16_t *block_codes = (uint16_t *) codes + begin;
+        for (unsigned int i = 0; i < count; i++) {
+            weights[i] = somr_quantizer_decode_half(block_codes[i]);
+        }
+        break;
+    }
+    default:
+        memcpy(weights, (double *) codes + begin, sizeof(double) * count);
+        break;
+    }
+}
+
+char *somr_encoding_get_name(somr_encoding_t encoding) {
+    assert(encoding < SOMR_ENCODINGS_COUNT);
+    return SOMR_ENCODING_NAMES[encoding];
+}
+
+bool somr_encoding_find(char *name, somr_encoding_t *encoding) {
+    for (unsigned int i = 0; i < SOMR_ENCODINGS_COUNT; i++) {
+        if (strcmp(name, SOMR_ENCODING_NAMES[i]) == 0) {
+            *encoding = i;
+            return true;
+        }
+    }
+    return false;
+}
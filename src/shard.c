@@ -0,0 +1,509 @@
+#define _GNU_SOURCE // for getaddrinfo, fdopen and fork
+#include "shard.h"
+#include <assert.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/** sparse vectors are tagged with this encoding in jobs */
+#define SOMR_SHARD_SPARSE_ENCODING SOMR_ENCODINGS_COUNT
+/** number of vectors allocated when a job data set starts being read, doubled as more vectors come */
+#define SOMR_SHARD_MIN_VECTORS_CAPACITY 1024
+
+void somr_shard_init(somr_shard_t *s, unsigned int depth) {
+    assert(depth > 0);
+    s->depth = depth;
+    s->workers_count = 0;
+    s->inputs = NULL;
+    s->outputs = NULL;
+    s->pids = NULL;
+    // a worker that dies should make the coordinator fail on its next read, not kill it silently on a write
+    signal(SIGPIPE, SIG_IGN);
+}
+
+void somr_shard_clear(somr_shard_t *s) {
+    // workers stop when their input is closed
+    for (unsigned int i = 0; i < s->workers_count; i++) {
+        fclose(s->outputs[i]);
+        fclose(s->inputs[i]);
+    }
+    for (unsigned int i = 0; i < s->workers_count; i++) {
+        if (s->pids[i] != 0) {
+            waitpid(s->pids[i], NULL, 0);
+        }
+    }
+    free(s->inputs);
+    free(s->outputs);
+    free(s->pids);
+    s->inputs = NULL;
+    s->outputs = NULL;
+    s->pids = NULL;
+    s->workers_count = 0;
+}
+
+/** adds worker connected to socket @p fd, running in local process @p pid (0 if remote) */
+static void somr_shard_add_worker(somr_shard_t *s, int fd, pid_t pid) {
+    s->inputs = realloc(s->inputs, sizeof(FILE *) * (s->workers_count + 1));
+    s->outputs = realloc(s->outputs, sizeof(FILE *) * (s->workers_count + 1));
+    s->pids = realloc(s->pids, sizeof(pid_t) * (s->workers_count + 1));
+    s->inputs[s->workers_count] = fdopen(fd, "rb");
+    s->outputs[s->workers_count] = fdopen(dup(fd), "wb");
+    s->pids[s->workers_count] = pid;
+    s->workers_count++;
+}
+
+void somr_shard_connect(somr_shard_t *s, char *host, char *port) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addresses;
+    if (getaddrinfo(host, port, &hints, &addresses) != 0) {
+        fprintf(stderr, "Could not resolve worker %s:%s\n", host, port);
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = -1;
+    for (struct addrinfo *address = addresses; address != NULL && fd < 0; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        fprintf(stderr, "Could not connect to worker %s:%s\n", host, port);
+        exit(EXIT_FAILURE);
+    }
+    somr_shard_add_worker(s, fd, 0);
+}
+
+void somr_shard_spawn(somr_shard_t *s, unsigned int workers_count) {
+    for (unsigned int i = 0; i < workers_count; i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            fprintf(stderr, "Could not create worker socket\n");
+            exit(EXIT_FAILURE);
+        }
+        // buffered output would otherwise be written by both processes
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Could not start worker process\n");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            // sockets of other workers are closed, so that they see the end of their input when coordinator closes it
+            close(fds[0]);
+            for (unsigned int j = 0; j < s->workers_count; j++) {
+                close(fileno(s->inputs[j]));
+                close(fileno(s->outputs[j]));
+            }
+            somr_shard_serve(fdopen(fds[1], "rb"), fdopen(dup(fds[1]), "wb"));
+            _exit(EXIT_SUCCESS);
+        }
+        close(fds[1]);
+        somr_shard_add_worker(s, fds[0], pid);
+    }
+}
+
+static void somr_shard_write(void *values, size_t size, size_t count, FILE *file) {
+    if (fwrite(values, size, count, file) != count) {
+        fprintf(stderr, "Error writing shard job\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void somr_shard_read(void *values, size_t size, size_t count, FILE *file) {
+    if (fread(values, size, count, file) != count) {
+        fprintf(stderr, "Error reading shard job\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/** @return number of network classes that labels of @p d can be translated to by @p labels_map */
+static unsigned int somr_shard_get_classes_count(somr_dataset_t *d, somr_label_t *labels_map) {
+    if (labels_map == NULL) {
+        return d->class_list->size;
+    }
+    unsigned int classes_count = 0;
+    for (unsigned int i = 0; i < d->class_list->size; i++) {
+        if ((unsigned int) labels_map[i] + 1 > classes_count) {
+            classes_count = labels_map[i] + 1;
+        }
+    }
+    return classes_count;
+}
+
+static void somr_shard_write_dataset(somr_dataset_t *d, somr_label_t *labels_map, unsigned int classes_count, FILE *file) {
+    uint32_t header[3] = { d->size, d->is_sparse ? SOMR_SHARD_SPARSE_ENCODING : SOMR_ENCODING_DOUBLE, classes_count };
+    if (d->quantizer != NULL) {
+        header[1] = d->quantizer->encoding;
+    }
+    somr_shard_write(header, sizeof(uint32_t), 3, file);
+    if (d->quantizer != NULL) {
+        somr_shard_write(d->quantizer->offsets, sizeof(double), d->features_count, file);
+        somr_shard_write(d->quantizer->steps, sizeof(double), d->features_count, file);
+    }
+
+    for (unsigned int i = 0; i < d->size; i++) {
+        somr_data_vector_t *v = somr_dataset_get_vector(d, i);
+        int32_t label = (labels_map != NULL && v->label != SOMR_EMPTY_LABEL) ? labels_map[v->label] : v->label;
+        somr_shard_write(&label, sizeof(int32_t), 1, file);
+        somr_shard_write(&v->norm_squared, sizeof(double), 1, file);
+        if (d->is_sparse) {
+            uint32_t nnz_count = v->nnz_count;
+            somr_shard_write(&nnz_count, sizeof(uint32_t), 1, file);
+            somr_shard_write(v->nnz_indices, sizeof(uint32_t), nnz_count, file);
+            somr_shard_write(v->nnz_values, sizeof(double), nnz_count, file);
+        } else if (d->quantizer != NULL) {
+            somr_shard_write(v->codes, somr_quantizer_get_code_size(d->quantizer), d->features_count, file);
+        } else {
+            somr_shard_write(v->weights, sizeof(double), d->features_count, file);
+        }
+    }
+}
+
+static void somr_shard_invalid_dataset(void) {
+    fprintf(stderr, "Invalid shard job data set\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+reads input vectors of a job in a new data set @p d, with labels of network and no classes,
+checking them as input files are (arrays grow with the vectors actually read, not with the announced number)
+*/
+static void somr_shard_read_dataset(somr_dataset_t *d, unsigned int features_count, FILE *file) {
+    uint32_t header[3];
+    somr_shard_read(header, sizeof(uint32_t), 3, file);
+    unsigned int size = header[0];
+    unsigned int classes_count = header[2];
+    if (size == 0 || header[1] > SOMR_SHARD_SPARSE_ENCODING) {
+        somr_shard_invalid_dataset();
+    }
+
+    somr_quantizer_t *quantizer = NULL;
+    bool is_sparse = header[1] == SOMR_SHARD_SPARSE_ENCODING;
+    bool is_quantized = !is_sparse && header[1] != SOMR_ENCODING_DOUBLE;
+    if (is_quantized) {
+        quantizer = malloc(sizeof(somr_quantizer_t));
+        double *offsets = malloc(sizeof(double) * features_count);
+        somr_shard_read(offsets, sizeof(double), features_count, file);
+        // levels are not fitted again, steps are read as they are so that codes decode to the same values
+        somr_quantizer_init(quantizer, header[1], features_count, offsets, offsets);
+        memcpy(quantizer->offsets, offsets, sizeof(double) * features_count);
+        free(offsets);
+        somr_shard_read(quantizer->steps, sizeof(double), features_count, file);
+    }
+
+    // dense weights or codes of all vectors, contiguous (vectors point into them once all are read)
+    size_t vector_size = is_quantized ? somr_quantizer_get_code_size(quantizer) * features_count : sizeof(double) * features_count;
+    char *values = NULL;
+    somr_data_vector_t *data_vectors = NULL;
+    unsigned int vectors_capacity = 0;
+    unsigned int *offsets = NULL;
+    unsigned int *nnz_indices = NULL;
+    double *nnz_values = NULL;
+    unsigned int nnz_capacity = 0;
+
+    for (unsigned int i = 0; i < size; i++) {
+        if (i == vectors_capacity) {
+            vectors_capacity = (vectors_capacity == 0) ? SOMR_SHARD_MIN_VECTORS_CAPACITY : 2 * vectors_capacity;
+            if (vectors_capacity > size) {
+                vectors_capacity = size;
+            }
+            data_vectors = realloc(data_vectors, sizeof(somr_data_vector_t) * vectors_capacity);
+            if (is_sparse) {
+                offsets = realloc(offsets, sizeof(unsigned int) * (vectors_capacity + 1));
+                offsets[0] = 0;
+            } else {
+                values = realloc(values, vector_size * vectors_capacity);
+            }
+        }
+
+        somr_data_vector_t *v = &data_vectors[i];
+        int32_t label;
+        somr_shard_read(&label, sizeof(int32_t), 1, file);
+        if (label != SOMR_EMPTY_LABEL && (label < 0 || (uint32_t) label >= classes_count)) {
+            somr_shard_invalid_dataset();
+        }
+        v->label = label;
+        somr_shard_read(&v->norm_squared, sizeof(double), 1, file);
+        if (is_sparse) {
+            uint32_t nnz_count;
+            somr_shard_read(&nnz_count, sizeof(uint32_t), 1, file);
+            // indices are strictly increasing and below features count, so there are at most features count of them
+            if (nnz_count > features_count || offsets[i] + nnz_count < offsets[i]) {
+                somr_shard_invalid_dataset();
+            }
+            offsets[i + 1] = offsets[i] + nnz_count;
+            if (offsets[i + 1] > nnz_capacity || nnz_indices == NULL) {
+                nnz_capacity = (offsets[i + 1] > 2 * nnz_capacity) ? offsets[i + 1] + 1 : 2 * nnz_capacity;
+                nnz_indices = realloc(nnz_indices, sizeof(unsigned int) * nnz_capacity);
+                nnz_values = realloc(nnz_values, sizeof(double) * nnz_capacity);
+            }
+            somr_shard_read(&nnz_indices[offsets[i]], sizeof(uint32_t), nnz_count, file);
+            somr_shard_read(&nnz_values[offsets[i]], sizeof(double), nnz_count, file);
+            for (unsigned int j = offsets[i]; j < offsets[i + 1]; j++) {
+                if (nnz_indices[j] >= features_count || (j > offsets[i] && nnz_indices[j] <= nnz_indices[j - 1])) {
+                    somr_shard_invalid_dataset();
+                }
+            }
+        } else {
+            somr_shard_read(&values[i * vector_size], 1, vector_size, file);
+        }
+    }
+
+    if (is_sparse) {
+        // norms are computed again, from the same values
+        somr_data_vector_init_sparse_batch(data_vectors, size, offsets, nnz_indices, nnz_values);
+        free(offsets);
+    } else {
+        for (unsigned int i = 0; i < size; i++) {
+            somr_data_vector_t *v = &data_vectors[i];
+            v->weights = is_quantized ? NULL : (double *) &values[i * vector_size];
+            v->codes = is_quantized ? &values[i * vector_size] : NULL;
+            v->quantizer = quantizer;
+            v->nnz_count = 0;
+            v->nnz_indices = NULL;
+            v->nnz_values = NULL;
+        }
+    }
+
+    somr_list_t class_list;
+    somr_list_init(&class_list, true);
+    unsigned int *indices = malloc(sizeof(unsigned int) * size);
+    for (unsigned int i = 0; i < size; i++) {
+        indices[i] = i;
+    }
+    somr_dataset_init(d, data_vectors, indices, size, features_count, &class_list);
+    somr_list_clear(&class_list);
+    free(indices);
+    d->quantizer = quantizer;
+}
+
+static void somr_shard_send_job(FILE *file, somr_shard_job_t *job, somr_trainer_settings_t *settings, somr_label_t *labels_map, unsigned int classes_count) {
+    somr_shard_write(SOMR_SHARD_MAGIC, 1, SOMR_SHARD_MAGIC_LENGTH, file);
+    uint32_t header[2] = { job->map->features_count, job->map->metric };
+    somr_shard_write(header, sizeof(uint32_t), 2, file);
+    double doubles[8] = {
+        settings->learn_rate, settings->spread_threshold, settings->depth_threshold, settings->convergence_tolerance,
+        settings->early_spread_ratio, settings->error_confidence, job->root_mean_error, job->parent_mean_error
+    };
+    somr_shard_write(doubles, sizeof(double), 8, file);
+    uint32_t iters_count = settings->iters_count;
+    uint8_t should_orient = settings->should_orient;
+    uint32_t counts[4] = { job->rand_state, settings->samples_per_unit, settings->max_insertions, settings->full_pass_period };
+    somr_shard_write(&iters_count, sizeof(uint32_t), 1, file);
+    somr_shard_write(&should_orient, sizeof(uint8_t), 1, file);
+    somr_shard_write(counts, sizeof(uint32_t), 4, file);
+    somr_map_write(job->map, file);
+    somr_shard_write_dataset(&job->dataset, labels_map, classes_count, file);
+    if (fflush(file) != 0 || ferror(file)) {
+        fprintf(stderr, "Error writing shard job\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/** @return true if labels of units of @p m and its child maps are empty or below @p classes_count */
+static bool somr_shard_has_valid_labels(somr_map_t *m, unsigned int classes_count) {
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        somr_unit_t *unit = &m->units[i];
+        if (unit->label != SOMR_EMPTY_LABEL && (unit->label < 0 || (unsigned int) unit->label >= classes_count)) {
+            return false;
+        }
+        if (unit->child != NULL && !somr_shard_has_valid_labels(unit->child, classes_count)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void somr_shard_run(somr_shard_t *s, somr_shard_job_t *jobs, unsigned int jobs_count, somr_trainer_settings_t *settings, somr_label_t *labels_map) {
+    if (s->workers_count == 0) {
+        fprintf(stderr, "No shard workers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // job of each worker, -1 if idle
+    int *worker_jobs = malloc(sizeof(int) * s->workers_count);
+    struct pollfd *fds = malloc(sizeof(struct pollfd) * s->workers_count);
+    for (unsigned int i = 0; i < s->workers_count; i++) {
+        worker_jobs[i] = -1;
+    }
+
+    unsigned int classes_count = (jobs_count > 0) ? somr_shard_get_classes_count(&jobs[0].dataset, labels_map) : 0;
+    unsigned int next_job = 0;
+    unsigned int done_count = 0;
+    while (done_count < jobs_count) {
+        // idle workers are waiting for a job, so sending it does not block for long
+        for (unsigned int i = 0; i < s->workers_count && next_job < jobs_count; i++) {
+            if (worker_jobs[i] < 0) {
+                somr_shard_send_job(s->outputs[i], &jobs[next_job], settings, labels_map, classes_count);
+                worker_jobs[i] = next_job;
+                next_job++;
+            }
+        }
+
+        for (unsigned int i = 0; i < s->workers_count; i++) {
+            fds[i].fd = (worker_jobs[i] >= 0) ? fileno(s->inputs[i]) : -1;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        if (poll(fds, s->workers_count, -1) < 0) {
+            fprintf(stderr, "Error waiting for shard workers\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // a worker starts writing its result once its job is trained, and the map is read as it comes
+        for (unsigned int i = 0; i < s->workers_count; i++) {
+            if (worker_jobs[i] < 0 || fds[i].revents == 0) {
+                continue;
+            }
+            // a worker that failed closes its connection without a result
+            int c = fgetc(s->inputs[i]);
+            if (c == EOF || ungetc(c, s->inputs[i]) == EOF) {
+                fprintf(stderr, "Error reading shard result\n");
+                exit(EXIT_FAILURE);
+            }
+            somr_map_t *map = jobs[worker_jobs[i]].map;
+            somr_metric_t metric = map->metric;
+            unsigned int features_count = map->features_count;
+            somr_map_clear(map);
+            somr_map_init_from_binary_file(map, s->inputs[i], features_count);
+            if (!somr_shard_has_valid_labels(map, classes_count)) {
+                fprintf(stderr, "Invalid shard result\n");
+                exit(EXIT_FAILURE);
+            }
+            somr_map_set_metric(map, metric);
+            somr_map_build_indexes(map);
+            worker_jobs[i] = -1;
+            done_count++;
+        }
+    }
+
+    free(worker_jobs);
+    free(fds);
+}
+
+/** @return false if @p input was closed before a new job */
+static bool somr_shard_serve_job(FILE *input, FILE *output) {
+    char magic[SOMR_SHARD_MAGIC_LENGTH];
+    size_t magic_length = fread(magic, 1, SOMR_SHARD_MAGIC_LENGTH, input);
+    if (magic_length == 0 && feof(input)) {
+        return false;
+    }
+    if (magic_length != SOMR_SHARD_MAGIC_LENGTH || memcmp(magic, SOMR_SHARD_MAGIC, SOMR_SHARD_MAGIC_LENGTH) != 0) {
+        fprintf(stderr, "Invalid shard job header\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t header[2];
+    somr_shard_read(header, sizeof(uint32_t), 2, input);
+    if (header[0] == 0 || header[1] >= SOMR_METRICS_COUNT) {
+        fprintf(stderr, "Invalid shard job header\n");
+        exit(EXIT_FAILURE);
+    }
+    unsigned int features_count = header[0];
+    double doubles[8];
+    somr_shard_read(doubles, sizeof(double), 8, input);
+    uint32_t iters_count;
+    uint8_t should_orient;
+    uint32_t counts[4];
+    somr_shard_read(&iters_count, sizeof(uint32_t), 1, input);
+    somr_shard_read(&should_orient, sizeof(uint8_t), 1, input);
+    somr_shard_read(counts, sizeof(uint32_t), 4, input);
+
+    somr_trainer_settings_t settings;
+    somr_trainer_settings_init(&settings, doubles[0], doubles[1], doubles[2], iters_count, should_orient, counts[0]);
+    settings.convergence_tolerance = doubles[3];
+    settings.early_spread_ratio = doubles[4];
+    settings.error_confidence = doubles[5];
+    settings.samples_per_unit = counts[1];
+    settings.max_insertions = counts[2];
+    settings.full_pass_period = counts[3];
+    settings.metric = header[1];
+
+    somr_map_t map;
+    somr_map_init_from_binary_file(&map, input, features_count);
+    somr_map_set_metric(&map, header[1]);
+    somr_dataset_t dataset;
+    somr_shard_read_dataset(&dataset, features_count, input);
+
+    somr_trainer_t trainer;
+    somr_trainer_init(&trainer, &map, &dataset, doubles[6], doubles[7], &settings);
+    somr_trainer_train(&trainer);
+
+    somr_map_write(&map, output);
+    if (fflush(output) != 0 || ferror(output)) {
+        fprintf(stderr, "Error writing shard result\n");
+        exit(EXIT_FAILURE);
+    }
+    somr_map_clear(&map);
+    somr_dataset_clear(&dataset);
+    return true;
+}
+
+void somr_shard_serve(FILE *input, FILE *output) {
+    while (somr_shard_serve_job(input, output)) {
+    }
+    fclose(input);
+    fclose(output);
+}
+
+void somr_shard_listen(char *host, char *port) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    // workers run jobs of any coordinator that connects, so they are only reachable from other hosts on request
+    if (host == NULL) {
+        host = "127.0.0.1";
+    }
+    struct addrinfo *addresses;
+    if (getaddrinfo(host, port, &hints, &addresses) != 0) {
+        fprintf(stderr, "Invalid address %s:%s\n", host, port);
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = -1;
+    int reuse = 1;
+    for (struct addrinfo *address = addresses; address != NULL && fd < 0; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(int)) != 0
+            || bind(fd, address->ai_addr, address->ai_addrlen) != 0 || listen(fd, 16) != 0)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        fprintf(stderr, "Could not listen on %s:%s\n", host, port);
+        exit(EXIT_FAILURE);
+    }
+
+    while (true) {
+        int connection_fd = accept(fd, NULL, NULL);
+        // reap workers of closed connections
+        while (waitpid(-1, NULL, WNOHANG) > 0) {
+        }
+        if (connection_fd < 0) {
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fd);
+            somr_shard_serve(fdopen(connection_fd, "rb"), fdopen(dup(connection_fd), "wb"));
+            _exit(EXIT_SUCCESS);
+        }
+        close(connection_fd);
+    }
+}
@@ -0,0 +1,122 @@
+#include "stats.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *SOMR_PHASE_NAMES[] = { "epoch", "error", "spread", "deepen", "label" };
+
+static void somr_counters_add(somr_counters_t *dest, somr_counters_t *src);
+static void somr_counters_write_json(somr_counters_t *c, FILE *file, char *indent);
+
+void somr_stats_init(somr_stats_t *s) {
+#ifdef SOMR_STATS
+    s->enabled = true;
+#else
+    s->enabled = false;
+#endif
+    memset(&s->total, 0, sizeof(somr_counters_t));
+    s->maps = NULL;
+    s->maps_count = 0;
+    s->maps_capacity = 0;
+    s->pending_children_count = 0;
+}
+
+void somr_stats_clear(somr_stats_t *s) {
+    free(s->maps);
+    s->maps = NULL;
+    s->maps_count = 0;
+    s->maps_capacity = 0;
+}
+
+void somr_stats_reset(somr_stats_t *s) {
+    memset(&s->total, 0, sizeof(somr_counters_t));
+    s->maps_count = 0;
+    s->pending_children_count = 0;
+}
+
+unsigned int somr_stats_add_map(somr_stats_t *s, int parent_index, unsigned int parent_unit_id, unsigned int dataset_size) {
+    assert(parent_index < (int) s->maps_count);
+
+    if (s->maps_count == s->maps_capacity) {
+        s->maps_capacity = (s->maps_capacity == 0) ? 16 : s->maps_capacity * 2;
+        s->maps = realloc(s->maps, sizeof(somr_map_stats_t) * s->maps_capacity);
+    }
+
+    somr_map_stats_t *map_stats = &s->maps[s->maps_count];
+    memset(map_stats, 0, sizeof(somr_map_stats_t));
+    map_stats->parent_index = parent_index;
+    map_stats->parent_unit_id = parent_unit_id;
+    map_stats->depth = (parent_index < 0) ? 1 : s->maps[parent_index].depth + 1;
+    map_stats->dataset_size = dataset_size;
+
+    unsigned int index = s->maps_count;
+    s->maps_count++;
+    return index;
+}
+
+void somr_stats_compute_total(somr_stats_t *s) {
+    memset(&s->total, 0, sizeof(somr_counters_t));
+    for (unsigned int i = 0; i < s->maps_count; i++) {
+        somr_counters_add(&s->total, &s->maps[i].counters);
+    }
+}
+
+char *somr_phase_get_name(somr_phase_t phase) {
+    assert(phase < SOMR_PHASES_COUNT);
+    return SOMR_PHASE_NAMES[phase];
+}
+
+void somr_stats_write_json(somr_stats_t *s, FILE *file) {
+    fprintf(file, "{\n  \"enabled\": %s,\n  \"maps_count\": %u,\n  \"pending_children\": %u,\n  \"total\": ",
+        s->enabled ? "true" : "false", s->maps_count, s->pending_children_count);
+    somr_counters_write_json(&s->total, file, "  ");
+    fprintf(file, ",\n  \"maps\": [");
+    for (unsigned int i = 0; i < s->maps_count; i++) {
+        somr_map_stats_t *m = &s->maps[i];
+        fprintf(file, "%s\n    {\n", (i == 0) ? "" : ",");
+        fprintf(file, "      \"parent\": %d,\n      \"parent_unit\": %u,\n      \"depth\": %u,\n", m->parent_index, m->parent_unit_id, m->depth);
+        fprintf(file, "      \"width\": %u,\n      \"height\": %u,\n      \"dataset_size\": %u,\n", m->width, m->height, m->dataset_size);
+        fprintf(file, "      \"counters\": ");
+        somr_counters_write_json(&m->counters, file, "      ");
+        fprintf(file, "\n    }");
+    }
+    fprintf(file, "%s]\n}\n", (s->maps_count == 0) ? "" : "\n  ");
+}
+
+static void somr_counters_add(somr_counters_t *dest, somr_counters_t *src) {
+    dest->epochs_count += src->epochs_count;
+    dest->bmu_searches_count += src->bmu_searches_count;
+    dest->dist_evals_count += src->dist_evals_count;
+    dest->nbhd_updates_count += src->nbhd_updates_count;
+    dest->row_spreads_count += src->row_spreads_count;
+    dest->col_spreads_count += src->col_spreads_count;
+    dest->children_count += src->children_count;
+    dest->dataset_bytes += src->dataset_bytes;
+    for (unsigned int i = 0; i < SOMR_PHASES_COUNT; i++) {
+        dest->wall_time[i] += src->wall_time[i];
+        dest->cpu_time[i] += src->cpu_time[i];
+    }
+}
+
+static void somr_counters_write_json(somr_counters_t *c, FILE *file, char *indent) {
+    fprintf(file, "{\n");
+    fprintf(file, "%s  \"epochs\": %llu,\n", indent, c->epochs_count);
+    fprintf(file, "%s  \"bmu_searches\": %llu,\n", indent, c->bmu_searches_count);
+    fprintf(file, "%s  \"dist_evals\": %llu,\n", indent, c->dist_evals_count);
+    fprintf(file, "%s  \"nbhd_updates\": %llu,\n", indent, c->nbhd_updates_count);
+    fprintf(file, "%s  \"row_spreads\": %llu,\n", indent, c->row_spreads_count);
+    fprintf(file, "%s  \"col_spreads\": %llu,\n", indent, c->col_spreads_count);
+    fprintf(file, "%s  \"children\": %llu,\n", indent, c->children_count);
+    fprintf(file, "%s  \"dataset_bytes\": %llu,\n", indent, c->dataset_bytes);
+
+    char *time_names[] = { "wall_time", "cpu_time" };
+    double *times[] = { c->wall_time, c->cpu_time };
+    for (unsigned int i = 0; i < 2; i++) {
+        fprintf(file, "%s  \"%s\": {", indent, time_names[i]);
+        for (unsigned int j = 0; j < SOMR_PHASES_COUNT; j++) {
+            fprintf(file, "%s\"%s\": %.9f", (j == 0) ? " " : ", ", SOMR_PHASE_NAMES[j], times[i][j]);
+        }
+        fprintf(file, " }%s\n", (i == 0) ? "," : "");
+    }
+    fprintf(file, "%s}", indent);
+}
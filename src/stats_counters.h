@@ -0,0 +1,59 @@
+#pragma once
+#include "stats.h"
+#include <time.h>
+
+/**
+Counters and timers are only compiled in when SOMR_STATS is defined (STATS=1 in Makefile),
+otherwise all macros expand to nothing and their arguments are not evaluated.
+@p counters may be NULL when stats are not requested.
+*/
+#ifdef SOMR_STATS
+
+typedef struct somr_timer_t {
+    double wall_time;
+    double cpu_time;
+} somr_timer_t;
+
+static inline double somr_timer_read_clock(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline somr_timer_t somr_timer_start(void) {
+    somr_timer_t timer = {
+        somr_timer_read_clock(CLOCK_MONOTONIC),
+        somr_timer_read_clock(CLOCK_THREAD_CPUTIME_ID)
+    };
+    return timer;
+}
+
+static inline void somr_timer_add_to(somr_timer_t *timer, somr_counters_t *counters, somr_phase_t phase) {
+    counters->wall_time[phase] += somr_timer_read_clock(CLOCK_MONOTONIC) - timer->wall_time;
+    counters->cpu_time[phase] += somr_timer_read_clock(CLOCK_THREAD_CPUTIME_ID) - timer->cpu_time;
+}
+
+#define SOMR_STATS_COUNT(counters, field, n) \
+    do {                                     \
+        somr_counters_t *c_ = (counters);    \
+        if (c_ != NULL) {                    \
+            c_->field += (n);                \
+        }                                    \
+    } while (0)
+#define SOMR_STATS_TIMER_BEGIN(timer) somr_timer_t timer = somr_timer_start()
+#define SOMR_STATS_TIMER_END(timer, counters, phase) \
+    do {                                             \
+        somr_counters_t *c_ = (counters);            \
+        if (c_ != NULL) {                            \
+            somr_timer_add_to(&(timer), c_, phase);  \
+        }                                            \
+    } while (0)
+
+#else
+
+// sizeof keeps arguments "used" for the compiler without evaluating them
+#define SOMR_STATS_COUNT(counters, field, n) ((void) sizeof((counters)->field += (n)))
+#define SOMR_STATS_TIMER_BEGIN(timer) ((void) 0)
+#define SOMR_STATS_TIMER_END(timer, counters, phase) ((void) sizeof(counters))
+
+#endif
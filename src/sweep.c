@@ -0,0 +1,221 @@
+#define _GNU_SOURCE // for sysconf
+#include "sweep.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** state shared by sweep threads, under @p mutex */
+typedef struct somr_sweep_pool_t {
+    somr_sweep_t *sweep;
+    unsigned int next_run;
+    /** memory estimated for running trainings */
+    size_t reserved_memory;
+    /** highest peak bytes of trainings so far */
+    size_t max_peak_bytes;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} somr_sweep_pool_t;
+
+static void *somr_sweep_worker(void *arg);
+static size_t somr_sweep_estimate_memory(somr_sweep_pool_t *p);
+static void somr_sweep_train(somr_sweep_t *s, somr_sweep_run_t *run);
+static void somr_sweep_measure_map(somr_map_t *m, somr_sweep_result_t *result);
+static double somr_sweep_read_clock(void);
+
+void somr_sweep_init(somr_sweep_t *s, somr_dataset_t *dataset, unsigned int threads_count, size_t max_memory) {
+    s->dataset = dataset;
+    s->runs = NULL;
+    s->runs_count = 0;
+    s->runs_capacity = 0;
+    if (threads_count == 0) {
+        long cpus_count = sysconf(_SC_NPROCESSORS_ONLN);
+        threads_count = (cpus_count > 0) ? (unsigned int) cpus_count : 1;
+    }
+    s->threads_count = threads_count;
+    s->max_memory = max_memory;
+}
+
+void somr_sweep_clear(somr_sweep_t *s) {
+    free(s->runs);
+    s->runs = NULL;
+    s->runs_count = 0;
+    s->runs_capacity = 0;
+}
+
+void somr_sweep_add(somr_sweep_t *s, somr_trainer_settings_t *settings) {
+    if (s->runs_count == s->runs_capacity) {
+        s->runs_capacity = (s->runs_capacity == 0) ? 16 : s->runs_capacity * 2;
+        s->runs = realloc(s->runs, sizeof(somr_sweep_run_t) * s->runs_capacity);
+    }
+    somr_sweep_run_t *run = &s->runs[s->runs_count];
+    s->runs_count++;
+    run->settings = *settings;
+    // networks keep their own stats, and trainings only share the data set
+    run->settings.stats = NULL;
+    run->settings.checkpoint = NULL;
+    run->settings.trace = NULL;
+    run->settings.shard = NULL;
+    run->settings.memory = NULL;
+    memset(&run->result, 0, sizeof(somr_sweep_result_t));
+}
+
+void somr_sweep_run(somr_sweep_t *s) {
+    somr_sweep_pool_t p;
+    p.sweep = s;
+    p.next_run = 0;
+    p.reserved_memory = 0;
+    p.max_peak_bytes = 0;
+    pthread_mutex_init(&p.mutex, NULL);
+    pthread_cond_init(&p.cond, NULL);
+
+    // calling thread is one of the workers
+    unsigned int threads_count = (s->threads_count < s->runs_count) ? s->threads_count : s->runs_count;
+    pthread_t *threads = malloc(sizeof(pthread_t) * s->threads_count);
+    unsigned int started_count = 0;
+    for (unsigned int i = 1; i < threads_count; i++) {
+        if (pthread_create(&threads[started_count], NULL, somr_sweep_worker, &p) != 0) {
+            break;
+        }
+        started_count++;
+    }
+    somr_sweep_worker(&p);
+    for (unsigned int i = 0; i < started_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    pthread_mutex_destroy(&p.mutex);
+    pthread_cond_destroy(&p.cond);
+}
+
+static void *somr_sweep_worker(void *arg) {
+    somr_sweep_pool_t *p = arg;
+    somr_sweep_t *s = p->sweep;
+    pthread_mutex_lock(&p->mutex);
+    while (p->next_run < s->runs_count) {
+        // a training always runs when no other does, even if its estimate exceeds the limit
+        size_t memory = somr_sweep_estimate_memory(p);
+        if (s->max_memory > 0 && p->reserved_memory > 0 && p->reserved_memory + memory > s->max_memory) {
+            pthread_cond_wait(&p->cond, &p->mutex);
+            continue;
+        }
+        somr_sweep_run_t *run = &s->runs[p->next_run];
+        p->next_run++;
+        p->reserved_memory += memory;
+        pthread_mutex_unlock(&p->mutex);
+
+        somr_sweep_train(s, run);
+
+        pthread_mutex_lock(&p->mutex);
+        p->reserved_memory -= memory;
+        if (run->result.peak_bytes > p->max_peak_bytes) {
+            p->max_peak_bytes = run->result.peak_bytes;
+        }
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return NULL;
+}
+
+/**
+@return estimated peak memory of a training: highest peak accounted so far, or before the first one indices of its
+data set, bmus cached by the trainers of a map and its ancestors and grouped for child maps (counted twice for the
+whole data set), and a network of a unit per input vector
+*/
+static size_t somr_sweep_estimate_memory(somr_sweep_pool_t *p) {
+    if (p->max_peak_bytes > 0) {
+        return p->max_peak_bytes;
+    }
+    somr_dataset_t *d = p->sweep->dataset;
+    size_t memory = d->size * (sizeof(unsigned int) + 2 * sizeof(somr_bmu_cache_entry_t) + 2 * sizeof(somr_unit_id_t));
+    return memory + d->size * (sizeof(somr_unit_t) + sizeof(double) * d->features_count);
+}
+
+static void somr_sweep_train(somr_sweep_t *s, somr_sweep_run_t *run) {
+    somr_dataset_t dataset;
+    somr_dataset_init_shared(&dataset, s->dataset);
+    somr_network_t network;
+    somr_network_init(&network, dataset.features_count);
+
+    double start_time = somr_sweep_read_clock();
+    somr_network_train_with_settings(&network, &dataset, &run->settings);
+    run->result.train_time = somr_sweep_read_clock() - start_time;
+    run->result.epochs_count = network.stats.total.epochs_count;
+
+    // errors are measured in input data set order, not in the order of the last training pass
+    somr_sweep_result_t *result = &run->result;
+    double error_sum = 0.0;
+    result->classification_errors_count = 0;
+    for (unsigned int i = 0; i < s->dataset->size; i++) {
+        somr_data_vector_t *v = somr_dataset_get_vector(s->dataset, i);
+        somr_map_t *map = network.root.child;
+        somr_unit_t *bmu = &map->units[somr_map_find_bmu(map, v)];
+        while (bmu->child != NULL) {
+            map = bmu->child;
+            bmu = &map->units[somr_map_find_bmu(map, v)];
+        }
+        error_sum += sqrt(bmu->activation);
+        result->classification_errors_count += bmu->label != v->label;
+    }
+    result->quantization_error = error_sum / s->dataset->size;
+    somr_sweep_measure_map(network.root.child, result);
+    somr_memory_t memory;
+    somr_network_get_memory(&network, &memory);
+    result->model_bytes = memory.total;
+    result->peak_bytes = network.memory.peak;
+
+    somr_network_clear(&network);
+    somr_dataset_clear(&dataset);
+}
+
+/** adds maps and units of @p m and its child maps to @p result */
+static void somr_sweep_measure_map(somr_map_t *m, somr_sweep_result_t *result) {
+    result->maps_count++;
+    result->units_count += m->units_count;
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        if (m->units[i].child != NULL) {
+            somr_sweep_measure_map(m->units[i].child, result);
+        }
+    }
+}
+
+static double somr_sweep_read_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void somr_sweep_write_json(somr_sweep_t *s, FILE *file) {
+    fprintf(file, "[");
+    for (unsigned int i = 0; i < s->runs_count; i++) {
+        somr_trainer_settings_t *settings = &s->runs[i].settings;
+        somr_sweep_result_t *r = &s->runs[i].result;
+        fprintf(file, "%s\n  {\n", (i == 0) ? "" : ",");
+        fprintf(file, "    \"learn_rate\": %g,\n    \"spread_threshold\": %g,\n    \"depth_threshold\": %g,\n",
+            settings->learn_rate, settings->spread_threshold, settings->depth_threshold);
+        fprintf(file, "    \"iters_count\": %u,\n    \"seed\": %u,\n    \"metric\": \"%s\",\n",
+            settings->iters_count, settings->rand_state, somr_metric_get_name(settings->metric));
+        fprintf(file, "    \"quantization_error\": %.6f,\n    \"classification_errors\": %u,\n",
+            r->quantization_error, r->classification_errors_count);
+        fprintf(file, "    \"maps\": %u,\n    \"units\": %u,\n    \"model_bytes\": %zu,\n    \"peak_bytes\": %zu,\n",
+            r->maps_count, r->units_count, r->model_bytes, r->peak_bytes);
+        fprintf(file, "    \"train_time\": %.6f,\n    \"epochs\": %llu\n  }", r->train_time, r->epochs_count);
+    }
+    fprintf(file, "%s]\n", (s->runs_count == 0) ? "" : "\n");
+}
+
+void somr_sweep_write_table(somr_sweep_t *s, FILE *file) {
+    fprintf(file, "%-4s %-8s %-8s %-8s %-6s %-10s %-10s %-8s %-6s %-7s %-11s %-11s %-9s %-8s\n",
+        "run", "learn", "spread", "depth", "iters", "seed", "qe", "errors", "maps", "units", "bytes", "peak", "time_s", "epochs");
+    for (unsigned int i = 0; i < s->runs_count; i++) {
+        somr_trainer_settings_t *settings = &s->runs[i].settings;
+        somr_sweep_result_t *r = &s->runs[i].result;
+        fprintf(file, "%-4u %-8g %-8g %-8g %-6u %-10u %-10.6f %-8u %-6u %-7u %-11zu %-11zu %-9.3f %-8llu\n",
+            i, settings->learn_rate, settings->spread_threshold, settings->depth_threshold, settings->iters_count,
+            settings->rand_state, r->quantization_error, r->classification_errors_count, r->maps_count, r->units_count,
+            r->model_bytes, r->peak_bytes, r->train_time, r->epochs_count);
+    }
+}
@@ -0,0 +1,124 @@
+#include "trace.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** initial number of events of a thread buffer */
+#define SOMR_TRACE_BUFFER_CAPACITY 1024
+
+/** source of trace ids, so that buffers cached by threads for a cleared trace are never reused */
+static atomic_ulong somr_trace_next_id = 1;
+
+/** buffer of calling thread for trace of id @p somr_trace_cached_id */
+static _Thread_local somr_trace_buffer_t *somr_trace_cached_buffer = NULL;
+static _Thread_local unsigned long somr_trace_cached_id = 0;
+
+static double somr_trace_read_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void somr_trace_init(somr_trace_t *t) {
+    t->id = atomic_fetch_add(&somr_trace_next_id, 1);
+    t->start_time = somr_trace_read_clock();
+    atomic_init(&t->buffers, NULL);
+    atomic_init(&t->threads_count, 0);
+}
+
+void somr_trace_clear(somr_trace_t *t) {
+    somr_trace_buffer_t *buffer = atomic_load(&t->buffers);
+    while (buffer != NULL) {
+        somr_trace_buffer_t *next = buffer->next;
+        for (unsigned int i = 0; i < buffer->events_count; i++) {
+            free(buffer->events[i].path);
+        }
+        free(buffer->events);
+        free(buffer);
+        buffer = next;
+    }
+    atomic_store(&t->buffers, NULL);
+}
+
+/** @return buffer of calling thread, created and pushed to buffers of trace on first event of thread */
+static somr_trace_buffer_t *somr_trace_get_buffer(somr_trace_t *t) {
+    if (somr_trace_cached_id == t->id) {
+        return somr_trace_cached_buffer;
+    }
+
+    somr_trace_buffer_t *buffer = malloc(sizeof(somr_trace_buffer_t));
+    buffer->events = malloc(sizeof(somr_trace_event_t) * SOMR_TRACE_BUFFER_CAPACITY);
+    buffer->events_count = 0;
+    buffer->events_capacity = SOMR_TRACE_BUFFER_CAPACITY;
+    buffer->thread_index = atomic_fetch_add(&t->threads_count, 1);
+    buffer->next = atomic_load(&t->buffers);
+    while (!atomic_compare_exchange_weak(&t->buffers, &buffer->next, buffer)) {
+    }
+
+    somr_trace_cached_buffer = buffer;
+    somr_trace_cached_id = t->id;
+    return buffer;
+}
+
+static somr_trace_event_t *somr_trace_push(somr_trace_t *t, char type) {
+    somr_trace_buffer_t *buffer = somr_trace_get_buffer(t);
+    if (buffer->events_count == buffer->events_capacity) {
+        buffer->events_capacity *= 2;
+        buffer->events = realloc(buffer->events, sizeof(somr_trace_event_t) * buffer->events_capacity);
+    }
+    somr_trace_event_t *event = &buffer->events[buffer->events_count];
+    buffer->events_count++;
+    event->type = type;
+    event->name = NULL;
+    event->path = NULL;
+    event->timestamp = (somr_trace_read_clock() - t->start_time) * 1e6;
+    event->dataset_size = 0;
+    event->width = 0;
+    event->height = 0;
+    return event;
+}
+
+void somr_trace_begin(somr_trace_t *t, const char *name, char *path, unsigned int dataset_size) {
+    assert(name != NULL);
+    somr_trace_event_t *event = somr_trace_push(t, 'B');
+    event->name = name;
+    if (path != NULL) {
+        size_t size = strlen(path) + 1;
+        event->path = malloc(size);
+        memcpy(event->path, path, size);
+    }
+    event->dataset_size = dataset_size;
+}
+
+void somr_trace_end(somr_trace_t *t, unsigned int width, unsigned int height) {
+    somr_trace_event_t *event = somr_trace_push(t, 'E');
+    event->width = width;
+    event->height = height;
+}
+
+void somr_trace_write_json(somr_trace_t *t, FILE *file) {
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    bool is_first = true;
+    for (somr_trace_buffer_t *buffer = atomic_load(&t->buffers); buffer != NULL; buffer = buffer->next) {
+        fprintf(file, "%s\n{\"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"name\": \"thread_name\", \"args\": {\"name\": \"thread %u\"}}",
+            is_first ? "" : ",", buffer->thread_index, buffer->thread_index);
+        is_first = false;
+
+        for (unsigned int i = 0; i < buffer->events_count; i++) {
+            somr_trace_event_t *event = &buffer->events[i];
+            fprintf(file, ",\n{\"ph\": \"%c\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f", event->type, buffer->thread_index, event->timestamp);
+            if (event->type == 'B' && event->path != NULL) {
+                fprintf(file, ", \"name\": \"%s %s\", \"args\": {\"path\": \"%s\", \"dataset_size\": %u}", event->name, event->path, event->path, event->dataset_size);
+            } else if (event->type == 'B') {
+                fprintf(file, ", \"name\": \"%s\"", event->name);
+            } else if (event->width > 0) {
+                // arguments of end events are merged into those of their span
+                fprintf(file, ", \"args\": {\"width\": %u, \"height\": %u}", event->width, event->height);
+            }
+            fprintf(file, "}");
+        }
+    }
+    fprintf(file, "\n]}\n");
+}
@@ -1,16 +1,117 @@
 #define _GNU_SOURCE // for rand_r
 #include "trainer.h"
 #include "map_grow.h"
+#include "shard.h"
+#include "stats_counters.h"
 #include "vector.h"
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-static somr_unit_id_t somr_trainer_compute_error(somr_trainer_t *t);
-static void somr_trainer_spread(somr_trainer_t *t, somr_unit_id_t error_unit_id);
+/** minimum number of epochs per pass when schedule is accelerated */
+#define SOMR_TRAINER_MIN_EPOCHS 4
+/** minimum number of sampled vectors mapped to a unit for its error estimate to be trusted */
+#define SOMR_TRAINER_MIN_UNIT_SAMPLES 8
+/** input vectors whose bmu is at most this number of rows or columns away from an insertion are used to fine-tune it */
+#define SOMR_TRAINER_FINE_TUNE_MARGIN 1
+/** initial neighborhood radius of fine-tuning */
+#define SOMR_TRAINER_FINE_TUNE_RADIUS 1.0
+/** initial neighborhood radius of updates with new input vectors, small so that units without new vectors barely move */
+#define SOMR_TRAINER_UPDATE_RADIUS 0.5
+
+/** map trained by best-first growth, kept until the whole network is labelled */
+typedef struct somr_growth_node_t {
+    somr_trainer_t trainer;
+    /** data set of child map, subrange of the data set of its parent map (unused for top map) */
+    somr_dataset_t dataset;
+    /** ranges of input vectors mapped to each unit (see somr_trainer_group_by_bmu), NULL if no unit is above threshold */
+    unsigned int *offsets;
+} somr_growth_node_t;
+
+/** unit above depth threshold, to be given a child map by best-first growth */
+typedef struct somr_growth_candidate_t {
+    double error;
+    unsigned int node_index;
+    somr_unit_id_t unit_id;
+} somr_growth_candidate_t;
+
+/** state of best-first growth: maps trained so far, in training order, and max-heap of their units to expand by error */
+typedef struct somr_growth_t {
+    somr_growth_node_t **nodes;
+    unsigned int nodes_count;
+    unsigned int nodes_capacity;
+    somr_growth_candidate_t *candidates;
+    unsigned int candidates_count;
+    unsigned int candidates_capacity;
+    /** monotonic clock when growth started, in seconds */
+    double start_time;
+    /** distance evaluations of maps trained so far */
+    unsigned long long dist_evals_count;
+} somr_growth_t;
+
+static void somr_trainer_grow(somr_trainer_t *t);
+static unsigned int *somr_trainer_group_by_bmu(somr_trainer_t *t);
 static void somr_trainer_deepen(somr_trainer_t *t);
-static void somr_trainer_run_epoch(somr_trainer_t *t, double radius, double learn_rate);
+static void somr_trainer_reset_schedule(somr_trainer_t *t, bool should_reset_progress);
+static bool somr_trainer_run_schedule(somr_trainer_t *t, double radius, double error_threshold, bool allow_early_spread);
+static void somr_trainer_restore(somr_trainer_t *t);
+static somr_counters_t *somr_trainer_get_counters(somr_trainer_t *t);
+static unsigned int somr_trainer_get_sample_size(somr_trainer_t *t);
+static bool somr_trainer_estimate_error(somr_trainer_t *t, unsigned int sample_size, somr_unit_id_t *error_unit_id);
+static void somr_trainer_find_max_error(somr_trainer_t *t, somr_unit_id_t *error_unit_id);
+static unsigned int somr_trainer_get_insertions_count(somr_trainer_t *t, double error_threshold);
+static void somr_trainer_add_insertion(somr_trainer_t *t, bool is_row, unsigned int before);
+static void somr_trainer_fine_tune(somr_trainer_t *t);
+static unsigned int somr_trainer_find_insertion(somr_trainer_t *t, somr_unit_id_t error_unit_id, bool *is_row);
+static double *somr_trainer_split_errors(somr_trainer_t *t, double *errors, bool is_row, unsigned int before);
+static void somr_trainer_update_children(somr_trainer_t *t);
+static void somr_trainer_fill_empty_labels(somr_map_t *m, somr_label_t label);
+static void somr_trainer_prepare_map(somr_trainer_t *t);
+static void somr_trainer_trace_begin(somr_trainer_t *t, somr_phase_t phase);
+static void somr_trainer_trace_end(somr_trainer_t *t);
+static void somr_trainer_trace_map_begin(somr_trainer_t *t);
+static void somr_trainer_label_parents(somr_trainer_t *t, unsigned int *offsets, bool should_merge);
+static unsigned int somr_trainer_get_depth(somr_trainer_t *t);
+static void somr_trainer_deepen_sharded(somr_trainer_t *t, unsigned int *offsets, double error_threshold);
+static void somr_trainer_account_map(somr_trainer_t *t);
+static void somr_trainer_account_subtree(somr_trainer_t *t, somr_map_t *map, bool is_added);
+static void somr_trainer_account_scratch(somr_trainer_t *t, size_t bytes, bool is_allocated);
+static unsigned int somr_trainer_fit_insertions(somr_trainer_t *t, unsigned int insertions_count);
+static bool somr_trainer_fit_child(somr_trainer_t *t);
+static void somr_growth_expand(somr_growth_t *g, somr_growth_node_t *node);
+static bool somr_growth_is_before(somr_growth_candidate_t *a, somr_growth_candidate_t *b);
+static void somr_growth_push(somr_growth_t *g, somr_growth_candidate_t candidate);
+static somr_growth_candidate_t somr_growth_pop(somr_growth_t *g);
+static bool somr_growth_is_over(somr_growth_t *g, somr_trainer_settings_t *settings);
+static double somr_growth_read_clock(void);
+
+void somr_trainer_settings_init(somr_trainer_settings_t *s, double learn_rate, double spread_threshold, double depth_threshold,
+    unsigned int iters_count, bool should_orient, unsigned int seed) {
+    s->learn_rate = learn_rate;
+    s->spread_threshold = spread_threshold;
+    s->depth_threshold = depth_threshold;
+    s->iters_count = iters_count;
+    s->should_orient = should_orient;
+    s->rand_state = seed;
+    s->stats = NULL;
+    s->convergence_tolerance = 0.0;
+    s->early_spread_ratio = 0.0;
+    s->samples_per_unit = 0;
+    s->error_confidence = 3.0;
+    s->max_insertions = 1;
+    s->full_pass_period = 0;
+    s->metric = SOMR_METRIC_EUCLID;
+    s->checkpoint = NULL;
+    s->trace = NULL;
+    s->shard = NULL;
+    s->memory_budget = 0;
+    s->memory = NULL;
+    s->is_best_first = false;
+    s->time_budget = 0.0;
+    s->dist_evals_budget = 0;
+}
 
 void somr_trainer_init(somr_trainer_t *t, somr_map_t *map, somr_dataset_t *dataset, double root_mean_error, double parent_mean_error, somr_trainer_settings_t *settings) {
     assert(map->features_count == dataset->features_count);
@@ -20,6 +121,7 @@ void somr_trainer_init(somr_trainer_t *t, somr_map_t *map, somr_dataset_t *datas
     assert(settings->spread_threshold >= 0.0 && settings->spread_threshold <= 1.0);
     assert(settings->depth_threshold >= 0.0 && settings->depth_threshold <= 1.0);
     assert(settings->iters_count > 0);
+    assert(settings->error_confidence >= 0.0);
     //assert(dataset->size >= map->units_count);
 
     t->map = map;
@@ -28,57 +130,493 @@ void somr_trainer_init(somr_trainer_t *t, somr_map_t *map, somr_dataset_t *datas
     t->parent_mean_error = parent_mean_error;
     t->features_count = map->features_count;
     t->settings = settings;
+    t->stats_index = -1;
+    t->bmu_cache = NULL;
+    t->bmu_cache_count = 0;
+    t->bmu_cache_width = 0;
+    t->insertions = NULL;
+    t->insertions_count = 0;
+    t->insertions_capacity = 0;
+    t->labels_map = NULL;
+    t->parent = NULL;
+    t->parent_unit_id = 0;
+    t->is_deepening = false;
+    t->deepen_unit_id = 0;
+    t->spreads_count = 0;
+    t->was_fine_tuned = false;
+    t->schedule_index = 0;
+    somr_trainer_reset_schedule(t, true);
+    t->resume_frames = NULL;
+    t->resume_frames_count = 0;
+    // map is accounted as it is, trainer only accounts its changes
+    memset(t->map_bytes, 0, sizeof(t->map_bytes));
+    somr_memory_measure_map(map, t->map_bytes, false);
+}
+
+/** restores training loop state and data set order of map from first resume frame */
+static void somr_trainer_restore(somr_trainer_t *t) {
+    assert(t->resume_frames != NULL && t->resume_frames_count > 0);
+    somr_checkpoint_frame_t *frame = &t->resume_frames[0];
+    if (frame->dataset_size != t->dataset->size) {
+        fprintf(stderr, "Checkpoint does not match input data\n");
+        exit(EXIT_FAILURE);
+    }
+    // indices of child data sets are checked when their parent data set is restored
+    for (unsigned int i = 0; i < frame->dataset_size && !t->dataset->has_parent; i++) {
+        if (frame->indices[i] >= t->dataset->size) {
+            fprintf(stderr, "Checkpoint does not match input data\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(t->dataset->indices, frame->indices, sizeof(unsigned int) * frame->dataset_size);
+
+    t->is_deepening = frame->is_deepening;
+    t->deepen_unit_id = frame->deepen_unit_id;
+    t->spreads_count = frame->spreads_count;
+    t->was_fine_tuned = frame->was_fine_tuned;
+    t->schedule_index = frame->schedule_index;
+    t->schedule.progress = frame->progress;
+    t->schedule.epoch_index = frame->schedule_epoch_index;
+    t->schedule.step = frame->step;
+    t->schedule.previous_error = frame->previous_error;
+    t->schedule.epochs_count = frame->schedule_epochs_count;
+}
+
+/** @return counters of trained map, NULL if stats are not requested
+(pointer must not be kept across child maps training, as stats entries may be reallocated) */
+static somr_counters_t *somr_trainer_get_counters(somr_trainer_t *t) {
+    if (t->settings->stats == NULL || t->stats_index < 0) {
+        return NULL;
+    }
+    return &t->settings->stats->maps[t->stats_index].counters;
+}
+
+/** opens trace span of @p phase, if a trace is requested */
+static void somr_trainer_trace_begin(somr_trainer_t *t, somr_phase_t phase) {
+    if (t->settings->trace != NULL) {
+        somr_trace_begin(t->settings->trace, somr_phase_get_name(phase), NULL, 0);
+    }
+}
+
+static void somr_trainer_trace_end(somr_trainer_t *t) {
+    if (t->settings->trace != NULL) {
+        somr_trace_end(t->settings->trace, 0, 0);
+    }
+}
+
+/** opens trace span of map, tagged with its path in the tree (ids of parent units from top map, "/" for top map) */
+static void somr_trainer_trace_map_begin(somr_trainer_t *t) {
+    if (t->settings->trace == NULL) {
+        return;
+    }
+    unsigned int depth = 0;
+    for (somr_trainer_t *trainer = t; trainer->parent != NULL; trainer = trainer->parent) {
+        depth++;
+    }
+    // path is written backwards from the end of buffer, with up to 10 digits and a separator per level
+    unsigned int capacity = depth * 11 + 2;
+    char *path = malloc(capacity);
+    unsigned int begin = capacity - 1;
+    path[begin] = '\0';
+    for (somr_trainer_t *trainer = t; trainer->parent != NULL; trainer = trainer->parent) {
+        char id[12];
+        int id_length = snprintf(id, sizeof(id), "/%u", trainer->parent_unit_id);
+        begin -= id_length;
+        memcpy(&path[begin], id, id_length);
+    }
+    if (depth == 0) {
+        begin--;
+        path[begin] = '/';
+    }
+    somr_trace_begin(t->settings->trace, "map", &path[begin], t->dataset->size);
+    free(path);
+}
+
+/** @return number of input vectors to use per epoch, proportional to number of units of map */
+static unsigned int somr_trainer_get_sample_size(somr_trainer_t *t) {
+    unsigned long long size = (unsigned long long) t->settings->samples_per_unit * t->map->units_count;
+    if (t->settings->samples_per_unit == 0 || size >= t->dataset->size) {
+        return t->dataset->size;
+    }
+    return (unsigned int) size;
 }
 
 void somr_trainer_train(somr_trainer_t *t) {
+    somr_trainer_trace_map_begin(t);
+    somr_trainer_grow(t);
+    somr_trainer_deepen(t);
+    somr_trainer_label(t);
+    somr_trainer_account_map(t);
+
+    if (t->settings->trace != NULL) {
+        somr_trace_end(t->settings->trace, t->map->width, t->map->height);
+    }
+}
+
+/** trains map and spreads it until its error is below spread threshold (or its growth does not fit in memory budget) */
+static void somr_trainer_grow(somr_trainer_t *t) {
     double error_threshold = t->settings->spread_threshold * t->parent_mean_error;
+    bool should_fine_tune = t->settings->full_pass_period > 1;
+    if (should_fine_tune) {
+        t->bmu_cache = malloc(sizeof(somr_bmu_cache_entry_t) * t->dataset->size);
+        somr_trainer_account_scratch(t, sizeof(somr_bmu_cache_entry_t) * t->dataset->size, true);
+    }
 
-    while (true) {
-        // TODO check best radius formula
-        double radius = sqrt(t->map->units_count) / 2;
-        //double radius = floor((sqrt(t->map->units_count / 2.0) - 1.0) / 2.0);
-        //double radius = sqrt(t->map->units_count) + 1;
-        for (unsigned int i = 0; i < t->settings->iters_count; i++) {
-            // linear decay of learning factor and radius
-            double decay = (double) i / (double) t->settings->iters_count;
+    // when resuming, map is either in the middle of a schedule, or done growing (and then deepening)
+    bool is_resuming = t->resume_frames != NULL;
+    if (is_resuming) {
+        somr_trainer_restore(t);
+    }
 
-            double decayed_learn_rate = t->settings->learn_rate * (1.0 - decay);
-            assert(decayed_learn_rate > 0.0 && decayed_learn_rate <= t->settings->learn_rate);
+    bool is_spread_refused = false;
+    while (!t->is_deepening) {
+        somr_unit_id_t error_unit_id = t->map->units_count;
+        bool is_pass_complete = false;
+        if (t->was_fine_tuned && !is_resuming) {
+            somr_trainer_fine_tune(t);
+            error_unit_id = somr_trainer_compute_error(t);
+        }
 
-            // TODO make sure radius stays >= 1 ?
-            // double decayed_radius = (double) radius - ((double) radius - 1.0) * decay;
-            // assert(decayed_radius >= 1.0 && decayed_radius <= radius);
-            double decayed_radius = (double) radius - ((double) radius) * decay;
-            assert(decayed_radius > 0.0 && decayed_radius <= radius);
+        // run full pass if map was not fine-tuned, or if it is good enough so that training ends with a full pass
+        if (!t->was_fine_tuned || is_resuming || t->map->mean_error <= error_threshold) {
+            // TODO check best radius formula
+            double radius = sqrt(t->map->units_count) / 2;
+            //double radius = floor((sqrt(t->map->units_count / 2.0) - 1.0) / 2.0);
+            //double radius = sqrt(t->map->units_count) + 1;
+            if (!is_resuming) {
+                t->schedule_index = 0;
+                somr_trainer_reset_schedule(t, true);
+            }
 
-            somr_trainer_run_epoch(t, decayed_radius, decayed_learn_rate);
+            // once no spread fits in memory budget, last pass is run to its end
+            bool stopped_early = false;
+            if (t->schedule_index == 0) {
+                stopped_early = somr_trainer_run_schedule(t, radius, error_threshold, !is_spread_refused);
+                error_unit_id = somr_trainer_compute_error(t);
+            }
+            // pass was ended early on an estimate that was wrong, finish it
+            if (t->schedule_index == 1 || (stopped_early && t->map->mean_error <= error_threshold)) {
+                if (t->schedule_index == 0) {
+                    t->schedule_index = 1;
+                    somr_trainer_reset_schedule(t, false);
+                }
+                somr_trainer_run_schedule(t, radius, error_threshold, false);
+                error_unit_id = somr_trainer_compute_error(t);
+                stopped_early = false;
+            }
+            is_pass_complete = !stopped_early;
+            is_resuming = false;
         }
 
-        somr_unit_id_t error_unit_id = somr_trainer_compute_error(t);
-        // loop until we stop spreading
-        if (t->map->mean_error > error_threshold) {
-            somr_trainer_spread(t, error_unit_id);
+        // loop until we stop spreading, or until memory budget is reached
+        if (t->map->mean_error <= error_threshold || is_spread_refused) {
+            break;
+        }
+        somr_trainer_account_map(t);
+        unsigned int insertions_count = somr_trainer_fit_insertions(t, somr_trainer_get_insertions_count(t, error_threshold));
+        if (insertions_count == 0) {
+            // map ends its growth with a complete full pass, as when its error is below threshold
+            is_spread_refused = true;
+            if (is_pass_complete) {
+                break;
+            }
+            t->was_fine_tuned = false;
+            continue;
+        }
+        if (insertions_count > 1) {
+            somr_trainer_spread_many(t, insertions_count);
         } else {
+            somr_trainer_spread(t, error_unit_id);
+        }
+        somr_trainer_account_map(t);
+        t->spreads_count++;
+        t->was_fine_tuned = should_fine_tune && t->spreads_count % t->settings->full_pass_period != 0;
+    }
+
+    if (t->bmu_cache != NULL) {
+        somr_trainer_account_scratch(t, sizeof(somr_bmu_cache_entry_t) * t->dataset->size, false);
+    }
+    free(t->bmu_cache);
+    free(t->insertions);
+    t->bmu_cache = NULL;
+    t->insertions = NULL;
+    t->insertions_count = 0;
+    t->insertions_capacity = 0;
+
+    if (t->settings->stats != NULL && t->stats_index >= 0) {
+        somr_map_stats_t *map_stats = &t->settings->stats->maps[t->stats_index];
+        map_stats->width = t->map->width;
+        map_stats->height = t->map->height;
+    }
+}
+
+void somr_trainer_train_best_first(somr_trainer_t *t) {
+    assert(t->settings->checkpoint == NULL && t->settings->shard == NULL);
+    somr_stats_t *stats = t->settings->stats;
+    if (t->settings->dist_evals_budget > 0 && (stats == NULL || !stats->enabled || t->stats_index < 0)) {
+        fprintf(stderr, "Distance evaluation budget needs training statistics (STATS=1)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    somr_growth_t g;
+    g.nodes = NULL;
+    g.nodes_count = 0;
+    g.nodes_capacity = 0;
+    g.candidates = NULL;
+    g.candidates_count = 0;
+    g.candidates_capacity = 0;
+    g.start_time = somr_growth_read_clock();
+    g.dist_evals_count = 0;
+
+    // top map is always trained, so that the network is valid whatever the budget
+    somr_growth_node_t *top = malloc(sizeof(somr_growth_node_t));
+    top->trainer = *t;
+    somr_growth_expand(&g, top);
+
+    while (g.candidates_count > 0 && !somr_growth_is_over(&g, t->settings)) {
+        somr_growth_candidate_t candidate = somr_growth_pop(&g);
+        somr_growth_node_t *node = g.nodes[candidate.node_index];
+        somr_trainer_t *parent = &node->trainer;
+        if (!somr_trainer_fit_child(parent)) {
+            continue;
+        }
+        somr_unit_id_t i = candidate.unit_id;
+        somr_unit_t *unit = &parent->map->units[i];
+        unsigned int data_vectors_count = node->offsets[i + 1] - node->offsets[i];
+        somr_map_add_child(parent->map, i, t->settings->should_orient, &t->settings->rand_state);
+        somr_trainer_account_subtree(parent, unit->child, true);
+        somr_counters_t *counters = somr_trainer_get_counters(parent);
+        SOMR_STATS_COUNT(counters, children_count, 1);
+
+        somr_growth_node_t *child = malloc(sizeof(somr_growth_node_t));
+        somr_dataset_init_from_parent(&child->dataset, parent->dataset, node->offsets[i], data_vectors_count);
+        somr_trainer_init(&child->trainer, unit->child, &child->dataset, parent->root_mean_error, unit->error, t->settings);
+        child->trainer.labels_map = parent->labels_map;
+        child->trainer.parent = parent;
+        child->trainer.parent_unit_id = i;
+        if (stats != NULL && parent->stats_index >= 0) {
+            child->trainer.stats_index = somr_stats_add_map(stats, parent->stats_index, i, data_vectors_count);
+        }
+        somr_growth_expand(&g, child);
+    }
+    if (stats != NULL) {
+        stats->pending_children_count = g.candidates_count;
+    }
+
+    // maps are labelled in reverse training order, so that child maps are labelled before the unit they are attached to
+    // (labelling shuffles the data set of a map, and with it the ranges of its units)
+    for (unsigned int i = g.nodes_count; i-- > 0;) {
+        somr_growth_node_t *node = g.nodes[i];
+        if (node->offsets != NULL) {
+            somr_trainer_label_parents(&node->trainer, node->offsets, false);
+            somr_trainer_account_scratch(&node->trainer, sizeof(unsigned int) * (node->trainer.map->units_count + 1), false);
+            free(node->offsets);
+        }
+        somr_trainer_label(&node->trainer);
+        somr_trainer_account_map(&node->trainer);
+        if (i > 0) {
+            somr_dataset_clear(&node->dataset);
+        }
+    }
+
+    *t = top->trainer;
+    for (unsigned int i = 0; i < g.nodes_count; i++) {
+        free(g.nodes[i]);
+    }
+    free(g.nodes);
+    free(g.candidates);
+}
+
+/** grows map of @p node and adds it to @p g, along with its units above depth threshold */
+static void somr_growth_expand(somr_growth_t *g, somr_growth_node_t *node) {
+    somr_trainer_t *t = &node->trainer;
+    somr_trainer_trace_map_begin(t);
+    somr_trainer_grow(t);
+    somr_trainer_prepare_map(t);
+    somr_map_build_index(t->map);
+    somr_trainer_account_map(t);
+
+    if (g->nodes_count == g->nodes_capacity) {
+        g->nodes_capacity = (g->nodes_capacity == 0) ? 16 : g->nodes_capacity * 2;
+        g->nodes = realloc(g->nodes, sizeof(somr_growth_node_t *) * g->nodes_capacity);
+    }
+    unsigned int node_index = g->nodes_count;
+    g->nodes[node_index] = node;
+    g->nodes_count++;
+
+    double error_threshold = t->root_mean_error * t->settings->depth_threshold;
+    bool has_children = false;
+    for (somr_unit_id_t i = 0; i < t->map->units_count && !has_children; i++) {
+        has_children = t->map->units[i].error > error_threshold;
+    }
+    node->offsets = has_children ? somr_trainer_group_by_bmu(t) : NULL;
+    for (somr_unit_id_t i = 0; i < t->map->units_count && has_children; i++) {
+        if (t->map->units[i].error > error_threshold) {
+            assert(node->offsets[i + 1] - node->offsets[i] > 1);
+            somr_growth_push(g, (somr_growth_candidate_t) { t->map->units[i].error, node_index, i });
+        }
+    }
+
+    somr_counters_t *counters = somr_trainer_get_counters(t);
+    if (counters != NULL) {
+        g->dist_evals_count += counters->dist_evals_count;
+    }
+    if (t->settings->trace != NULL) {
+        somr_trace_end(t->settings->trace, t->map->width, t->map->height);
+    }
+}
+
+/** @return true if @p a is expanded before @p b: higher error first, then earlier map and unit on ties */
+static bool somr_growth_is_before(somr_growth_candidate_t *a, somr_growth_candidate_t *b) {
+    if (a->error != b->error) {
+        return a->error > b->error;
+    }
+    if (a->node_index != b->node_index) {
+        return a->node_index < b->node_index;
+    }
+    return a->unit_id < b->unit_id;
+}
+
+static void somr_growth_push(somr_growth_t *g, somr_growth_candidate_t candidate) {
+    if (g->candidates_count == g->candidates_capacity) {
+        g->candidates_capacity = (g->candidates_capacity == 0) ? 64 : g->candidates_capacity * 2;
+        g->candidates = realloc(g->candidates, sizeof(somr_growth_candidate_t) * g->candidates_capacity);
+    }
+    unsigned int i = g->candidates_count;
+    g->candidates_count++;
+    while (i > 0 && somr_growth_is_before(&candidate, &g->candidates[(i - 1) / 2])) {
+        g->candidates[i] = g->candidates[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    g->candidates[i] = candidate;
+}
+
+static somr_growth_candidate_t somr_growth_pop(somr_growth_t *g) {
+    assert(g->candidates_count > 0);
+    somr_growth_candidate_t first = g->candidates[0];
+    g->candidates_count--;
+    somr_growth_candidate_t last = g->candidates[g->candidates_count];
+    unsigned int i = 0;
+    while (2 * i + 1 < g->candidates_count) {
+        unsigned int child = 2 * i + 1;
+        if (child + 1 < g->candidates_count && somr_growth_is_before(&g->candidates[child + 1], &g->candidates[child])) {
+            child++;
+        }
+        if (!somr_growth_is_before(&g->candidates[child], &last)) {
             break;
         }
+        g->candidates[i] = g->candidates[child];
+        i = child;
     }
+    g->candidates[i] = last;
+    return first;
+}
 
-    somr_trainer_deepen(t);
-    somr_trainer_label(t);
+/** @return true if time or distance evaluation budget of @p settings is spent */
+static bool somr_growth_is_over(somr_growth_t *g, somr_trainer_settings_t *settings) {
+    if (settings->time_budget > 0.0 && somr_growth_read_clock() - g->start_time >= settings->time_budget) {
+        return true;
+    }
+    return settings->dist_evals_budget > 0 && g->dist_evals_count >= settings->dist_evals_budget;
 }
 
-static void somr_trainer_run_epoch(somr_trainer_t *t, double radius, double learn_rate) {
+static double somr_growth_read_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** restarts schedule of trainer, from its beginning if @p should_reset_progress is true, from its current progress otherwise */
+static void somr_trainer_reset_schedule(somr_trainer_t *t, bool should_reset_progress) {
+    if (should_reset_progress) {
+        t->schedule.progress = 0.0;
+        t->schedule.epoch_index = 0;
+    }
+    t->schedule.step = 1.0 / (double) t->settings->iters_count;
+    t->schedule.previous_error = -1.0;
+    t->schedule.epochs_count = 0;
+}
+
+/**
+runs epochs with linearly decaying learning rate and radius, from schedule progress (in [0, 1]) to the end of the schedule
+(or until the map is found to need spreading, if @p allow_early_spread is true)
+without convergence tolerance, exactly iters_count epochs are run, decay being derived from the integer epoch index
+@return true if schedule was interrupted before its end, it can then be resumed from its progress
+*/
+static bool somr_trainer_run_schedule(somr_trainer_t *t, double radius, double error_threshold, bool allow_early_spread) {
+    double base_step = 1.0 / (double) t->settings->iters_count;
+    double max_step = (t->settings->iters_count > SOMR_TRAINER_MIN_EPOCHS) ? 1.0 / SOMR_TRAINER_MIN_EPOCHS : base_step;
+    somr_schedule_t *schedule = &t->schedule;
+    bool is_step_fixed = t->settings->convergence_tolerance <= 0.0;
+
+    while (is_step_fixed ? schedule->epoch_index < t->settings->iters_count : schedule->progress < 1.0) {
+        // linear decay of learning factor and radius
+        double decay = is_step_fixed ? (double) schedule->epoch_index / (double) t->settings->iters_count : schedule->progress;
+
+        double decayed_learn_rate = t->settings->learn_rate * (1.0 - decay);
+        assert(decayed_learn_rate > 0.0 && decayed_learn_rate <= t->settings->learn_rate);
+
+        // TODO make sure radius stays >= 1 ?
+        // double decayed_radius = (double) radius - ((double) radius - 1.0) * decay;
+        // assert(decayed_radius >= 1.0 && decayed_radius <= radius);
+        double decayed_radius = (double) radius - ((double) radius) * decay;
+        assert(decayed_radius > 0.0 && decayed_radius <= radius);
+
+        double error = somr_trainer_run_epoch(t, decayed_radius, decayed_learn_rate);
+        schedule->epoch_index++;
+        if (is_step_fixed) {
+            schedule->progress = (double) schedule->epoch_index / (double) t->settings->iters_count;
+        } else {
+            schedule->progress += schedule->step;
+        }
+        schedule->epochs_count++;
+
+        // map settled, move faster through the rest of the schedule
+        if (!is_step_fixed && schedule->previous_error > 0.0 && schedule->epochs_count >= SOMR_TRAINER_MIN_EPOCHS) {
+            double improvement = (schedule->previous_error - error) / schedule->previous_error;
+            if (improvement < t->settings->convergence_tolerance && schedule->step < max_step) {
+                schedule->step = (schedule->step * 2.0 < max_step) ? schedule->step * 2.0 : max_step;
+            }
+        }
+        schedule->previous_error = error;
+
+        // error is still far above threshold late in the schedule, the map will need to spread anyway
+        if (allow_early_spread && t->settings->early_spread_ratio > 0.0 && schedule->progress >= 0.5 && schedule->progress < 1.0
+            && error > t->settings->early_spread_ratio * error_threshold) {
+            return true;
+        }
+
+        if (t->settings->checkpoint != NULL) {
+            somr_checkpoint_tick(t->settings->checkpoint, t);
+        }
+    }
+    return false;
+}
+
+double somr_trainer_run_epoch(somr_trainer_t *t, double radius, double learn_rate) {
     assert(learn_rate > 0.0 && learn_rate < 1.0);
     assert(radius > 0.0);
 
     // pre-allocate array that will contain list of bmus
     // somr_unit_id_t *bmus = malloc(sizeof(somr_unit_id_t) * t->map->units_count);
 
-    // randomize data set
-    somr_dataset_shuffle(t->dataset, &t->settings->rand_state);
+    SOMR_STATS_TIMER_BEGIN(timer);
+    somr_trainer_trace_begin(t, SOMR_PHASE_EPOCH);
+    unsigned long long nbhd_updates_count = 0;
+    double error_sum = 0.0;
+    unsigned int sample_size = somr_trainer_get_sample_size(t);
+
+    somr_trainer_prepare_map(t);
+
+    // randomize data set, or draw a new sample at its beginning
+    if (sample_size < t->dataset->size) {
+        somr_dataset_shuffle_head(t->dataset, sample_size, &t->settings->rand_state);
+    } else {
+        somr_dataset_shuffle(t->dataset, &t->settings->rand_state);
+    }
 
     // find bmu for each vector in data set and teach its neighborhood
-    for (unsigned int i = 0; i < t->dataset->size; i++) {
+    for (unsigned int i = 0; i < sample_size; i++) {
         somr_data_vector_t *data_vector = somr_dataset_get_vector(t->dataset, i);
 
         // TODO randomly pick one if several found, is this useful?
@@ -97,13 +635,39 @@ static void somr_trainer_run_epoch(somr_trainer_t *t, double radius, double lear
         // }
 
         somr_unit_id_t bmu_id = somr_map_find_bmu(t->map, data_vector);
-        somr_map_teach_nbhd(t->map, bmu_id, data_vector, learn_rate, radius);
+        // activation is squared distance to bmu before it learns from vector
+        error_sum += sqrt(t->map->units[bmu_id].activation);
+        nbhd_updates_count += somr_map_teach_nbhd(t->map, bmu_id, data_vector, learn_rate, radius);
     }
 
     // free(bmus);
+    somr_trainer_prepare_map(t);
+
+    somr_counters_t *counters = somr_trainer_get_counters(t);
+    SOMR_STATS_COUNT(counters, epochs_count, 1);
+    SOMR_STATS_COUNT(counters, bmu_searches_count, sample_size);
+    SOMR_STATS_COUNT(counters, dist_evals_count, (unsigned long long) sample_size * t->map->units_count);
+    SOMR_STATS_COUNT(counters, nbhd_updates_count, nbhd_updates_count);
+    SOMR_STATS_COUNT(counters, dataset_bytes, (unsigned long long) sample_size * t->features_count * somr_dataset_get_feature_size(t->dataset));
+    SOMR_STATS_TIMER_END(timer, counters, SOMR_PHASE_EPOCH);
+    somr_trainer_trace_end(t);
+
+    // same definition as mean error of map: sum of unit errors over number of units (extrapolated to whole data set)
+    return error_sum * ((double) t->dataset->size / sample_size) / t->map->units_count;
 }
 
-static somr_unit_id_t somr_trainer_compute_error(somr_trainer_t *t) {
+somr_unit_id_t somr_trainer_compute_error(somr_trainer_t *t) {
+    somr_unit_id_t error_unit_id;
+    somr_trainer_prepare_map(t);
+    somr_map_build_index(t->map);
+    unsigned int sample_size = somr_trainer_get_sample_size(t);
+    if (sample_size < t->dataset->size && somr_trainer_estimate_error(t, sample_size, &error_unit_id)) {
+        return error_unit_id;
+    }
+
+    SOMR_STATS_TIMER_BEGIN(timer);
+    somr_trainer_trace_begin(t, SOMR_PHASE_ERROR);
+
     // reset error for all units
     for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
         t->map->units[i].error = 0.0;
@@ -114,15 +678,38 @@ static somr_unit_id_t somr_trainer_compute_error(somr_trainer_t *t) {
         somr_data_vector_t *data_vector = somr_dataset_get_vector(t->dataset, i);
         somr_unit_id_t bmu_id = somr_map_find_bmu(t->map, data_vector);
         somr_unit_t *bmu = &t->map->units[bmu_id];
-        bmu->error += somr_vector_euclid_dist(bmu->weights, data_vector->weights, t->features_count);
+        // activation is squared distance to bmu
+        bmu->error += sqrt(bmu->activation);
         assert(bmu->error >= 0.0);
+        if (t->bmu_cache != NULL) {
+            t->bmu_cache[i].data_vector = data_vector;
+            t->bmu_cache[i].bmu_id = bmu_id;
+        }
     }
+    if (t->bmu_cache != NULL) {
+        t->bmu_cache_count = t->dataset->size;
+        t->bmu_cache_width = t->map->width;
+        t->insertions_count = 0;
+    }
+
+    somr_trainer_find_max_error(t, &error_unit_id);
+
+    somr_counters_t *counters = somr_trainer_get_counters(t);
+    SOMR_STATS_COUNT(counters, bmu_searches_count, t->dataset->size);
+    SOMR_STATS_COUNT(counters, dist_evals_count, (unsigned long long) t->dataset->size * t->map->units_count);
+    SOMR_STATS_COUNT(counters, dataset_bytes, (unsigned long long) t->dataset->size * t->features_count * somr_dataset_get_feature_size(t->dataset));
+    SOMR_STATS_TIMER_END(timer, counters, SOMR_PHASE_ERROR);
+    somr_trainer_trace_end(t);
+
+    return error_unit_id;
+}
 
-    // compute mean error of map, and locate unit with max error
+/** computes mean error of map from unit errors, and locates unit with max error */
+static void somr_trainer_find_max_error(somr_trainer_t *t, somr_unit_id_t *error_unit_id) {
     double sum = 0.0;
     unsigned int count = 0;
     double max_error = 0.0;
-    somr_unit_id_t error_unit_id = t->map->units_count;
+    *error_unit_id = t->map->units_count;
 
     for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
         somr_unit_t *unit = &t->map->units[i];
@@ -133,7 +720,7 @@ static somr_unit_id_t somr_trainer_compute_error(somr_trainer_t *t) {
         // TODO randomly pick one if several with same error?
         if (unit->error > max_error) {
             max_error = unit->error;
-            error_unit_id = i;
+            *error_unit_id = i;
         }
     }
 
@@ -141,11 +728,105 @@ static somr_unit_id_t somr_trainer_compute_error(somr_trainer_t *t) {
     assert(sum >= 0.0);
     t->map->mean_error = sum / count;
 
-    assert(error_unit_id != t->map->units_count);
-    return error_unit_id;
+    assert(*error_unit_id != t->map->units_count);
 }
 
-static void somr_trainer_spread(somr_trainer_t *t, somr_unit_id_t error_unit_id) {
+/**
+estimates unit errors and mean error of map from the distances of a random sample of @p sample_size input vectors to their bmu,
+scaled to the whole data set
+@return false if an estimate is too close to the spread threshold (or to the depth threshold when the map will not spread)
+for the spread and deepen decisions to be trusted, in which case the error must be computed exactly
+*/
+static bool somr_trainer_estimate_error(somr_trainer_t *t, unsigned int sample_size, somr_unit_id_t *error_unit_id) {
+    SOMR_STATS_TIMER_BEGIN(timer);
+    somr_trainer_trace_begin(t, SOMR_PHASE_ERROR);
+    somr_dataset_shuffle_head(t->dataset, sample_size, &t->settings->rand_state);
+
+    // sums of squared distances and number of sampled vectors per unit, for variance of estimates
+    double *squares = calloc(t->map->units_count, sizeof(double));
+    unsigned int *counts = calloc(t->map->units_count, sizeof(unsigned int));
+    double sum = 0.0;
+    double squares_sum = 0.0;
+
+    for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+        t->map->units[i].error = 0.0;
+    }
+
+    for (unsigned int i = 0; i < sample_size; i++) {
+        somr_data_vector_t *data_vector = somr_dataset_get_vector(t->dataset, i);
+        somr_unit_id_t bmu_id = somr_map_find_bmu(t->map, data_vector);
+        somr_unit_t *bmu = &t->map->units[bmu_id];
+        double dist = sqrt(bmu->activation);
+        bmu->error += dist;
+        squares[bmu_id] += dist * dist;
+        counts[bmu_id]++;
+        sum += dist;
+        squares_sum += dist * dist;
+        if (t->bmu_cache != NULL) {
+            t->bmu_cache[i].data_vector = data_vector;
+            t->bmu_cache[i].bmu_id = bmu_id;
+        }
+    }
+    if (t->bmu_cache != NULL) {
+        t->bmu_cache_count = sample_size;
+        t->bmu_cache_width = t->map->width;
+        t->insertions_count = 0;
+    }
+
+    // error of unit is a sum over the vectors of the data set, estimated as size times the sample mean of
+    // (distance if vector is mapped to unit, 0 otherwise), with the standard error of that mean
+    double size = t->dataset->size;
+    double z = t->settings->error_confidence;
+    bool is_trusted = true;
+
+    double mean = sum / sample_size;
+    double variance = fmax(squares_sum / sample_size - mean * mean, 0.0);
+    double mean_error = size * mean / t->map->units_count;
+    double mean_error_margin = z * size * sqrt(variance / sample_size) / t->map->units_count;
+    double spread_threshold = t->settings->spread_threshold * t->parent_mean_error;
+
+    if (fabs(mean_error - spread_threshold) <= mean_error_margin) {
+        is_trusted = false;
+    } else if (mean_error <= spread_threshold) {
+        // map will not spread, check that deepen decision of each unit is reliable
+        double depth_threshold = t->root_mean_error * t->settings->depth_threshold;
+        for (somr_unit_id_t i = 0; i < t->map->units_count && is_trusted; i++) {
+            double unit_mean = t->map->units[i].error / sample_size;
+            double unit_variance = fmax(squares[i] / sample_size - unit_mean * unit_mean, 0.0);
+            double unit_error = size * unit_mean;
+            double unit_error_margin = z * size * sqrt(unit_variance / sample_size);
+            if (counts[i] < SOMR_TRAINER_MIN_UNIT_SAMPLES || fabs(unit_error - depth_threshold) <= unit_error_margin) {
+                is_trusted = false;
+            }
+        }
+    }
+
+    double scale = size / sample_size;
+    for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+        t->map->units[i].error *= scale;
+    }
+    somr_trainer_find_max_error(t, error_unit_id);
+
+    free(squares);
+    free(counts);
+
+    somr_counters_t *counters = somr_trainer_get_counters(t);
+    SOMR_STATS_COUNT(counters, bmu_searches_count, sample_size);
+    SOMR_STATS_COUNT(counters, dist_evals_count, (unsigned long long) sample_size * t->map->units_count);
+    SOMR_STATS_COUNT(counters, dataset_bytes, (unsigned long long) sample_size * t->features_count * somr_dataset_get_feature_size(t->dataset));
+    SOMR_STATS_TIMER_END(timer, counters, SOMR_PHASE_ERROR);
+    somr_trainer_trace_end(t);
+
+    return is_trusted;
+}
+
+/**
+locates where a row or column should be inserted to spread around unit @p error_unit_id:
+between it and its most distant neighbor
+@p is_row: set to true if a row should be inserted, false for a column
+@return index of row or column after which the new one should be inserted
+*/
+static unsigned int somr_trainer_find_insertion(somr_trainer_t *t, somr_unit_id_t error_unit_id, bool *is_row) {
     double *error_weights = t->map->units[error_unit_id].weights;
 
     int error_unit_y = error_unit_id / t->map->width;
@@ -192,70 +873,620 @@ static void somr_trainer_spread(somr_trainer_t *t, somr_unit_id_t error_unit_id)
     assert(max_delta >= 0.0);
     assert(max_delta_nb_id < t->map->units_count);
 
-    // insert row or column between error unit and max delta neighbor
+    // row or column goes between error unit and max delta neighbor
     if (max_delta_nb_id == error_unit_id + 1) {
         assert(error_unit_x < t->map->width - 1);
-        somr_map_insert_col(t->map, error_unit_x);
+        *is_row = false;
+        return error_unit_x;
     } else if (max_delta_nb_id == error_unit_id - 1) {
         assert(error_unit_x > 0);
-        somr_map_insert_col(t->map, error_unit_x - 1);
+        *is_row = false;
+        return error_unit_x - 1;
     } else if (max_delta_nb_id == error_unit_id + t->map->width) {
         assert(error_unit_y < t->map->height - 1);
-        somr_map_insert_row(t->map, error_unit_y);
+        *is_row = true;
+        return error_unit_y;
     } else {
         assert(max_delta_nb_id == error_unit_id - t->map->width);
         assert(error_unit_y > 0);
-        somr_map_insert_row(t->map, error_unit_y - 1);
+        *is_row = true;
+        return error_unit_y - 1;
     }
 }
 
-static void somr_trainer_deepen(somr_trainer_t *t) {
-    // pre-alloc
-    unsigned int *data_vectors_indices = malloc(sizeof(unsigned int) * t->dataset->size);
+void somr_trainer_spread(somr_trainer_t *t, somr_unit_id_t error_unit_id) {
+    SOMR_STATS_TIMER_BEGIN(timer);
+    somr_trainer_trace_begin(t, SOMR_PHASE_SPREAD);
+    somr_counters_t *counters = somr_trainer_get_counters(t);
 
-    double error_threshold = t->root_mean_error * t->settings->depth_threshold;
+    bool is_row;
+    unsigned int before = somr_trainer_find_insertion(t, error_unit_id, &is_row);
+    somr_trainer_add_insertion(t, is_row, before);
+    if (is_row) {
+        somr_map_insert_row(t->map, before);
+        SOMR_STATS_COUNT(counters, row_spreads_count, 1);
+    } else {
+        somr_map_insert_col(t->map, before);
+        SOMR_STATS_COUNT(counters, col_spreads_count, 1);
+    }
 
-    for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
-        somr_unit_t *unit = &t->map->units[i];
-        if (unit->error <= error_threshold) {
+    SOMR_STATS_TIMER_END(timer, counters, SOMR_PHASE_SPREAD);
+    somr_trainer_trace_end(t);
+}
+
+/** unit error entry, for sorting units by decreasing error */
+typedef struct somr_unit_error_t {
+    double error;
+    somr_unit_id_t unit_id;
+} somr_unit_error_t;
+
+static int somr_unit_error_compare(const void *a, const void *b) {
+    const somr_unit_error_t *ea = a;
+    const somr_unit_error_t *eb = b;
+    if (ea->error != eb->error) {
+        return (ea->error < eb->error) ? 1 : -1;
+    }
+    return (ea->unit_id > eb->unit_id) - (ea->unit_id < eb->unit_id);
+}
+
+/** inserts rows (or columns) after each of the @p count indices in @p befores, in decreasing order so that indices stay valid */
+static void somr_trainer_insert_all(somr_trainer_t *t, unsigned int *befores, unsigned int count, bool is_row) {
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int max_index = i;
+        for (unsigned int j = i + 1; j < count; j++) {
+            if (befores[j] > befores[max_index]) {
+                max_index = j;
+            }
+        }
+        unsigned int before = befores[max_index];
+        befores[max_index] = befores[i];
+        befores[i] = before;
+
+        if (is_row) {
+            somr_map_insert_row(t->map, before);
+        } else {
+            somr_map_insert_col(t->map, before);
+        }
+    }
+}
+
+unsigned int somr_trainer_spread_many(somr_trainer_t *t, unsigned int max_count) {
+    assert(max_count > 0);
+    SOMR_STATS_TIMER_BEGIN(timer);
+    somr_trainer_trace_begin(t, SOMR_PHASE_SPREAD);
+    somr_counters_t *counters = somr_trainer_get_counters(t);
+
+    unsigned int width = t->map->width;
+    somr_unit_id_t units_count = t->map->units_count;
+    somr_unit_error_t *errors = malloc(sizeof(somr_unit_error_t) * units_count);
+    for (somr_unit_id_t i = 0; i < units_count; i++) {
+        errors[i].error = t->map->units[i].error;
+        errors[i].unit_id = i;
+    }
+    qsort(errors, units_count, sizeof(somr_unit_error_t), somr_unit_error_compare);
+
+    // picked units, and rows and columns after which to insert
+    somr_unit_id_t *picked_ids = malloc(sizeof(somr_unit_id_t) * max_count);
+    unsigned int *row_befores = malloc(sizeof(unsigned int) * max_count);
+    unsigned int *col_befores = malloc(sizeof(unsigned int) * max_count);
+    unsigned int picked_count = 0;
+    unsigned int rows_count = 0;
+    unsigned int cols_count = 0;
+
+    for (somr_unit_id_t i = 0; i < units_count && picked_count < max_count; i++) {
+        somr_unit_id_t unit_id = errors[i].unit_id;
+        if (errors[i].error <= 0.0) {
+            break;
+        }
+
+        // skip units next to an already picked unit, their errors are already taken care of
+        int x = unit_id % width;
+        int y = unit_id / width;
+        bool is_conflicting = false;
+        for (unsigned int j = 0; j < picked_count && !is_conflicting; j++) {
+            int picked_x = picked_ids[j] % width;
+            int picked_y = picked_ids[j] / width;
+            is_conflicting = abs(x - picked_x) <= 1 && abs(y - picked_y) <= 1;
+        }
+
+        // skip units that would insert at the same place as an already picked unit
+        bool is_row;
+        unsigned int before = somr_trainer_find_insertion(t, unit_id, &is_row);
+        unsigned int *befores = is_row ? row_befores : col_befores;
+        unsigned int befores_count = is_row ? rows_count : cols_count;
+        for (unsigned int j = 0; j < befores_count && !is_conflicting; j++) {
+            is_conflicting = befores[j] == before;
+        }
+        if (is_conflicting) {
             continue;
         }
 
-        // find data vectors for unit
-        unsigned int data_vectors_count = 0;
-        for (unsigned int j = 0; j < t->dataset->size; j++) {
-            somr_data_vector_t *data_vector = somr_dataset_get_vector(t->dataset, j);
+        picked_ids[picked_count] = unit_id;
+        picked_count++;
+        somr_trainer_add_insertion(t, is_row, before);
+        befores[befores_count] = before;
+        if (is_row) {
+            rows_count++;
+        } else {
+            cols_count++;
+        }
+    }
+    assert(picked_count > 0);
+
+    // inserting rows does not move columns and vice versa
+    somr_trainer_insert_all(t, row_befores, rows_count, true);
+    somr_trainer_insert_all(t, col_befores, cols_count, false);
+
+    free(errors);
+    free(picked_ids);
+    free(row_befores);
+    free(col_befores);
+
+    SOMR_STATS_COUNT(counters, row_spreads_count, rows_count);
+    SOMR_STATS_COUNT(counters, col_spreads_count, cols_count);
+    SOMR_STATS_TIMER_END(timer, counters, SOMR_PHASE_SPREAD);
+    somr_trainer_trace_end(t);
+
+    return picked_count;
+}
+
+/** records an insertion, so that fine-tuning can locate input vectors around it (only needed if bmus are cached) */
+static void somr_trainer_add_insertion(somr_trainer_t *t, bool is_row, unsigned int before) {
+    if (t->bmu_cache == NULL) {
+        return;
+    }
+    if (t->insertions_count == t->insertions_capacity) {
+        t->insertions_capacity = (t->insertions_capacity == 0) ? 4 : t->insertions_capacity * 2;
+        t->insertions = realloc(t->insertions, sizeof(somr_insertion_t) * t->insertions_capacity);
+    }
+    t->insertions[t->insertions_count].is_row = is_row;
+    t->insertions[t->insertions_count].before = before;
+    t->insertions_count++;
+}
+
+/**
+runs a short schedule with small radius and learning rate, only presenting input vectors whose cached bmu
+was near a row or column inserted since bmus were cached
+*/
+static void somr_trainer_fine_tune(somr_trainer_t *t) {
+    SOMR_STATS_TIMER_BEGIN(timer);
+    somr_trainer_trace_begin(t, SOMR_PHASE_EPOCH);
+
+    // select vectors around insertions (coordinates of cached bmus are those of the map before insertions)
+    somr_data_vector_t **data_vectors = malloc(sizeof(somr_data_vector_t *) * t->bmu_cache_count);
+    unsigned int data_vectors_count = 0;
+    for (unsigned int i = 0; i < t->bmu_cache_count; i++) {
+        somr_bmu_cache_entry_t *entry = &t->bmu_cache[i];
+        int x = entry->bmu_id % t->bmu_cache_width;
+        int y = entry->bmu_id / t->bmu_cache_width;
+        for (unsigned int j = 0; j < t->insertions_count; j++) {
+            int before = t->insertions[j].before;
+            int coord = t->insertions[j].is_row ? y : x;
+            // inserted between before and before + 1
+            if (coord >= before + 1 - SOMR_TRAINER_FINE_TUNE_MARGIN && coord <= before + SOMR_TRAINER_FINE_TUNE_MARGIN) {
+                data_vectors[data_vectors_count] = entry->data_vector;
+                data_vectors_count++;
+                break;
+            }
+        }
+    }
+
+    unsigned int epochs_count = t->settings->iters_count / SOMR_TRAINER_MIN_EPOCHS;
+    if (epochs_count < 1) {
+        epochs_count = 1;
+    }
+    unsigned long long nbhd_updates_count = 0;
+    somr_trainer_prepare_map(t);
+    for (unsigned int e = 0; e < epochs_count && data_vectors_count > 0; e++) {
+        double decay = (double) e / epochs_count;
+        double radius = SOMR_TRAINER_FINE_TUNE_RADIUS * (1.0 - decay);
+        double learn_rate = t->settings->learn_rate / 2.0 * (1.0 - decay);
+
+        for (unsigned int i = 0; i < data_vectors_count; i++) {
+            unsigned int index = i + rand_r(&t->settings->rand_state) % (data_vectors_count - i);
+            somr_data_vector_t *data_vector = data_vectors[index];
+            data_vectors[index] = data_vectors[i];
+            data_vectors[i] = data_vector;
+
             somr_unit_id_t bmu_id = somr_map_find_bmu(t->map, data_vector);
+            nbhd_updates_count += somr_map_teach_nbhd(t->map, bmu_id, data_vector, learn_rate, radius);
+        }
+    }
+    free(data_vectors);
+    somr_trainer_prepare_map(t);
+
+    somr_counters_t *counters = somr_trainer_get_counters(t);
+    // fine-tuning epochs are only a small part of full epochs, and not counted as such
+    unsigned long long presented_count = (unsigned long long) epochs_count * data_vectors_count;
+    SOMR_STATS_COUNT(counters, bmu_searches_count, presented_count);
+    SOMR_STATS_COUNT(counters, dist_evals_count, presented_count * t->map->units_count);
+    SOMR_STATS_COUNT(counters, nbhd_updates_count, nbhd_updates_count);
+    SOMR_STATS_COUNT(counters, dataset_bytes, presented_count * t->features_count * somr_dataset_get_feature_size(t->dataset));
+    SOMR_STATS_TIMER_END(timer, counters, SOMR_PHASE_EPOCH);
+    somr_trainer_trace_end(t);
+}
+
+/**
+@return number of rows and columns to insert at once so that the map gets closer to @p error_threshold in a single step:
+growing a map with n units by k rows or columns adds about k * sqrt(n) units, and we aim (conservatively)
+at half the number of units that would bring mean error down to the threshold if it was inversely proportional to units count
+*/
+static unsigned int somr_trainer_get_insertions_count(somr_trainer_t *t, double error_threshold) {
+    if (t->settings->max_insertions <= 1 || error_threshold <= 0.0) {
+        return 1;
+    }
+    double gap = t->map->mean_error / error_threshold - 1.0;
+    double count = ceil(gap * sqrt(t->map->units_count) / 2.0);
+    if (count < 1.0) {
+        return 1;
+    }
+    return (count < t->settings->max_insertions) ? (unsigned int) count : t->settings->max_insertions;
+}
+
+/**
+groups input vectors of data set by bmu, in place: vectors of unit i end up from @p[out] offsets[i] to
+offsets[i + 1] (units count + 1 offsets, zeroed), so that child data sets are subranges of the data set indices
+(@p bmu_ids, bmu of vector at each index, are moved along with them)
+*/
+static void somr_trainer_partition(somr_trainer_t *t, somr_unit_id_t *bmu_ids, unsigned int *offsets) {
+    unsigned int *indices = t->dataset->indices;
+    for (unsigned int i = 0; i < t->dataset->size; i++) {
+        offsets[bmu_ids[i] + 1]++;
+    }
+    for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    // swap each vector into the range of its bmu (vectors already in their range are never moved,
+    // so that partitioning indices restored from a checkpoint gives back the same ranges)
+    unsigned int *positions = malloc(sizeof(unsigned int) * t->map->units_count);
+    memcpy(positions, offsets, sizeof(unsigned int) * t->map->units_count);
+    for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+        while (positions[i] < offsets[i + 1]) {
+            unsigned int position = positions[i];
+            somr_unit_id_t bmu_id = bmu_ids[position];
             if (bmu_id == i) {
-                data_vectors_indices[data_vectors_count] = j;
-                data_vectors_count++;
+                positions[i]++;
+                continue;
             }
+            unsigned int target = positions[bmu_id];
+            positions[bmu_id]++;
+            unsigned int swap_index = indices[position];
+            indices[position] = indices[target];
+            indices[target] = swap_index;
+            bmu_ids[position] = bmu_ids[target];
+            bmu_ids[target] = bmu_id;
+        }
+    }
+    free(positions);
+}
+
+/**
+@return ranges of input vectors of data set mapped to each unit, after grouping them by bmu (see somr_trainer_partition),
+accounted as scratch memory until freed
+*/
+static unsigned int *somr_trainer_group_by_bmu(somr_trainer_t *t) {
+    // time spent training child maps is not accounted to deepen phase
+    SOMR_STATS_TIMER_BEGIN(timer);
+    somr_trainer_trace_begin(t, SOMR_PHASE_DEEPEN);
+
+    somr_unit_id_t *bmu_ids = malloc(sizeof(somr_unit_id_t) * t->dataset->size);
+    for (unsigned int j = 0; j < t->dataset->size; j++) {
+        somr_data_vector_t *data_vector = somr_dataset_get_vector(t->dataset, j);
+        bmu_ids[j] = somr_map_find_bmu(t->map, data_vector);
+    }
+    unsigned int *offsets = calloc(t->map->units_count + 1, sizeof(unsigned int));
+    size_t offsets_bytes = sizeof(unsigned int) * (t->map->units_count + 1);
+    somr_trainer_account_scratch(t, sizeof(somr_unit_id_t) * t->dataset->size + offsets_bytes, true);
+    somr_trainer_partition(t, bmu_ids, offsets);
+    free(bmu_ids);
+    somr_trainer_account_scratch(t, sizeof(somr_unit_id_t) * t->dataset->size, false);
+
+    somr_counters_t *counters = somr_trainer_get_counters(t);
+    SOMR_STATS_COUNT(counters, bmu_searches_count, t->dataset->size);
+    SOMR_STATS_COUNT(counters, dist_evals_count, (unsigned long long) t->dataset->size * t->map->units_count);
+    SOMR_STATS_COUNT(counters, dataset_bytes, (unsigned long long) t->dataset->size * t->features_count * somr_dataset_get_feature_size(t->dataset));
+    SOMR_STATS_TIMER_END(timer, counters, SOMR_PHASE_DEEPEN);
+    somr_trainer_trace_end(t);
+    return offsets;
+}
+
+static void somr_trainer_deepen(somr_trainer_t *t) {
+    double error_threshold = t->root_mean_error * t->settings->depth_threshold;
+
+    // when resuming, child map of first unit to deepen already exists and is being trained
+    bool is_resuming = t->resume_frames != NULL && t->is_deepening;
+    somr_unit_id_t first_unit_id = is_resuming ? t->deepen_unit_id : 0;
+    t->is_deepening = true;
+    somr_trainer_prepare_map(t);
+    somr_map_build_index(t->map);
+    somr_trainer_account_map(t);
+
+    bool has_children = false;
+    for (somr_unit_id_t i = first_unit_id; i < t->map->units_count && !has_children; i++) {
+        has_children = t->map->units[i].error > error_threshold;
+    }
+    if (!has_children) {
+        t->resume_frames = NULL;
+        t->resume_frames_count = 0;
+        return;
+    }
+
+    // group data vectors by bmu once for all child maps
+    unsigned int *offsets = somr_trainer_group_by_bmu(t);
+    size_t offsets_bytes = sizeof(unsigned int) * (t->map->units_count + 1);
+
+    if (t->settings->shard != NULL && somr_trainer_get_depth(t) == t->settings->shard->depth) {
+        somr_trainer_deepen_sharded(t, offsets, error_threshold);
+        somr_trainer_label_parents(t, offsets, false);
+        somr_trainer_account_scratch(t, offsets_bytes, false);
+        free(offsets);
+        return;
+    }
+
+    for (somr_unit_id_t i = first_unit_id; i < t->map->units_count; i++) {
+        somr_unit_t *unit = &t->map->units[i];
+        if (unit->error <= error_threshold) {
+            continue;
+        }
+        t->deepen_unit_id = i;
+        bool is_resumed_child = is_resuming && i == first_unit_id;
+        if (is_resumed_child && (unit->child == NULL || t->resume_frames_count < 2 || t->resume_frames[1].parent_unit_id != i)) {
+            fprintf(stderr, "Invalid checkpoint frame\n");
+            exit(EXIT_FAILURE);
         }
+
+        if (!is_resumed_child && !somr_trainer_fit_child(t)) {
+            continue;
+        }
+
+        unsigned int data_vectors_count = offsets[i + 1] - offsets[i];
         assert(data_vectors_count > 1);
         // TODO check
         // if (data_vectors_count < 4) {
         //     continue;
         // }
 
-        somr_map_add_child(t->map, i, t->settings->should_orient, &t->settings->rand_state);
+        if (!is_resumed_child) {
+            somr_map_add_child(t->map, i, t->settings->should_orient, &t->settings->rand_state);
+            somr_trainer_account_subtree(t, unit->child, true);
+        }
 
         somr_dataset_t child_dataset;
-        somr_dataset_init_from_parent(&child_dataset, t->dataset, data_vectors_indices, data_vectors_count);
+        somr_dataset_init_from_parent(&child_dataset, t->dataset, offsets[i], data_vectors_count);
         somr_trainer_t child_trainer;
         somr_trainer_init(&child_trainer, unit->child, &child_dataset, t->root_mean_error, unit->error, t->settings);
+        child_trainer.labels_map = t->labels_map;
+        child_trainer.parent = t;
+        child_trainer.parent_unit_id = i;
+        if (is_resumed_child) {
+            child_trainer.resume_frames = t->resume_frames + 1;
+            child_trainer.resume_frames_count = t->resume_frames_count - 1;
+        }
+        if (t->settings->stats != NULL && t->stats_index >= 0) {
+            child_trainer.stats_index = somr_stats_add_map(t->settings->stats, t->stats_index, i, data_vectors_count);
+        }
+        somr_counters_t *counters = somr_trainer_get_counters(t);
+        SOMR_STATS_COUNT(counters, children_count, 1);
 
         somr_trainer_train(&child_trainer);
 
         somr_dataset_clear(&child_dataset);
     }
+    somr_trainer_label_parents(t, offsets, false);
+
+    t->resume_frames = NULL;
+    t->resume_frames_count = 0;
+    somr_trainer_account_scratch(t, offsets_bytes, false);
+    free(offsets);
+}
+
+/** @return depth of map in the tree (1 for top map) */
+static unsigned int somr_trainer_get_depth(somr_trainer_t *t) {
+    unsigned int depth = 1;
+    for (somr_trainer_t *parent = t->parent; parent != NULL; parent = parent->parent) {
+        depth++;
+    }
+    return depth;
+}
 
-    free(data_vectors_indices);
+/** trains child maps of units above @p error_threshold and their subtrees on shard workers */
+static void somr_trainer_deepen_sharded(somr_trainer_t *t, unsigned int *offsets, double error_threshold) {
+    somr_shard_job_t *jobs = malloc(sizeof(somr_shard_job_t) * t->map->units_count);
+    unsigned int jobs_count = 0;
+    for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+        somr_unit_t *unit = &t->map->units[i];
+        if (unit->error <= error_threshold) {
+            continue;
+        }
+        if (!somr_trainer_fit_child(t)) {
+            continue;
+        }
+        unsigned int data_vectors_count = offsets[i + 1] - offsets[i];
+        assert(data_vectors_count > 1);
+
+        somr_map_add_child(t->map, i, t->settings->should_orient, &t->settings->rand_state);
+        somr_trainer_account_subtree(t, unit->child, true);
+        somr_shard_job_t *job = &jobs[jobs_count];
+        job->map = unit->child;
+        somr_dataset_init_from_parent(&job->dataset, t->dataset, offsets[i], data_vectors_count);
+        job->root_mean_error = t->root_mean_error;
+        job->parent_mean_error = unit->error;
+        // each child map has its own random state, so that results do not depend on the order jobs are done in
+        job->rand_state = rand_r(&t->settings->rand_state);
+        jobs_count++;
+
+        somr_counters_t *counters = somr_trainer_get_counters(t);
+        SOMR_STATS_COUNT(counters, children_count, 1);
+    }
+
+    // child maps are replaced by the subtrees trained by workers (which do not enforce the memory budget)
+    for (unsigned int i = 0; i < jobs_count; i++) {
+        somr_trainer_account_subtree(t, jobs[i].map, false);
+    }
+    somr_shard_run(t->settings->shard, jobs, jobs_count, t->settings, t->labels_map);
+
+    for (unsigned int i = 0; i < jobs_count; i++) {
+        somr_trainer_account_subtree(t, jobs[i].map, true);
+        somr_dataset_clear(&jobs[i].dataset);
+    }
+    free(jobs);
+}
+
+/** updates settings memory with the bytes @p t->map gained or lost since last accounted */
+static void somr_trainer_account_map(somr_trainer_t *t) {
+    somr_memory_t *memory = t->settings->memory;
+    size_t bytes[SOMR_MEMORY_CATEGORIES_COUNT] = { 0 };
+    somr_memory_measure_map(t->map, bytes, false);
+    for (unsigned int i = 0; i < SOMR_MEMORY_CATEGORIES_COUNT; i++) {
+        if (memory != NULL && bytes[i] > t->map_bytes[i]) {
+            somr_memory_add(memory, i, bytes[i] - t->map_bytes[i]);
+        } else if (memory != NULL && bytes[i] < t->map_bytes[i]) {
+            somr_memory_remove(memory, i, t->map_bytes[i] - bytes[i]);
+        }
+        t->map_bytes[i] = bytes[i];
+    }
+}
+
+/** adds (or removes if not @p is_added) bytes of @p map and of its child maps to settings memory */
+static void somr_trainer_account_subtree(somr_trainer_t *t, somr_map_t *map, bool is_added) {
+    somr_memory_t *memory = t->settings->memory;
+    if (memory == NULL) {
+        return;
+    }
+    size_t bytes[SOMR_MEMORY_CATEGORIES_COUNT] = { 0 };
+    somr_memory_measure_map(map, bytes, true);
+    for (unsigned int i = 0; i < SOMR_MEMORY_CATEGORIES_COUNT; i++) {
+        if (is_added) {
+            somr_memory_add(memory, i, bytes[i]);
+        } else {
+            somr_memory_remove(memory, i, bytes[i]);
+        }
+    }
+}
+
+static void somr_trainer_account_scratch(somr_trainer_t *t, size_t bytes, bool is_allocated) {
+    if (t->settings->memory == NULL) {
+        return;
+    }
+    if (is_allocated) {
+        somr_memory_add(t->settings->memory, SOMR_MEMORY_SCRATCH, bytes);
+    } else {
+        somr_memory_remove(t->settings->memory, SOMR_MEMORY_SCRATCH, bytes);
+    }
+}
+
+/**
+@return how many of @p insertions_count rows or columns can be inserted in map within memory budget, 0 if none
+(in which case the refused spread is counted): k insertions add at most k * max(width, height) + k^2 / 4 units,
+along with their weights, the growth of unit structures and that of the distance index
+*/
+static unsigned int somr_trainer_fit_insertions(somr_trainer_t *t, unsigned int insertions_count) {
+    somr_memory_t *memory = t->settings->memory;
+    if (memory == NULL || memory->budget == 0) {
+        return insertions_count;
+    }
+    somr_map_t *m = t->map;
+    size_t side = (m->width > m->height) ? m->width : m->height;
+    for (size_t count = insertions_count; count > 0; count--) {
+        size_t units_count = m->units_count + count * side + count * count / 4;
+        size_t bytes = sizeof(double) * (units_count - m->units_count) * m->features_count;
+        if (units_count > m->units_capacity) {
+            size_t capacity = (units_count > 2 * (size_t) m->units_capacity) ? units_count : 2 * (size_t) m->units_capacity;
+            bytes += sizeof(somr_unit_t) * (capacity - m->units_capacity);
+        }
+        if (units_count >= SOMR_MAP_INDEX_MIN_UNITS && units_count <= SOMR_MAP_INDEX_MAX_UNITS) {
+            size_t index_bytes = sizeof(somr_unit_dist_t) * units_count * (units_count - 1);
+            if (index_bytes > t->map_bytes[SOMR_MEMORY_INDEXES]) {
+                bytes += index_bytes - t->map_bytes[SOMR_MEMORY_INDEXES];
+            }
+        }
+        if (somr_memory_fits(memory, bytes)) {
+            return (unsigned int) count;
+        }
+    }
+    memory->refused_spreads_count++;
+    return 0;
+}
+
+/** @return true if a new child map fits in memory budget, counts refused child map otherwise */
+static bool somr_trainer_fit_child(somr_trainer_t *t) {
+    somr_memory_t *memory = t->settings->memory;
+    if (memory == NULL || somr_memory_fits(memory, somr_memory_measure_child_map(t->features_count))) {
+        return true;
+    }
+    memory->refused_children_count++;
+    return false;
+}
+
+static int somr_label_compare(const void *a, const void *b) {
+    somr_label_t la = *(const somr_label_t *) a;
+    somr_label_t lb = *(const somr_label_t *) b;
+    return (la > lb) - (la < lb);
+}
+
+/**
+labels each unit with a child map with the most frequent label of the input vectors mapped to it, that is of its subtree
+(smallest label on ties), so that classification can stop at it
+@p offsets: ranges of input vectors of data set mapped to each unit, as filled by somr_trainer_partition
+@p should_merge: if true, input vectors are added to those behind the current label of units, which is kept on ties
+(other labels are only counted among the new input vectors)
+*/
+static void somr_trainer_label_parents(somr_trainer_t *t, unsigned int *offsets, bool should_merge) {
+    somr_label_t *labels = malloc(sizeof(somr_label_t) * t->dataset->size);
+    somr_trainer_account_scratch(t, sizeof(somr_label_t) * t->dataset->size, true);
+    for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+        somr_unit_t *unit = &t->map->units[i];
+        if (unit->child == NULL || offsets[i + 1] == offsets[i]) {
+            continue;
+        }
+
+        unsigned int labels_count = 0;
+        for (unsigned int j = offsets[i]; j < offsets[i + 1]; j++) {
+            somr_label_t label = somr_dataset_get_vector(t->dataset, j)->label;
+            if (label != SOMR_EMPTY_LABEL) {
+                labels[labels_count] = (t->labels_map != NULL) ? t->labels_map[label] : label;
+                labels_count++;
+            }
+        }
+        qsort(labels, labels_count, sizeof(somr_label_t), somr_label_compare);
+
+        somr_label_t previous_label = should_merge ? unit->label : SOMR_EMPTY_LABEL;
+        unsigned int previous_count = should_merge ? unit->label_count : 0;
+        unit->label = previous_label;
+        unit->label_count = previous_count;
+        for (unsigned int j = 0; j < labels_count;) {
+            unsigned int run_end = j + 1;
+            while (run_end < labels_count && labels[run_end] == labels[j]) {
+                run_end++;
+            }
+            unsigned int count = run_end - j;
+            if (labels[j] == previous_label) {
+                count += previous_count;
+            }
+            if (count > unit->label_count || (count == unit->label_count && labels[j] == previous_label)) {
+                unit->label_count = count;
+                unit->label = labels[j];
+            }
+            j = run_end;
+        }
+    }
+    somr_trainer_account_scratch(t, sizeof(somr_label_t) * t->dataset->size, false);
+    free(labels);
 }
 
 void somr_trainer_label(somr_trainer_t *t) {
-    // init with empty labels for all units
+    SOMR_STATS_TIMER_BEGIN(timer);
+    somr_trainer_trace_begin(t, SOMR_PHASE_LABEL);
+
+    somr_trainer_prepare_map(t);
+    somr_map_build_index(t->map);
+
+    // init with empty labels for all units, but units with a child map that were labelled from their subtree
     for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
-        t->map->units[i].label = SOMR_EMPTY_LABEL;
+        if (t->map->units[i].child == NULL) {
+            t->map->units[i].label = SOMR_EMPTY_LABEL;
+        }
     }
 
     // randomize data set
@@ -266,6 +1497,212 @@ void somr_trainer_label(somr_trainer_t *t) {
         somr_data_vector_t *data_vector = somr_dataset_get_vector(t->dataset, i);
         somr_unit_id_t bmu_id = somr_map_find_bmu(t->map, data_vector);
         somr_unit_t *bmu = &t->map->units[bmu_id];
+        if (bmu->child != NULL) {
+            continue;
+        }
         bmu->label = data_vector->label;
+        if (t->labels_map != NULL && data_vector->label != SOMR_EMPTY_LABEL) {
+            bmu->label = t->labels_map[data_vector->label];
+        }
     }
+
+    somr_counters_t *counters = somr_trainer_get_counters(t);
+    SOMR_STATS_COUNT(counters, bmu_searches_count, t->dataset->size);
+    SOMR_STATS_COUNT(counters, dist_evals_count, (unsigned long long) t->dataset->size * t->map->units_count);
+    SOMR_STATS_COUNT(counters, dataset_bytes, (unsigned long long) t->dataset->size * t->features_count * somr_dataset_get_feature_size(t->dataset));
+    SOMR_STATS_TIMER_END(timer, counters, SOMR_PHASE_LABEL);
+    somr_trainer_trace_end(t);
+}
+
+void somr_trainer_update(somr_trainer_t *t) {
+    double error_threshold = t->settings->spread_threshold * t->parent_mean_error;
+
+    // errors of previous input vectors, new input vectors errors are added to them
+    double *errors = malloc(sizeof(double) * t->map->units_count);
+    for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+        errors[i] = t->map->units[i].error;
+    }
+
+    while (true) {
+        somr_trainer_reset_schedule(t, true);
+        somr_trainer_run_schedule(t, SOMR_TRAINER_UPDATE_RADIUS, error_threshold, false);
+
+        somr_trainer_compute_error(t);
+        for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+            t->map->units[i].error += errors[i];
+        }
+        somr_unit_id_t error_unit_id;
+        somr_trainer_find_max_error(t, &error_unit_id);
+
+        somr_trainer_account_map(t);
+        if (t->map->mean_error <= error_threshold || somr_trainer_fit_insertions(t, 1) == 0) {
+            break;
+        }
+
+        bool is_row;
+        unsigned int before = somr_trainer_find_insertion(t, error_unit_id, &is_row);
+        double *split_errors = somr_trainer_split_errors(t, errors, is_row, before);
+        free(errors);
+        errors = split_errors;
+        somr_trainer_spread(t, error_unit_id);
+        somr_trainer_account_map(t);
+
+        // inserted units take labels of units before them, as previous input vectors may be mapped to them
+        for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+            unsigned int coord = is_row ? i / t->map->width : i % t->map->width;
+            if (coord == before + 1) {
+                t->map->units[i].label = t->map->units[is_row ? i - t->map->width : i - 1].label;
+            }
+        }
+    }
+    free(errors);
+
+    if (t->settings->stats != NULL && t->stats_index >= 0) {
+        somr_map_stats_t *map_stats = &t->settings->stats->maps[t->stats_index];
+        map_stats->width = t->map->width;
+        map_stats->height = t->map->height;
+    }
+
+    // labels of units are updated along with children (units without new input vectors keep their label)
+    somr_trainer_update_children(t);
+}
+
+/**
+@return errors of units of map after insertion of a row (or column) after @p before, given their errors @p errors before:
+error of units on both sides of insertion is split in thirds, one third going to the inserted unit between them
+*/
+static double *somr_trainer_split_errors(somr_trainer_t *t, double *errors, bool is_row, unsigned int before) {
+    unsigned int width = t->map->width;
+    unsigned int height = t->map->height;
+    unsigned int new_width = is_row ? width : width + 1;
+    unsigned int new_height = is_row ? height + 1 : height;
+    double *new_errors = malloc(sizeof(double) * new_width * new_height);
+
+    for (unsigned int y = 0; y < new_height; y++) {
+        for (unsigned int x = 0; x < new_width; x++) {
+            unsigned int coord = is_row ? y : x;
+            double error;
+            if (coord == before + 1) {
+                // inserted unit, between old units at before and before + 1
+                somr_unit_id_t id_before = is_row ? before * width + x : y * width + before;
+                somr_unit_id_t id_after = is_row ? (before + 1) * width + x : y * width + before + 1;
+                error = (errors[id_before] + errors[id_after]) / 3.0;
+            } else {
+                unsigned int old_x = (!is_row && x > before) ? x - 1 : x;
+                unsigned int old_y = (is_row && y > before) ? y - 1 : y;
+                error = errors[old_y * width + old_x];
+                if (coord == before || coord == before + 2) {
+                    error *= 2.0 / 3.0;
+                }
+            }
+            new_errors[y * new_width + x] = error;
+        }
+    }
+    return new_errors;
+}
+
+/**
+labels units with the new input vectors mapped to them, updates their child maps with these vectors, and creates
+child maps for units without child map whose error now exceeds the depth threshold
+*/
+static void somr_trainer_update_children(somr_trainer_t *t) {
+    SOMR_STATS_TIMER_BEGIN(timer);
+    somr_trainer_trace_begin(t, SOMR_PHASE_DEEPEN);
+
+    somr_trainer_prepare_map(t);
+    somr_map_build_index(t->map);
+    somr_trainer_account_map(t);
+
+    // group input vectors by bmu, in a single pass
+    somr_unit_id_t *bmu_ids = malloc(sizeof(somr_unit_id_t) * t->dataset->size);
+    for (unsigned int i = 0; i < t->dataset->size; i++) {
+        somr_data_vector_t *data_vector = somr_dataset_get_vector(t->dataset, i);
+        bmu_ids[i] = somr_map_find_bmu(t->map, data_vector);
+
+        // labels of units with a child map are merged with those of the new input vectors once they are grouped
+        somr_label_t label = data_vector->label;
+        if (t->labels_map != NULL && label != SOMR_EMPTY_LABEL) {
+            label = t->labels_map[label];
+        }
+        if (t->map->units[bmu_ids[i]].child == NULL) {
+            t->map->units[bmu_ids[i]].label = label;
+        }
+    }
+    unsigned int *offsets = calloc(t->map->units_count + 1, sizeof(unsigned int));
+    size_t offsets_bytes = sizeof(unsigned int) * (t->map->units_count + 1);
+    somr_trainer_account_scratch(t, sizeof(somr_unit_id_t) * t->dataset->size + offsets_bytes, true);
+    somr_trainer_partition(t, bmu_ids, offsets);
+    free(bmu_ids);
+    somr_trainer_account_scratch(t, sizeof(somr_unit_id_t) * t->dataset->size, false);
+
+    somr_counters_t *counters = somr_trainer_get_counters(t);
+    SOMR_STATS_COUNT(counters, bmu_searches_count, t->dataset->size);
+    SOMR_STATS_COUNT(counters, dist_evals_count, (unsigned long long) t->dataset->size * t->map->units_count);
+    SOMR_STATS_COUNT(counters, dataset_bytes, (unsigned long long) t->dataset->size * t->features_count * somr_dataset_get_feature_size(t->dataset));
+    SOMR_STATS_TIMER_END(timer, counters, SOMR_PHASE_DEEPEN);
+    somr_trainer_trace_end(t);
+
+    double error_threshold = t->root_mean_error * t->settings->depth_threshold;
+
+    for (somr_unit_id_t i = 0; i < t->map->units_count; i++) {
+        somr_unit_t *unit = &t->map->units[i];
+        unsigned int data_vectors_count = offsets[i + 1] - offsets[i];
+        bool should_deepen = unit->child == NULL && unit->error > error_threshold && data_vectors_count > 1 && somr_trainer_fit_child(t);
+        if (data_vectors_count == 0 || (unit->child == NULL && !should_deepen)) {
+            continue;
+        }
+
+        if (should_deepen) {
+            somr_map_add_child(t->map, i, t->settings->should_orient, &t->settings->rand_state);
+            somr_trainer_account_subtree(t, unit->child, true);
+            counters = somr_trainer_get_counters(t);
+            SOMR_STATS_COUNT(counters, children_count, 1);
+        }
+
+        somr_dataset_t child_dataset;
+        somr_dataset_init_from_parent(&child_dataset, t->dataset, offsets[i], data_vectors_count);
+        somr_trainer_t child_trainer;
+        somr_trainer_init(&child_trainer, unit->child, &child_dataset, t->root_mean_error, unit->error, t->settings);
+        child_trainer.labels_map = t->labels_map;
+        if (t->settings->stats != NULL && t->stats_index >= 0) {
+            child_trainer.stats_index = somr_stats_add_map(t->settings->stats, t->stats_index, i, data_vectors_count);
+        }
+
+        // new child maps are trained from scratch on new input vectors, existing ones are updated
+        if (should_deepen) {
+            somr_trainer_train(&child_trainer);
+            // previous input vectors may be mapped to units without new input vectors
+            somr_trainer_fill_empty_labels(unit->child, unit->label);
+        } else {
+            somr_trainer_update(&child_trainer);
+        }
+
+        somr_dataset_clear(&child_dataset);
+    }
+    // new input vectors add to those behind labels of units with a child map
+    somr_trainer_label_parents(t, offsets, true);
+
+    somr_trainer_account_scratch(t, offsets_bytes, false);
+    free(offsets);
+}
+
+/** assigns @p label to units of @p m (and of its child maps, recursively) that have no label */
+static void somr_trainer_fill_empty_labels(somr_map_t *m, somr_label_t label) {
+    for (somr_unit_id_t i = 0; i < m->units_count; i++) {
+        somr_unit_t *unit = &m->units[i];
+        if (unit->label == SOMR_EMPTY_LABEL) {
+            unit->label = label;
+        }
+        if (unit->child != NULL) {
+            somr_trainer_fill_empty_labels(unit->child, unit->label);
+        }
+    }
+}
+
+/**
+applies pending scales of unit weights and computes unit norms used by dot product kernels: called before bmus are searched
+(weights may have been written by insertions or orientation), and after learning so that weights are usable as such
+*/
+static void somr_trainer_prepare_map(somr_trainer_t *t) {
+    somr_map_update_norms(t->map);
 }
@@ -3,12 +3,21 @@
 #include "map.h"
 #include "vector.h"
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+/** smallest scale of unit weights kept during sparse updates (folding it into weights costs a dense pass, so it is kept rare) */
+#define SOMR_UNIT_MIN_SCALE 1e-100
+/** below this number of features, the full euclidean distance is faster than the dot product of normalized vectors */
+#define SOMR_UNIT_DOT_MIN_FEATURES 32
+
 void somr_unit_init(somr_unit_t *n, unsigned int features_count) {
     n->weights = malloc(sizeof(double) * features_count);
+    n->scale = 1.0;
+    n->norm_squared = 0.0;
     n->label = SOMR_EMPTY_LABEL;
+    n->label_count = 0;
     n->child = NULL;
 }
 
@@ -33,22 +42,183 @@ void somr_unit_init_random_weights(somr_unit_t *n, unsigned int *rand_sate, unsi
     }
 }
 
-void somr_unit_activate(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count) {
-    assert(features_count > 0);
+void somr_unit_update_norm(somr_unit_t *n, unsigned int features_count) {
+    double norm_squared = 0.0;
+    for (unsigned int i = 0; i < features_count; i++) {
+        n->weights[i] *= n->scale;
+        norm_squared += n->weights[i] * n->weights[i];
+    }
+    n->scale = 1.0;
+    n->norm_squared = norm_squared;
+}
+
+/** @return number of features of block starting at @p begin, for kernels of quantized input vectors */
+static unsigned int somr_unit_get_block_count(unsigned int begin, unsigned int features_count) {
+    return (features_count - begin < SOMR_QUANTIZER_BLOCK_SIZE) ? features_count - begin : SOMR_QUANTIZER_BLOCK_SIZE;
+}
+
+/** @return dot product of (scaled) unit weights with input vector */
+static double somr_unit_dot(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count) {
+    if (somr_data_vector_is_sparse(data_vector)) {
+        return n->scale * somr_vector_sparse_dot(n->weights, data_vector->nnz_indices, data_vector->nnz_values, data_vector->nnz_count);
+    }
+    if (somr_data_vector_is_quantized(data_vector)) {
+        double block[SOMR_QUANTIZER_BLOCK_SIZE];
+        double dot = 0.0;
+        for (unsigned int begin = 0; begin < features_count; begin += SOMR_QUANTIZER_BLOCK_SIZE) {
+            unsigned int count = somr_unit_get_block_count(begin, features_count);
+            somr_data_vector_get_block(data_vector, begin, count, block);
+            dot += somr_vector_dot(&n->weights[begin], block, count);
+        }
+        return n->scale * dot;
+    }
+    return n->scale * somr_vector_dot(n->weights, data_vector->weights, features_count);
+}
+
+static void somr_unit_activate_euclid(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count) {
+    bool has_norm = data_vector->norm_squared >= 0.0;
+    if (somr_data_vector_is_sparse(data_vector) || (has_norm && features_count >= SOMR_UNIT_DOT_MIN_FEATURES)) {
+        // |w - x|^2 = |w|^2 - 2 w.x + |x|^2, clamped as rounding may make it slightly negative
+        double activation = n->norm_squared - 2.0 * somr_unit_dot(n, data_vector, features_count) + data_vector->norm_squared;
+        n->activation = (activation > 0.0) ? activation : 0.0;
+        return;
+    }
 
     // sqrt omitted on purpose, not need if we only use the activation value for comparison
+    if (somr_data_vector_is_quantized(data_vector)) {
+        double block[SOMR_QUANTIZER_BLOCK_SIZE];
+        n->activation = 0.0;
+        for (unsigned int begin = 0; begin < features_count; begin += SOMR_QUANTIZER_BLOCK_SIZE) {
+            unsigned int count = somr_unit_get_block_count(begin, features_count);
+            somr_data_vector_get_block(data_vector, begin, count, block);
+            n->activation += somr_vector_euclid_dist_squared(&n->weights[begin], block, count);
+        }
+        return;
+    }
     n->activation = somr_vector_euclid_dist_squared(n->weights, data_vector->weights, features_count);
 }
 
+static void somr_unit_activate_cosine(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count) {
+    double norm_squared = data_vector->norm_squared;
+    if (norm_squared < 0.0) {
+        norm_squared = somr_vector_dot(data_vector->weights, data_vector->weights, features_count);
+    }
+    double norms_product = sqrt(n->norm_squared * norm_squared);
+    double cos = (norms_product > 0.0) ? somr_unit_dot(n, data_vector, features_count) / norms_product : 0.0;
+    // squared chord distance between unit vectors
+    double activation = 2.0 - 2.0 * cos;
+    n->activation = (activation > 0.0) ? activation : 0.0;
+}
+
+static void somr_unit_activate_manhattan(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count) {
+    double dist;
+    if (somr_data_vector_is_sparse(data_vector)) {
+        // walk all features, consuming non-zero values as their index comes
+        dist = 0.0;
+        unsigned int k = 0;
+        for (unsigned int i = 0; i < features_count; i++) {
+            double value = 0.0;
+            if (k < data_vector->nnz_count && data_vector->nnz_indices[k] == i) {
+                value = data_vector->nnz_values[k];
+                k++;
+            }
+            dist += fabs(n->scale * n->weights[i] - value);
+        }
+    } else if (somr_data_vector_is_quantized(data_vector)) {
+        double block[SOMR_QUANTIZER_BLOCK_SIZE];
+        dist = 0.0;
+        for (unsigned int begin = 0; begin < features_count; begin += SOMR_QUANTIZER_BLOCK_SIZE) {
+            unsigned int count = somr_unit_get_block_count(begin, features_count);
+            somr_data_vector_get_block(data_vector, begin, count, block);
+            dist += somr_vector_manhattan_dist(&n->weights[begin], block, count);
+        }
+    } else {
+        dist = somr_vector_manhattan_dist(n->weights, data_vector->weights, features_count);
+    }
+    n->activation = dist * dist;
+}
+
+void somr_unit_activate(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count, somr_metric_t metric) {
+    assert(features_count > 0);
+
+    switch (metric) {
+    case SOMR_METRIC_EUCLID:
+        somr_unit_activate_euclid(n, data_vector, features_count);
+        break;
+    case SOMR_METRIC_COSINE:
+        somr_unit_activate_cosine(n, data_vector, features_count);
+        break;
+    case SOMR_METRIC_MANHATTAN:
+        somr_unit_activate_manhattan(n, data_vector, features_count);
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+/**
+sparse version of somr_unit_learn: w + r (x - w) = (1 - r) w + r x, with (1 - r) applied to scale of unit,
+and squared norm of weights updated from their dot product with x
+*/
+static void somr_unit_learn_sparse(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count, double learn_rate) {
+    unsigned int *indices = data_vector->nnz_indices;
+    double *values = data_vector->nnz_values;
+    double keep_rate = 1.0 - learn_rate;
+    double dot = n->scale * somr_vector_sparse_dot(n->weights, indices, values, data_vector->nnz_count);
+    double norm_squared = keep_rate * keep_rate * n->norm_squared + 2.0 * keep_rate * learn_rate * dot
+        + learn_rate * learn_rate * data_vector->norm_squared;
+
+    // fold scale into weights before it gets too small to divide by
+    if (n->scale * keep_rate < SOMR_UNIT_MIN_SCALE) {
+        somr_unit_update_norm(n, features_count);
+        for (unsigned int i = 0; i < features_count; i++) {
+            n->weights[i] *= keep_rate;
+        }
+    } else {
+        n->scale *= keep_rate;
+    }
+    for (unsigned int i = 0; i < data_vector->nnz_count; i++) {
+        n->weights[indices[i]] += learn_rate * values[i] / n->scale;
+    }
+    n->norm_squared = (norm_squared > 0.0) ? norm_squared : 0.0;
+}
+
 void somr_unit_learn(somr_unit_t *n, somr_data_vector_t *data_vector, unsigned int features_count, double learn_rate) {
     assert(features_count > 0);
     assert(learn_rate > 0.0);
 
+    if (somr_data_vector_is_sparse(data_vector)) {
+        somr_unit_learn_sparse(n, data_vector, features_count, learn_rate);
+        return;
+    }
+
+    assert(n->scale == 1.0);
+    if (somr_data_vector_is_quantized(data_vector)) {
+        // same update, decoding a block of input features at a time
+        double block[SOMR_QUANTIZER_BLOCK_SIZE];
+        double norm_squared = 0.0;
+        for (unsigned int begin = 0; begin < features_count; begin += SOMR_QUANTIZER_BLOCK_SIZE) {
+            unsigned int count = somr_unit_get_block_count(begin, features_count);
+            somr_data_vector_get_block(data_vector, begin, count, block);
+            double *weights = &n->weights[begin];
+            for (unsigned int i = 0; i < count; i++) {
+                weights[i] += learn_rate * (block[i] - weights[i]);
+                norm_squared += weights[i] * weights[i];
+            }
+        }
+        n->norm_squared = norm_squared;
+        return;
+    }
+
+    double norm_squared = 0.0;
     for (unsigned int i = 0; i < features_count; i++) {
         double delta = data_vector->weights[i] - n->weights[i];
         n->weights[i] += learn_rate * delta;
+        norm_squared += n->weights[i] * n->weights[i];
         assert(abs(data_vector->weights[i] - n->weights[i]) <= abs(delta));
     }
+    n->norm_squared = norm_squared;
 }
 
 void somr_unit_add_child(somr_unit_t *n, unsigned int features_count) {
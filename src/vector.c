@@ -33,6 +33,37 @@ double somr_vector_euclid_dist(double *lhs, double *rhs, unsigned int length) {
     return sqrt(somr_vector_euclid_dist_squared(lhs, rhs, length));
 }
 
+double somr_vector_dot(double *lhs, double *rhs, unsigned int length) {
+    double sums[4] = { 0.0, 0.0, 0.0, 0.0 };
+    unsigned int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        sums[0] += lhs[i] * rhs[i];
+        sums[1] += lhs[i + 1] * rhs[i + 1];
+        sums[2] += lhs[i + 2] * rhs[i + 2];
+        sums[3] += lhs[i + 3] * rhs[i + 3];
+    }
+    for (; i < length; i++) {
+        sums[0] += lhs[i] * rhs[i];
+    }
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+double somr_vector_manhattan_dist(double *lhs, double *rhs, unsigned int length) {
+    double result = 0.0;
+    for (unsigned int i = 0; i < length; i++) {
+        result += fabs(lhs[i] - rhs[i]);
+    }
+    return result;
+}
+
+double somr_vector_sparse_dot(double *dense, unsigned int *indices, double *values, unsigned int nnz_count) {
+    double result = 0.0;
+    for (unsigned int i = 0; i < nnz_count; i++) {
+        result += dense[indices[i]] * values[i];
+    }
+    return result;
+}
+
 void somr_vectors_mean(double **vectors, unsigned int vectors_count, unsigned int length, double *result) {
     assert(length > 0);
     assert(vectors_count > 0);
@@ -3,4 +3,10 @@
 void somr_vector_normalize(double *v, unsigned int length);
 double somr_vector_euclid_dist_squared(double *lhs, double *rhs, unsigned int length);
 double somr_vector_euclid_dist(double *lhs, double *rhs, unsigned int length);
+/** dot product, with independent partial sums so that additions do not wait for each other */
+double somr_vector_dot(double *lhs, double *rhs, unsigned int length);
+/** sum of absolute differences */
+double somr_vector_manhattan_dist(double *lhs, double *rhs, unsigned int length);
+/** dot product of dense vector @p dense with the sparse vector of @p nnz_count values @p values at indices @p indices */
+double somr_vector_sparse_dot(double *dense, unsigned int *indices, double *values, unsigned int nnz_count);
 void somr_vectors_mean(double **vectors, unsigned int vectors_count, unsigned int length, double *result);